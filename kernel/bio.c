@@ -1,10 +1,15 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
 //
+// Each hash bucket, keyed by (dev, blockno), has its own lock,
+// so lookups of different blocks don't contend. Recycling a
+// buffer is serialized by bcache.lock and takes the least
+// recently released unused buffer from any bucket.
+//
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
 // * After changing buffer data, call bwrite to write it to disk.
@@ -12,6 +17,8 @@
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+// * bprefetch starts reads that nobody waits for; a later
+//     bread of the block sleeps until the data arrives.
 
 
 #include "types.h"
@@ -19,36 +26,79 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "riscv.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
 
-struct {
+struct bucket {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct buf head;   // circular list through prev/next
+};
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+struct {
+  struct spinlock lock;  // serializes buffer recycling
+  struct buf buf[NBUF];
+  struct bucket bucket[NBUCKET];
 } bcache;
 
+static struct bucket*
+bhash(uint dev, uint blockno)
+{
+  return &bcache.bucket[(dev * 31 + blockno) % NBUCKET];
+}
+
+// unlink b from its bucket. caller holds the bucket lock.
+static void
+bunlink(struct buf *b)
+{
+  b->next->prev = b->prev;
+  b->prev->next = b->next;
+}
+
+// insert b at the front of bk. caller holds bk->lock.
+static void
+binsert(struct bucket *bk, struct buf *b)
+{
+  b->next = bk->head.next;
+  b->prev = &bk->head;
+  bk->head.next->prev = b;
+  bk->head.next = b;
+}
+
+// return the cached buffer for (dev, blockno) in bk, with
+// a new reference, or 0. caller holds bk->lock.
+static struct buf*
+blookup(struct bucket *bk, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bk->head.next; b != &bk->head; b = b->next){
+    if(b->dev == dev && b->blockno == blockno){
+      b->refcnt++;
+      return b;
+    }
+  }
+  return 0;
+}
+
 void
 binit(void)
 {
   struct buf *b;
+  struct bucket *bk;
 
   initlock(&bcache.lock, "bcache");
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++){
+    initlock(&bk->lock, "bcache.bucket");
+    bk->head.prev = &bk->head;
+    bk->head.next = &bk->head;
+  }
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
+  // Spread the buffers over the buckets.
   for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    binsert(&bcache.bucket[(b - bcache.buf) % NBUCKET], b);
   }
 }
 
@@ -58,34 +108,71 @@ binit(void)
 static struct buf*
 bget(uint dev, uint blockno)
 {
-  struct buf *b;
+  struct buf *b, *victim;
+  struct bucket *bk, *vb, *t;
 
-  acquire(&bcache.lock);
+  bk = bhash(dev, blockno);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  acquire(&bk->lock);
+  b = blookup(bk, dev, blockno);
+  release(&bk->lock);
+  if(b){
+    acquiresleep(&b->lock);
+    return b;
   }
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+  // Not cached. Only one CPU at a time recycles, so look
+  // again in case another CPU cached the block meanwhile.
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  b = blookup(bk, dev, blockno);
+  release(&bk->lock);
+  if(b){
+    release(&bcache.lock);
+    acquiresleep(&b->lock);
+    return b;
+  }
+
+  // Find the least recently used unused buffer, keeping
+  // the lock of the bucket that holds it.
+  victim = 0;
+  vb = 0;
+  for(t = bcache.bucket; t < bcache.bucket+NBUCKET; t++){
+    int better = 0;
+    acquire(&t->lock);
+    for(b = t->head.next; b != &t->head; b = b->next){
+      if(b->refcnt == 0 && (victim == 0 || b->lastuse < victim->lastuse)){
+        victim = b;
+        better = 1;
+      }
+    }
+    if(better){
+      if(vb)
+        release(&vb->lock);
+      vb = t;
+    } else {
+      release(&t->lock);
     }
   }
-  panic("bget: no buffers");
+  if(victim == 0)
+    panic("bget: no buffers");
+
+  bunlink(victim);
+  release(&vb->lock);
+
+  victim->dev = dev;
+  victim->blockno = blockno;
+  victim->valid = 0;
+  victim->refcnt = 1;
+
+  acquire(&bk->lock);
+  binsert(bk, victim);
+  release(&bk->lock);
+  release(&bcache.lock);
+
+  acquiresleep(&victim->lock);
+  return victim;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -93,9 +180,12 @@ struct buf*
 bread(uint dev, uint blockno)
 {
   struct buf *b;
+  struct proc *p;
 
   b = bget(dev, blockno);
   if(!b->valid) {
+    if((p = myproc()) != 0)
+      p->ninblock++;
     virtio_disk_rw(b, 0);
     b->valid = 1;
   }
@@ -111,43 +201,106 @@ bwrite(struct buf *b)
   virtio_disk_rw(b, 1);
 }
 
+// Write n locked bufs to disk as one batch.
+void
+bwritev(struct buf **bufs, int n)
+{
+  for(int i = 0; i < n; i++)
+    if(!holdingsleep(&bufs[i]->lock))
+      panic("bwritev");
+  virtio_disk_rwv(bufs, n, 1);
+}
+
+// Start reading blocks blocknos[0..n-1] into the cache
+// without waiting for them. Blocks already cached are
+// skipped; the rest go to the disk as one batch, each
+// buffer staying locked until bdone() releases it.
+void
+bprefetch(uint dev, uint *blocknos, int n)
+{
+  struct buf *bufs[NREADAHEAD], *b;
+  struct bucket *bk;
+  int i, m;
+
+  if(n > NREADAHEAD)
+    panic("bprefetch");
+
+  m = 0;
+  for(i = 0; i < n; i++){
+    bk = bhash(dev, blocknos[i]);
+    acquire(&bk->lock);
+    b = blookup(bk, dev, blocknos[i]);
+    if(b)
+      b->refcnt--;
+    release(&bk->lock);
+    if(b)
+      continue;
+    b = bget(dev, blocknos[i]);
+    if(b->valid)
+      brelse(b);
+    else
+      bufs[m++] = b;
+  }
+  if(m > 0)
+    virtio_disk_read_async(bufs, m);
+}
+
+// Called by virtio_disk_intr() when a prefetch read
+// completes: mark the buffer valid and release it on
+// behalf of the process that started the read.
+void
+bdone(struct buf *b)
+{
+  struct bucket *bk;
+
+  b->valid = 1;
+  releasesleep(&b->lock);
+
+  bk = bhash(b->dev, b->blockno);
+  acquire(&bk->lock);
+  b->refcnt--;
+  if (b->refcnt == 0)
+    b->lastuse = ticks;
+  release(&bk->lock);
+}
+
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// Record the release time for LRU recycling.
 void
 brelse(struct buf *b)
 {
+  struct bucket *bk;
+
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  bk = bhash(b->dev, b->blockno);
+  acquire(&bk->lock);
   b->refcnt--;
   if (b->refcnt == 0) {
     // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->lastuse = ticks;
   }
-  
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = bhash(b->dev, b->blockno);
+
+  acquire(&bk->lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = bhash(b->dev, b->blockno);
+
+  acquire(&bk->lock);
   b->refcnt--;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
-
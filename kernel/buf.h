@@ -5,8 +5,12 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
+  uint lastuse;     // ticks at last release, for LRU
+  struct buf *prev; // hash bucket list
   struct buf *next;
+  struct buf *qnext; // disk queue, or the rest of its request; vdisk_lock
+  int *qpending;    // its batch's count of unfinished bufs, or 0 if async
+  char qwrite;      // queued to be written, not read
   uchar data[BSIZE];
 };
 
@@ -21,6 +21,7 @@
 #include "riscv.h"
 #include "defs.h"
 #include "proc.h"
+#include "poll.h"
 
 #define BACKSPACE 0x100
 #define C(x)  ((x)-'@')  // Control-x
@@ -50,6 +51,7 @@ struct {
   uint r;  // Read index
   uint w;  // Write index
   uint e;  // Edit index
+  struct pollent *pollq;  // processes in poll(); polllock
 } cons;
 
 //
@@ -58,13 +60,16 @@ struct {
 int
 consolewrite(int user_src, uint64 src, int n)
 {
-  int i;
-
-  for(i = 0; i < n; i++){
-    char c;
-    if(either_copyin(&c, user_src, src+i, 1) == -1)
+  char buf[256];
+  int i, m;
+
+  for(i = 0; i < n; i += m){
+    m = n - i;
+    if(m > sizeof(buf))
+      m = sizeof(buf);
+    if(either_copyin(buf, user_src, src+i, m) == -1)
       break;
-    uartputc(c);
+    uartwrite(buf, m);
   }
 
   return i;
@@ -79,11 +84,14 @@ consolewrite(int user_src, uint64 src, int n)
 int
 consoleread(int user_dst, uint64 dst, int n)
 {
-  uint target;
-  int c;
-  char cbuf;
+  uint target, i;
+  int c, m, eol, eof;
 
   target = n;
+  // copyout() below can't read file pages from disk
+  // while holding cons.lock.
+  if(user_dst && n > 0)
+    uvmprefault(myproc(), dst, n, 1);
   acquire(&cons.lock);
   while(n > 0){
     // wait until interrupt handler has put some
@@ -96,26 +104,43 @@ consoleread(int user_dst, uint64 dst, int n)
       sleep(&cons.r, &cons.lock);
     }
 
-    c = cons.buf[cons.r++ % INPUT_BUF_SIZE];
+    // find the longest span that can go out in one copy:
+    // up to a newline, an end-of-file, the end of the
+    // input that has arrived, or the end of cons.buf.
+    i = cons.r % INPUT_BUF_SIZE;
+    m = eol = eof = 0;
+    while(m < n && cons.r + m != cons.w && i + m < INPUT_BUF_SIZE){
+      c = cons.buf[i + m];
+      if(c == C('D')){
+        eof = 1;
+        break;
+      }
+      m++;
+      if(c == '\n'){
+        eol = 1;
+        break;
+      }
+    }
 
-    if(c == C('D')){  // end-of-file
-      if(n < target){
-        // Save ^D for next time, to make sure
+    // copy the span to the user-space buffer.
+    if(m > 0){
+      if(either_copyout(user_dst, dst, &cons.buf[i], m) == -1)
+        break;
+      cons.r += m;
+      dst += m;
+      n -= m;
+    }
+
+    if(eof){  // end-of-file
+      if(n == target){
+        // consume the ^D only if it is all we return;
+        // otherwise save it for next time, to make sure
         // caller gets a 0-byte result.
-        cons.r--;
+        cons.r++;
       }
       break;
     }
-
-    // copy the input byte to the user-space buffer.
-    cbuf = c;
-    if(either_copyout(user_dst, dst, &cbuf, 1) == -1)
-      break;
-
-    dst++;
-    --n;
-
-    if(c == '\n'){
+    if(eol){
       // a whole line has arrived, return to
       // the user-level read().
       break;
@@ -170,6 +195,7 @@ consoleintr(int c)
         // has arrived.
         cons.w = cons.e;
         wakeup(&cons.r);
+        pollwake(&cons.pollq);
       }
     }
     break;
@@ -178,6 +204,23 @@ consoleintr(int c)
   release(&cons.lock);
 }
 
+// Put e, if not 0, on the console's poll queue, and return
+// POLLIN if a line of input is waiting. Writes don't block
+// for long, so the console is always POLLOUT.
+int
+consolepoll(struct pollent *e)
+{
+  int r = POLLOUT;
+
+  if(e)
+    polladd(&cons.pollq, e);
+  acquire(&cons.lock);
+  if(cons.r != cons.w)
+    r |= POLLIN;
+  release(&cons.lock);
+  return r;
+}
+
 void
 consoleinit(void)
 {
@@ -0,0 +1,157 @@
+// Directory name cache.
+//
+// Maps (dev, directory inum, name) to the inum the name refers
+// to, so that dirlookup() can resolve a path element without
+// reading the directory. A name known to be absent is cached
+// with inum 0, so repeated lookups of missing names are cheap
+// too.
+//
+// Entries for a directory are only changed by callers holding
+// that directory's lock: dirlookup() fills them in, dirlink()
+// and unlink record additions and removals, and iput() purges
+// a directory's entries when the directory is freed.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "file.h"
+
+#define NDCENTRY  128  // cached names
+#define NDCBUCKET 31
+
+struct dcentry {
+  uint dev;
+  uint dinum;           // directory
+  char name[DIRSIZ];
+  uint inum;            // 0 if the name is known to be absent
+  uint off;             // offset of the dirent in the directory
+  int used;
+  struct dcentry *next; // hash chain
+};
+
+struct {
+  struct spinlock lock;
+  struct dcentry entry[NDCENTRY];
+  struct dcentry *bucket[NDCBUCKET];
+  int hand;             // next slot to evict
+  uint64 nhit;
+  uint64 nmiss;
+} dcache;
+
+static struct dcentry**
+dchash(uint dev, uint dinum, char *name)
+{
+  uint h = dev * 31 + dinum;
+
+  for(int i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 33 + (uchar)name[i];
+  return &dcache.bucket[h % NDCBUCKET];
+}
+
+// Find the entry for name in directory dp. Caller holds dcache.lock.
+static struct dcentry*
+dcfind(struct inode *dp, char *name)
+{
+  struct dcentry *e;
+
+  for(e = *dchash(dp->dev, dp->inum, name); e; e = e->next){
+    if(e->dev == dp->dev && e->dinum == dp->inum &&
+       strncmp(e->name, name, DIRSIZ) == 0)
+      return e;
+  }
+  return 0;
+}
+
+// Remove e from its hash chain. Caller holds dcache.lock.
+static void
+dcdrop(struct dcentry *e)
+{
+  struct dcentry **pp;
+
+  for(pp = dchash(e->dev, e->dinum, e->name); *pp; pp = &(*pp)->next){
+    if(*pp == e){
+      *pp = e->next;
+      break;
+    }
+  }
+  e->used = 0;
+  e->next = 0;
+}
+
+void
+dcacheinit(void)
+{
+  initlock(&dcache.lock, "dcache");
+}
+
+// Look up name in directory dp. On a hit, set *inum (0 for a
+// name known to be absent) and *off and return 0; otherwise
+// return -1. Caller holds dp->lock.
+int
+dcache_lookup(struct inode *dp, char *name, uint *inum, uint *off)
+{
+  struct dcentry *e;
+
+  acquire(&dcache.lock);
+  if((e = dcfind(dp, name)) == 0){
+    dcache.nmiss++;
+    release(&dcache.lock);
+    return -1;
+  }
+  dcache.nhit++;
+  *inum = e->inum;
+  *off = e->off;
+  release(&dcache.lock);
+  return 0;
+}
+
+// Record that name in directory dp refers to inum, found at
+// offset off, or with inum 0 that it is absent.
+// Caller holds dp->lock.
+void
+dcache_enter(struct inode *dp, char *name, uint inum, uint off)
+{
+  struct dcentry *e;
+
+  acquire(&dcache.lock);
+  if((e = dcfind(dp, name)) == 0){
+    e = &dcache.entry[dcache.hand];
+    dcache.hand = (dcache.hand + 1) % NDCENTRY;
+    if(e->used)
+      dcdrop(e);
+    e->dev = dp->dev;
+    e->dinum = dp->inum;
+    strncpy(e->name, name, DIRSIZ);
+    e->used = 1;
+    e->next = *dchash(dp->dev, dp->inum, name);
+    *dchash(dp->dev, dp->inum, name) = e;
+  }
+  e->inum = inum;
+  e->off = off;
+  release(&dcache.lock);
+}
+
+// Forget every name in directory dp, which is being freed.
+void
+dcache_purge(struct inode *dp)
+{
+  struct dcentry *e;
+
+  acquire(&dcache.lock);
+  for(e = dcache.entry; e < &dcache.entry[NDCENTRY]; e++){
+    if(e->used && e->dev == dp->dev && e->dinum == dp->inum)
+      dcdrop(e);
+  }
+  release(&dcache.lock);
+}
+
+// Print cache statistics. For debugging.
+void
+dcachedump(void)
+{
+  printf("dcache: hit %ld miss %ld\n", dcache.nhit, dcache.nmiss);
+}
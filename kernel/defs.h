@@ -2,18 +2,27 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct iovec;
 struct pipe;
+struct pollent;
+struct pollfd;
 struct proc;
 struct spinlock;
 struct sleeplock;
+struct spawnact;
 struct stat;
+struct vma;
 struct superblock;
+struct timer;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bwritev(struct buf**, int);
+void            bprefetch(uint, uint*, int);
+void            bdone(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
 
@@ -21,18 +30,25 @@ void            bunpin(struct buf*);
 void            consoleinit(void);
 void            consoleintr(int);
 void            consputc(int);
+int             consolepoll(struct pollent*);
 
 // exec.c
 int             exec(char*, char**);
+int             execproc(struct proc*, char*, char**);
 
 // file.c
 struct file*    filealloc(void);
 void            fileclose(struct file*);
 struct file*    filedup(struct file*);
+struct file*    fileinherit(struct file*);
+int             filepoll(struct file*, struct pollent*);
+int             filesend(struct file*, struct file*, int);
 void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             filereadv(struct file*, struct iovec*, int);
+int             filewritev(struct file*, struct iovec*, int);
 
 // fs.c
 void            fsinit(int);
@@ -45,6 +61,8 @@ void            ilock(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
+void            ilockshared(struct inode*);
+void            iunlockshared(struct inode*);
 void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
@@ -61,20 +79,84 @@ void            ramdiskrw(struct buf*);
 
 // kalloc.c
 void*           kalloc(void);
+void*           kzalloc(void);
+void*           kalloc_order(int);
+void            kfree_order(void *, int);
+void            ksplit(void *, int);
+int             memstat(uint64);
 void            kfree(void *);
+void            kmemdump(void);
+void            kref(void *);
+int             krefcount(void *);
 void            kinit(void);
+int             kinitchunk(void);
+void            kzeroinit(void);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
+void            log_data(struct buf*);
+void            log_freed(uint);
 void            begin_op(void);
 void            end_op(void);
 
+// dcache.c
+void            dcacheinit(void);
+int             dcache_lookup(struct inode*, char*, uint*, uint*);
+void            dcache_enter(struct inode*, char*, uint, uint);
+void            dcache_purge(struct inode*);
+void            dcachedump(void);
+
+// pcache.c
+void            pcacheinit(void);
+char*           pcache_get(struct inode*, uint);
+void            pcache_inval(struct inode*);
+void            pcache_write(struct inode*, uint, char*, uint);
+void            pcachedump(void);
+int             pcache_reclaim(void);
+
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, uint64, int);
-int             pipewrite(struct pipe*, uint64, int);
+int             piperead(struct pipe*, int, uint64, int);
+int             pipewrite(struct pipe*, int, uint64, int);
+int             pipepoll(struct pipe*, int, struct pollent*);
+
+// poll.c
+void            pollinit(void);
+void            polladd(struct pollent**, struct pollent*);
+void            polldel(struct pollent*);
+void            pollwake(struct pollent**);
+int             poll(struct pollfd*, int, int);
+
+// trace.c
+extern int      tracemask;
+void            traceinit(void);
+void            tracerec(int, uint64, uint64);
+int             trace(int);
+int             traceread(uint64, int);
+#define TRACE(type, a, b) \
+  do { if(tracemask & (1 << (type))) tracerec((type), (a), (b)); } while(0)
+
+// uring.c
+int             uring_enter(uint64);
+
+// prof.c
+extern int      profon;
+void            profinit(void);
+void            profsample(uint64, int);
+int             profile(int);
+int             profread(uint64, int);
+
+// slab.c
+struct kmem_cache;
+void            slabinit(void);
+void            kmem_cache_init(struct kmem_cache*, char*, uint);
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+int             slab_reclaim(void);
+void            slabdump(void);
 
 // printf.c
 int            printf(char*, ...) __attribute__ ((format (printf, 1, 2)));
@@ -85,6 +167,7 @@ void            printfinit(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
+int             spawn(char*, char**, struct spawnact*, int, int);
 int             growproc(int);
 void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
@@ -101,11 +184,24 @@ void            sched(void);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
+int             wait_batch(uint64, int);
+int             reapn(uint64, int, int);
+int             chldpoll(struct pollent*);
 void            wakeup(void*);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+int             schedstat(uint64, int);
+int             setsid(void);
+int             nprocs(int);
+int             setpriority(int, int);
+int             setmaxproc(int);
+int             setpgid(int, int);
+int             killpg(int);
+int             getrusage(int, uint64);
+int             proc_reclaim(void);
+int             kthread_create(void (*)(void*), void*, char*);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
@@ -114,7 +210,9 @@ void            swtch(struct context*, struct context*);
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+int             lockstat(uint64, int);
 void            release(struct spinlock*);
+int             tryacquire(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
 
@@ -122,12 +220,16 @@ void            pop_off(void);
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
+void            acquiresleepshared(struct sleeplock*);
+void            releasesleepshared(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
 // string.c
 int             memcmp(const void*, const void*, uint);
 void*           memmove(void*, const void*, uint);
 void*           memset(void*, int, uint);
+void            pagecopy(void*, const void*);
+void            pagezero(void*);
 char*           safestrcpy(char*, const char*, int);
 int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
@@ -141,6 +243,15 @@ int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
 
+// timer.c
+int             tsleep(uint);
+uint64          clocktick(void);
+uint64          timeridle(void);
+void            tstart(struct timer*, uint, void (*)(void*), void*);
+void            tcancel(struct timer*);
+extern char     vdsopage[];
+void            vdsoinit(void);
+
 // trap.c
 extern uint     ticks;
 void            trapinit(void);
@@ -151,7 +262,7 @@ void            usertrapret(void);
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
-void            uartputc(int);
+void            uartwrite(char*, int);
 void            uartputc_sync(int);
 int             uartgetc(void);
 
@@ -168,11 +279,26 @@ int             uvmcopy(pagetable_t, pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+void            utlbflush(pagetable_t);
+uint64          asidswitch(struct proc*);
+void            uvmflush(pagetable_t, uint64);
 pte_t *         walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
+uint64          ptepa(pte_t, uint64);
+int             uvmsplitat(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
+int             uvmcow(pagetable_t, uint64);
+int             uvmfault(struct proc*, uint64, int);
+void            uvmprefault(struct proc*, uint64, uint64, int);
+void            vmafree(struct vma*);
+void            vmatrim(struct vma*, uint64);
+uint64          mmapbase(struct proc*);
+uint64          mmap(uint64, int, int, struct inode*, uint64);
+int             munmap(uint64, uint64);
+void            munmapall(struct proc*);
+int             vmacopy(struct proc*, struct proc*);
 
 // plic.c
 void            plicinit(void);
@@ -183,7 +309,10 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_rwv(struct buf **, int, int);
+void            virtio_disk_read_async(struct buf **, int);
 void            virtio_disk_intr(void);
+void            virtio_disk_tick(void);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
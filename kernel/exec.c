@@ -19,8 +19,11 @@ int flags2perm(int flags)
     return perm;
 }
 
+// Replace p's user image with the program at path.
+// p is the current process, or one spawn() is building
+// that nothing else can see yet.
 int
-exec(char *path, char **argv)
+execproc(struct proc *p, char *path, char **argv)
 {
   char *s, *last;
   int i, off;
@@ -29,7 +32,10 @@ exec(char *path, char **argv)
   struct inode *ip;
   struct proghdr ph;
   pagetable_t pagetable = 0, oldpagetable;
-  struct proc *p = myproc();
+  struct vma vma[NVMA];
+  int nvma = 0;
+
+  memset(vma, 0, sizeof(vma));
 
   begin_op();
 
@@ -37,7 +43,9 @@ exec(char *path, char **argv)
     end_op();
     return -1;
   }
-  ilock(ip);
+  // the image is only read, so execs of one program
+  // needn't queue on its inode.
+  ilockshared(ip);
 
   // Check ELF header
   if(readi(ip, 0, (uint64)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -61,6 +69,19 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
+    if((ph.flags & ELF_PROG_FLAG_WRITE) == 0 && ph.off % PGSIZE == 0 &&
+       ph.filesz == ph.memsz && ph.vaddr >= PGROUNDUP(sz) && nvma < NVMA){
+      // read-only segments are paged in on demand from the
+      // page cache; see uvmfault().
+      struct vma *v = &vma[nvma++];
+      v->start = ph.vaddr;
+      v->end = PGROUNDUP(ph.vaddr + ph.memsz);
+      v->off = ph.off;
+      v->perm = flags2perm(ph.flags) | PTE_R | PTE_U;
+      v->ip = idup(ip);
+      sz = ph.vaddr + ph.memsz;
+      continue;
+    }
     uint64 sz1;
     if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz, flags2perm(ph.flags))) == 0)
       goto bad;
@@ -68,11 +89,11 @@ exec(char *path, char **argv)
     if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
       goto bad;
   }
-  iunlockput(ip);
+  iunlockshared(ip);
+  iput(ip);
   end_op();
   ip = 0;
 
-  p = myproc();
   uint64 oldsz = p->sz;
 
   // Allocate some pages at the next page boundary.
@@ -121,12 +142,19 @@ exec(char *path, char **argv)
   safestrcpy(p->name, last, sizeof(p->name));
     
   // Commit to the user image.
+  munmapall(p);
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
+  memset(p->tlb, 0, sizeof(p->tlb));
+  p->asid = 0;  // the old page table's TLB entries carry the old one
   p->sz = sz;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
+  begin_op();
+  vmafree(p->vma);
+  end_op();
+  memmove(p->vma, vma, sizeof(vma));
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -134,12 +162,24 @@ exec(char *path, char **argv)
   if(pagetable)
     proc_freepagetable(pagetable, sz);
   if(ip){
-    iunlockput(ip);
+    vmafree(vma);
+    iunlockshared(ip);
+    iput(ip);
+    end_op();
+  } else {
+    begin_op();
+    vmafree(vma);
     end_op();
   }
   return -1;
 }
 
+int
+exec(char *path, char **argv)
+{
+  return execproc(myproc(), path, argv);
+}
+
 // Load a program segment into pagetable at virtual address va.
 // va must be page-aligned
 // and the pages from va to va+sz must already be mapped.
@@ -3,3 +3,5 @@
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+
+#define CHLD_NONBLOCK 0x1  // chldfd(): read returns 0 if no child has exited
@@ -12,17 +12,24 @@
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "slab.h"
+#include "uio.h"
+#include "poll.h"
 
 struct devsw devsw[NDEV];
+
+// Open files come from a slab cache, so there are as many as
+// memory allows; NOFILE per process bounds them in practice.
 struct {
-  struct spinlock lock;
-  struct file file[NFILE];
+  struct spinlock lock;  // protects f->ref
+  struct kmem_cache cache;
 } ftable;
 
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  kmem_cache_init(&ftable.cache, "file", sizeof(struct file));
 }
 
 // Allocate a file structure.
@@ -31,16 +38,11 @@ filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
-  }
-  release(&ftable.lock);
-  return 0;
+  if((f = kmem_cache_alloc(&ftable.cache)) == 0)
+    return 0;
+  memset(f, 0, sizeof(*f));
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -55,6 +57,38 @@ filedup(struct file *f)
   return f;
 }
 
+// f's reference for a fork child, or 0 if f doesn't pass to
+// children: a child-event descriptor reports on its owner's.
+struct file*
+fileinherit(struct file *f)
+{
+  if(f->type == FD_CHILD)
+    return 0;
+  return filedup(f);
+}
+
+// Put e, if not 0, on the poll queue of what f reads or
+// writes, and return the POLL bits that hold for f.
+int
+filepoll(struct file *f, struct pollent *e)
+{
+  int r;
+
+  if(f->type == FD_PIPE)
+    r = pipepoll(f->pipe, f->writable, e);
+  else if(f->type == FD_DEVICE && f->major == CONSOLE)
+    r = consolepoll(e);
+  else if(f->type == FD_CHILD)
+    r = myproc()->pid == f->owner ? chldpoll(e) : POLLNVAL;
+  else
+    r = POLLIN | POLLOUT;  // files and other devices don't block
+  if(!f->readable)
+    r &= ~POLLIN;
+  if(!f->writable)
+    r &= ~POLLOUT;
+  return r;
+}
+
 // Close file f.  (Decrement ref count, close when reaches 0.)
 void
 fileclose(struct file *f)
@@ -72,6 +106,7 @@ fileclose(struct file *f)
   f->ref = 0;
   f->type = FD_NONE;
   release(&ftable.lock);
+  kmem_cache_free(&ftable.cache, f);
 
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
@@ -91,9 +126,9 @@ filestat(struct file *f, uint64 addr)
   struct stat st;
   
   if(f->type == FD_INODE || f->type == FD_DEVICE){
-    ilock(f->ip);
+    ilockshared(f->ip);
     stati(f->ip, &st);
-    iunlock(f->ip);
+    iunlockshared(f->ip);
     if(copyout(p->pagetable, addr, (char *)&st, sizeof(st)) < 0)
       return -1;
     return 0;
@@ -101,27 +136,58 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
-// Read from file f.
-// addr is a user virtual address.
-int
-fileread(struct file *f, uint64 addr, int n)
+// Lock f's inode to read it at f->off. Readers of the inode
+// needn't exclude each other, only writers, unless another
+// process holds f too and could move f->off at the same time.
+// With one reference, only the caller could make another.
+// Returns whether the lock is shared, for iunlockread().
+static int
+ilockread(struct file *f)
 {
-  int r = 0;
+  if(f->ref == 1){
+    ilockshared(f->ip);
+    return 1;
+  }
+  ilock(f->ip);
+  return 0;
+}
+
+static void
+iunlockread(struct file *f, int shared)
+{
+  if(shared)
+    iunlockshared(f->ip);
+  else
+    iunlock(f->ip);
+}
+
+// Read from file f into addr, a user virtual address
+// if user_dst, else a kernel one.
+static int
+fileread1(struct file *f, int user_dst, uint64 addr, int n)
+{
+  int r = 0, shared;
 
   if(f->readable == 0)
     return -1;
 
   if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
+    r = piperead(f->pipe, user_dst, addr, n);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
       return -1;
-    r = devsw[f->major].read(1, addr, n);
+    r = devsw[f->major].read(user_dst, addr, n);
   } else if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
+    shared = ilockread(f);
+    if((r = readi(f->ip, user_dst, addr, f->off, n)) > 0)
       f->off += r;
-    iunlock(f->ip);
+    iunlockread(f, shared);
+  } else if(f->type == FD_CHILD){
+    // (pid, status) pairs of ints, as from wait_batch().
+    if(myproc()->pid != f->owner || !user_dst)
+      return -1;
+    if((r = reapn(addr, n / (2*sizeof(int)), !f->nonblock)) > 0)
+      r *= 2*sizeof(int);
   } else {
     panic("fileread");
   }
@@ -129,10 +195,18 @@ fileread(struct file *f, uint64 addr, int n)
   return r;
 }
 
-// Write to file f.
+// Read from file f.
 // addr is a user virtual address.
 int
-filewrite(struct file *f, uint64 addr, int n)
+fileread(struct file *f, uint64 addr, int n)
+{
+  return fileread1(f, 1, addr, n);
+}
+
+// Write to file f from addr, a user virtual address
+// if user_src, else a kernel one.
+static int
+filewrite1(struct file *f, int user_src, uint64 addr, int n)
 {
   int r, ret = 0;
 
@@ -140,20 +214,28 @@ filewrite(struct file *f, uint64 addr, int n)
     return -1;
 
   if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
+    ret = pipewrite(f->pipe, user_src, addr, n);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
       return -1;
-    ret = devsw[f->major].write(1, addr, n);
+    ret = devsw[f->major].write(user_src, addr, n);
   } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
+    // write MAXOPDATA blocks at a time, less 2 blocks
+    // of slop for non-aligned writes, to avoid exceeding
+    // a transaction's share of data blocks. the data
+    // doesn't go through the log; the i-node, indirect
+    // blocks and the one or two bitmap blocks that
+    // sequential allocation touches do.
     // this really belongs lower down, since writei()
     // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+    int max = (MAXOPDATA-2) * BSIZE;
     int i = 0;
+    // writei() can't read a source page of a file mapping
+    // while holding f->ip's lock: two processes writing each
+    // other's mapped file would take the locks in opposite
+    // orders.
+    if(user_src && n > 0)
+      uvmprefault(myproc(), addr, n, 0);
     while(i < n){
       int n1 = n - i;
       if(n1 > max)
@@ -161,7 +243,7 @@ filewrite(struct file *f, uint64 addr, int n)
 
       begin_op();
       ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
+      if ((r = writei(f->ip, user_src, addr + i, f->off, n1)) > 0)
         f->off += r;
       iunlock(f->ip);
       end_op();
@@ -180,3 +262,135 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+// Write to file f.
+// addr is a user virtual address.
+int
+filewrite(struct file *f, uint64 addr, int n)
+{
+  return filewrite1(f, 1, addr, n);
+}
+
+// Copy up to n bytes from in to out without going through
+// user space, a page at a time through a kernel buffer. An
+// inode is read until n bytes or its end; a pipe or device
+// only as far as one read returns, as read() would.
+// Returns the number of bytes copied, or -1 if an error
+// came before any were.
+int
+filesend(struct file *out, struct file *in, int n)
+{
+  char *buf;
+  int r = 0, tot = 0, m;
+
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  if((buf = kalloc()) == 0)
+    return -1;
+  while(tot < n){
+    m = n - tot < PGSIZE ? n - tot : PGSIZE;
+    if((r = fileread1(in, 0, (uint64)buf, m)) <= 0)
+      break;
+    if(filewrite1(out, 0, (uint64)buf, r) != r){
+      r = -1;
+      break;
+    }
+    tot += r;
+    if(in->type != FD_INODE)
+      break;
+  }
+  kfree(buf);
+  return (tot == 0 && r < 0) ? -1 : tot;
+}
+
+// Read from file f into the n user buffers in iov, filling
+// each before going on to the next. An inode is locked once
+// for all of them. A pipe or device stops after the first
+// buffer that gets any data, as one read() would, rather than
+// block with data in hand. Returns the number of bytes read,
+// or -1 if nothing could be read.
+int
+filereadv(struct file *f, struct iovec *iov, int n)
+{
+  int r = 0, tot = 0, shared;
+
+  if(f->readable == 0)
+    return -1;
+
+  if(f->type == FD_INODE){
+    shared = ilockread(f);
+    for(int i = 0; i < n; i++){
+      if((r = readi(f->ip, 1, (uint64)iov[i].iov_base, f->off, iov[i].iov_len)) > 0){
+        f->off += r;
+        tot += r;
+      }
+      if(r != iov[i].iov_len)
+        break;
+    }
+    iunlockread(f, shared);
+  } else {
+    for(int i = 0; i < n && tot == 0; i++){
+      if((r = fileread(f, (uint64)iov[i].iov_base, iov[i].iov_len)) < 0)
+        break;
+      tot += r;
+    }
+  }
+
+  return (tot == 0 && r < 0) ? -1 : tot;
+}
+
+// Write the n user buffers in iov to file f, in order.
+// For an inode, buffers share log transactions and ilock()s
+// up to the same size limit as filewrite(), so a few small
+// buffers cost one transaction rather than one each.
+// Returns the total length, or -1 on error.
+int
+filewritev(struct file *f, struct iovec *iov, int n)
+{
+  int r, tot = 0;
+
+  if(f->writable == 0)
+    return -1;
+
+  if(f->type == FD_INODE){
+    int max = (MAXOPDATA-2) * BSIZE;  // as in filewrite1()
+    int i = 0;
+    uint64 off = 0;  // into iov[i]
+    for(int j = 0; j < n; j++)  // as in filewrite1()
+      uvmprefault(myproc(), (uint64)iov[j].iov_base, iov[j].iov_len, 0);
+    while(i < n){
+      int room = max;
+      begin_op();
+      ilock(f->ip);
+      while(i < n && room > 0){
+        int n1 = iov[i].iov_len - off;
+        if(n1 > room)
+          n1 = room;
+        if((r = writei(f->ip, 1, (uint64)iov[i].iov_base + off, f->off, n1)) > 0)
+          f->off += r;
+        if(r != n1)
+          break;
+        tot += r;
+        room -= r;
+        off += r;
+        if(off == iov[i].iov_len){
+          i++;
+          off = 0;
+        }
+      }
+      iunlock(f->ip);
+      end_op();
+      if(room > 0 && i < n){
+        // error from writei
+        return -1;
+      }
+    }
+  } else {
+    for(int i = 0; i < n; i++){
+      if(filewrite(f, (uint64)iov[i].iov_base, iov[i].iov_len) < 0)
+        return -1;
+      tot += iov[i].iov_len;
+    }
+  }
+
+  return tot;
+}
@@ -1,5 +1,5 @@
 struct file {
-  enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE } type;
+  enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE, FD_CHILD } type;
   int ref; // reference count
   char readable;
   char writable;
@@ -7,6 +7,22 @@ struct file {
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
   short major;       // FD_DEVICE
+  int owner;         // FD_CHILD: pid whose exited children it reports
+  char nonblock;     // FD_CHILD: read returns 0 rather than wait
+};
+
+// A process in poll(), and its place on the queue of one of
+// the files it waits for; see poll.c.
+struct poller {
+  struct spinlock lock;
+  int fired;          // a file may have become ready
+  int expired;        // the timeout passed
+};
+
+struct pollent {
+  struct poller *pw;
+  struct pollent *next;  // on a file's queue; polllock
+  struct pollent **pprev;
 };
 
 #define major(dev)  ((dev) >> 16 & 0xFFFF)
@@ -18,7 +34,12 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  int ncached;        // pages in the exec page cache; pcache.lock
+  struct inode *hnext; // itable hash chain; itable.lock
+  struct inode *fnext; // itable free list, if ref is 0
+  struct inode *fprev;
   struct sleeplock lock; // protects everything below here
+  struct spinlock maplock; // map, mapbn, ranext, raend, for shared holders
   int valid;          // inode has been read from disk?
 
   short type;         // copy of disk inode
@@ -26,7 +47,11 @@ struct inode {
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint addrs[NDIRECT+2];
+  uint mapbn;         // first block of map[], or 0 if empty
+  uint map[NMAP];     // cached indirect entries; see bmap()
+  uint ranext;        // block after the last readi, for read-ahead
+  uint raend;         // blocks below this have been prefetched
 };
 
 // map major device number to device functions.
@@ -26,6 +26,20 @@
 // only one device
 struct superblock sb; 
 
+#define NBMAP (FSSIZE / BPB + 1)
+
+// In-memory allocation summaries, so that balloc() and
+// ialloc() need not scan from the start of the disk.
+// The on-disk bitmap and inodes remain the truth; these
+// only say where to look.
+static struct {
+  struct spinlock lock;
+  uint nfree[NBMAP];  // free blocks per bitmap block
+  uint bhint;         // block search starts here
+  uint ihint;         // every inode below this is in use
+  uint ifrees;        // inodes freed, to spot races with ialloc
+} fsalloc;
+
 // Read the super block.
 static void
 readsb(int dev, struct superblock *sb)
@@ -37,6 +51,25 @@ readsb(int dev, struct superblock *sb)
   brelse(bp);
 }
 
+// Count the free blocks under each bitmap block.
+static void
+bcount(int dev)
+{
+  struct buf *bp;
+  uint b, bi;
+
+  if(sb.size > NBMAP * BPB)
+    panic("bcount: fs too big");
+  for(b = 0; b < sb.size; b += BPB){
+    bp = bread(dev, BBLOCK(b, sb));
+    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
+      if((bp->data[bi/8] & (1 << (bi % 8))) == 0)
+        fsalloc.nfree[b / BPB]++;
+    }
+    brelse(bp);
+  }
+}
+
 // Init fs
 void
 fsinit(int dev) {
@@ -44,42 +77,68 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  initlock(&fsalloc.lock, "fsalloc");
+  fsalloc.ihint = 1;
+  bcount(dev);
 }
 
-// Zero a block.
+// Zero a block: through the log, or, for a file data
+// block, as data; see log_data().
 static void
-bzero(int dev, int bno)
+bzero(int dev, int bno, int data)
 {
   struct buf *bp;
 
   bp = bread(dev, bno);
   memset(bp->data, 0, BSIZE);
-  log_write(bp);
+  if(data)
+    log_data(bp);
+  else
+    log_write(bp);
   brelse(bp);
 }
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// Allocate a zeroed disk block, to hold file data if data.
 // returns 0 if out of disk space.
+// Starts at the block after the last one allocated, skips
+// bitmap blocks with nothing free, and tests 32 bits at a time.
 static uint
-balloc(uint dev)
+balloc(uint dev, int data)
 {
-  int b, bi, m;
+  uint hint, nbmap, k, w, b;
+  uint *a;
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
-        log_write(bp);
-        brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
-      }
+  acquire(&fsalloc.lock);
+  hint = fsalloc.bhint;
+  release(&fsalloc.lock);
+
+  // visit the hint's bitmap block twice, since the first
+  // visit starts part way through it.
+  nbmap = (sb.size + BPB - 1) / BPB;
+  for(int i = 0; i <= nbmap; i++){
+    k = (hint / BPB + i) % nbmap;
+    if(fsalloc.nfree[k] == 0)
+      continue;
+    bp = bread(dev, BBLOCK(k * BPB, sb));
+    a = (uint*)bp->data;
+    for(w = (i == 0 ? hint % BPB / 32 : 0); w < BPB / 32; w++){
+      if(a[w] == 0xffffffff)
+        continue;
+      b = k * BPB + w * 32 + __builtin_ctz(~a[w]);
+      if(b >= sb.size)
+        break;
+      a[w] |= 1U << (b % 32);  // Mark block in use.
+      log_write(bp);
+      brelse(bp);
+      acquire(&fsalloc.lock);
+      fsalloc.nfree[k]--;
+      fsalloc.bhint = b + 1;
+      release(&fsalloc.lock);
+      bzero(dev, b, data);
+      return b;
     }
     brelse(bp);
   }
@@ -102,6 +161,10 @@ bfree(int dev, uint b)
   bp->data[bi/8] &= ~m;
   log_write(bp);
   brelse(bp);
+  log_freed(b);
+  acquire(&fsalloc.lock);
+  fsalloc.nfree[b / BPB]++;
+  release(&fsalloc.lock);
 }
 
 // Inodes.
@@ -169,6 +232,13 @@ bfree(int dev, uint b)
 // and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold itable.lock while using any of those fields.
 //
+// Entries holding an inode are found through a hash table on
+// (dev, inum). Entries with ip->ref zero also sit on a free
+// list in the order they were released; iget() recycles the
+// least recently used one, so an inode that is opened again
+// soon usually finds its entry (and its cached pages) intact.
+// itable.lock protects the hash chains and the free list.
+//
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
@@ -176,8 +246,45 @@ bfree(int dev, uint b)
 struct {
   struct spinlock lock;
   struct inode inode[NINODE];
+  struct inode *bucket[NIHASH];
+  struct inode *freehead;   // least recently released
+  struct inode *freetail;
 } itable;
 
+static struct inode**
+ihash(uint dev, uint inum)
+{
+  return &itable.bucket[(dev * 31 + inum) % NIHASH];
+}
+
+// append ip to the free list. caller holds itable.lock.
+static void
+ifree_append(struct inode *ip)
+{
+  ip->fnext = 0;
+  ip->fprev = itable.freetail;
+  if(itable.freetail)
+    itable.freetail->fnext = ip;
+  else
+    itable.freehead = ip;
+  itable.freetail = ip;
+}
+
+// remove ip from the free list. caller holds itable.lock.
+static void
+ifree_remove(struct inode *ip)
+{
+  if(ip->fprev)
+    ip->fprev->fnext = ip->fnext;
+  else
+    itable.freehead = ip->fnext;
+  if(ip->fnext)
+    ip->fnext->fprev = ip->fprev;
+  else
+    itable.freetail = ip->fprev;
+  ip->fnext = ip->fprev = 0;
+}
+
 void
 iinit()
 {
@@ -186,6 +293,8 @@ iinit()
   initlock(&itable.lock, "itable");
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&itable.inode[i].lock, "inode");
+    initlock(&itable.inode[i].maplock, "inode map");
+    ifree_append(&itable.inode[i]);
   }
 }
 
@@ -195,14 +304,22 @@ static struct inode* iget(uint dev, uint inum);
 // Mark it as allocated by  giving it type type.
 // Returns an unlocked but allocated and referenced inode,
 // or NULL if there is no free inode.
+// The search starts at fsalloc.ihint, below which all
+// inodes are known to be in use.
 struct inode*
 ialloc(uint dev, short type)
 {
   int inum;
+  uint frees;
   struct buf *bp;
   struct dinode *dip;
 
-  for(inum = 1; inum < sb.ninodes; inum++){
+  acquire(&fsalloc.lock);
+  inum = fsalloc.ihint;
+  frees = fsalloc.ifrees;
+  release(&fsalloc.lock);
+
+  for(; inum < sb.ninodes; inum++){
     bp = bread(dev, IBLOCK(inum, sb));
     dip = (struct dinode*)bp->data + inum%IPB;
     if(dip->type == 0){  // a free inode
@@ -210,6 +327,11 @@ ialloc(uint dev, short type)
       dip->type = type;
       log_write(bp);   // mark it allocated on the disk
       brelse(bp);
+      // an inode freed during the scan may be below inum.
+      acquire(&fsalloc.lock);
+      if(fsalloc.ifrees == frees && fsalloc.ihint < inum + 1)
+        fsalloc.ihint = inum + 1;
+      release(&fsalloc.lock);
       return iget(dev, inum);
     }
     brelse(bp);
@@ -246,31 +368,39 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, **pp;
 
   acquire(&itable.lock);
 
-  // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  // Is the inode already in the table? An unreferenced
+  // entry for it is still up to date, and may still have
+  // pages in the exec page cache, so reuse it.
+  for(ip = *ihash(dev, inum); ip; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref++ == 0)
+        ifree_remove(ip);
       release(&itable.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode entry.
-  if(empty == 0)
+  // Recycle the least recently used free entry.
+  if((ip = itable.freehead) == 0)
     panic("iget: no inodes");
-
-  ip = empty;
+  ifree_remove(ip);
+  if(ip->inum){
+    for(pp = ihash(ip->dev, ip->inum); *pp != ip; pp = &(*pp)->hnext)
+      ;
+    *pp = ip->hnext;
+  }
+  if(ip->ncached)
+    pcache_inval(ip);
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->hnext = *ihash(dev, inum);
+  *ihash(dev, inum) = ip;
   release(&itable.lock);
 
   return ip;
@@ -310,6 +440,8 @@ ilock(struct inode *ip)
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
+    ip->ranext = ip->raend = 0;
+    ip->mapbn = 0;
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -326,6 +458,34 @@ iunlock(struct inode *ip)
   releasesleep(&ip->lock);
 }
 
+// Lock the given inode shared, for callers that only read
+// it: readi(), stati() and exec(). Reads the inode from disk
+// if necessary, under the exclusive lock.
+void
+ilockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+
+  for(;;){
+    acquiresleepshared(&ip->lock);
+    if(ip->valid)
+      return;
+    releasesleepshared(&ip->lock);
+    ilock(ip);
+    iunlock(ip);
+  }
+}
+
+void
+iunlockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("iunlockshared");
+
+  releasesleepshared(&ip->lock);
+}
+
 // Drop a reference to an in-memory inode.
 // If that was the last reference, the inode table entry can
 // be recycled.
@@ -348,16 +508,24 @@ iput(struct inode *ip)
     release(&itable.lock);
 
     itrunc(ip);
+    if(ip->type == T_DIR)
+      dcache_purge(ip);
     ip->type = 0;
     iupdate(ip);
     ip->valid = 0;
+    acquire(&fsalloc.lock);
+    if(ip->inum < fsalloc.ihint)
+      fsalloc.ihint = ip->inum;
+    fsalloc.ifrees++;
+    release(&fsalloc.lock);
 
     releasesleep(&ip->lock);
 
     acquire(&itable.lock);
   }
 
-  ip->ref--;
+  if(--ip->ref == 0)
+    ifree_append(ip);
   release(&itable.lock);
 }
 
@@ -374,7 +542,42 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT]. The next NDINDIRECT
+// are listed in the blocks listed in ip->addrs[NDIRECT+1].
+//
+// To save reading the indirect blocks on every access, the
+// in-memory inode keeps a copy of NMAP neighbouring entries
+// of the last indirect block bmap() used. Readers holding the
+// inode shared may refill it at once, so it and the read-ahead
+// state are under ip->maplock.
+
+// Return entry i of indirect block addr, allocating a block
+// for it if there is none, and refill ip->map with the entries
+// around it. fbn is the file block that entry i maps.
+// returns 0 if out of disk space.
+static uint
+bmapind(struct inode *ip, uint addr, uint i, uint fbn)
+{
+  uint *a, base;
+  struct buf *bp;
+
+  bp = bread(ip->dev, addr);
+  a = (uint*)bp->data;
+  if((addr = a[i]) == 0){
+    addr = balloc(ip->dev, ip->type == T_FILE);
+    if(addr){
+      a[i] = addr;
+      log_write(bp);
+    }
+  }
+  base = i - i % NMAP;
+  acquire(&ip->maplock);
+  ip->mapbn = fbn - (i - base);
+  memmove(ip->map, a + base, sizeof(ip->map));
+  release(&ip->maplock);
+  brelse(bp);
+  return addr;
+}
 
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
@@ -384,37 +587,61 @@ bmap(struct inode *ip, uint bn)
 {
   uint addr, *a;
   struct buf *bp;
+  uint fbn = bn;
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0){
-      addr = balloc(ip->dev);
+      addr = balloc(ip->dev, ip->type == T_FILE);
       if(addr == 0)
         return 0;
       ip->addrs[bn] = addr;
     }
     return addr;
   }
+
+  acquire(&ip->maplock);
+  addr = 0;
+  if(ip->mapbn && bn >= ip->mapbn && bn < ip->mapbn + NMAP)
+    addr = ip->map[bn - ip->mapbn];
+  release(&ip->maplock);
+  if(addr)
+    return addr;
   bn -= NDIRECT;
 
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0){
-      addr = balloc(ip->dev);
+      addr = balloc(ip->dev, 0);
       if(addr == 0)
         return 0;
       ip->addrs[NDIRECT] = addr;
     }
+    return bmapind(ip, addr, bn, fbn);
+  }
+  bn -= NINDIRECT;
+
+  if(bn < NDINDIRECT){
+    // Load the doubly-indirect block, then the indirect
+    // block it lists, allocating either if necessary.
+    if((addr = ip->addrs[NDIRECT+1]) == 0){
+      addr = balloc(ip->dev, 0);
+      if(addr == 0)
+        return 0;
+      ip->addrs[NDIRECT+1] = addr;
+    }
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      addr = balloc(ip->dev);
+    if((addr = a[bn / NINDIRECT]) == 0){
+      addr = balloc(ip->dev, 0);
       if(addr){
-        a[bn] = addr;
+        a[bn / NINDIRECT] = addr;
         log_write(bp);
       }
     }
     brelse(bp);
-    return addr;
+    if(addr == 0)
+      return 0;
+    return bmapind(ip, addr, bn % NINDIRECT, fbn);
   }
 
   panic("bmap: out of range");
@@ -425,9 +652,9 @@ bmap(struct inode *ip, uint bn)
 void
 itrunc(struct inode *ip)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
+  int i, j, k;
+  struct buf *bp, *bp2;
+  uint *a, *a2;
 
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
@@ -448,12 +675,36 @@ itrunc(struct inode *ip)
     ip->addrs[NDIRECT] = 0;
   }
 
+  if(ip->addrs[NDIRECT+1]){
+    bp = bread(ip->dev, ip->addrs[NDIRECT+1]);
+    a = (uint*)bp->data;
+    for(j = 0; j < NINDIRECT; j++){
+      if(a[j] == 0)
+        continue;
+      bp2 = bread(ip->dev, a[j]);
+      a2 = (uint*)bp2->data;
+      for(k = 0; k < NINDIRECT; k++){
+        if(a2[k])
+          bfree(ip->dev, a2[k]);
+      }
+      brelse(bp2);
+      bfree(ip->dev, a[j]);
+    }
+    brelse(bp);
+    bfree(ip->dev, ip->addrs[NDIRECT+1]);
+    ip->addrs[NDIRECT+1] = 0;
+  }
+
   ip->size = 0;
+  ip->raend = 0;
+  ip->mapbn = 0;
   iupdate(ip);
+  if(ip->ncached)
+    pcache_inval(ip);
 }
 
 // Copy stat information from inode.
-// Caller must hold ip->lock.
+// Caller must hold ip->lock, shared or not.
 void
 stati(struct inode *ip, struct stat *st)
 {
@@ -464,14 +715,53 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// Sequential read-ahead. readi() remembers in ip->ranext the
+// block where the last read stopped; a read starting there
+// prefetches blocks [bn, bn+NREADAHEAD) that lie within the
+// file, skipping those already prefetched (below ip->raend).
+// Caller must hold ip->lock, shared or not; two readers may
+// prefetch the same blocks, which is harmless.
+static void
+readahead(struct inode *ip, uint bn)
+{
+  uint blocknos[NREADAHEAD];
+  uint nblocks, end, addr;
+  int n;
+
+  nblocks = (ip->size + BSIZE - 1) / BSIZE;
+  end = bn + NREADAHEAD;
+  if(end > nblocks)
+    end = nblocks;
+  acquire(&ip->maplock);
+  if(bn < ip->raend)
+    bn = ip->raend;
+  release(&ip->maplock);
+  // wait until half the window is used before topping it up,
+  // so reads go to the disk in batches.
+  if(bn >= end || (end - bn < NREADAHEAD/2 && end < nblocks))
+    return;
+
+  n = 0;
+  for(; bn < end; bn++){
+    if((addr = bmap(ip, bn)) == 0)
+      break;
+    blocknos[n++] = addr;
+  }
+  acquire(&ip->maplock);
+  if(bn > ip->raend)
+    ip->raend = bn;
+  release(&ip->maplock);
+  bprefetch(ip->dev, blocknos, n);
+}
+
 // Read data from inode.
-// Caller must hold ip->lock.
+// Caller must hold ip->lock, shared or not.
 // If user_dst==1, then dst is a user virtual address;
 // otherwise, dst is a kernel address.
 int
 readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 {
-  uint tot, m;
+  uint tot, m, ranext;
   struct buf *bp;
 
   if(off > ip->size || off + n < off)
@@ -479,6 +769,12 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   if(off + n > ip->size)
     n = ip->size - off;
 
+  acquire(&ip->maplock);
+  ranext = ip->ranext;
+  release(&ip->maplock);
+  if(n > 0 && off/BSIZE == ranext)
+    readahead(ip, off/BSIZE);
+
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
     uint addr = bmap(ip, off/BSIZE);
     if(addr == 0)
@@ -492,6 +788,11 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
     }
     brelse(bp);
   }
+  if(tot != -1){
+    acquire(&ip->maplock);
+    ip->ranext = off/BSIZE;
+    release(&ip->maplock);
+  }
   return tot;
 }
 
@@ -523,7 +824,16 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
       brelse(bp);
       break;
     }
-    log_write(bp);
+    // only metadata goes through the log; file data is
+    // written in place before the commit.
+    if(ip->type == T_FILE)
+      log_data(bp);
+    else
+      log_write(bp);
+    // processes that map this page of the file see
+    // the new bytes too.
+    if(ip->ncached)
+      pcache_write(ip, off, (char*)bp->data + (off % BSIZE), m);
     brelse(bp);
   }
 
@@ -548,6 +858,7 @@ namecmp(const char *s, const char *t)
 
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
+// Answers from the name cache when it can.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
@@ -557,6 +868,14 @@ dirlookup(struct inode *dp, char *name, uint *poff)
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
+  if(dcache_lookup(dp, name, &inum, &off) == 0){
+    if(inum == 0)
+      return 0;
+    if(poff)
+      *poff = off;
+    return iget(dp->dev, inum);
+  }
+
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlookup read");
@@ -567,10 +886,12 @@ dirlookup(struct inode *dp, char *name, uint *poff)
       if(poff)
         *poff = off;
       inum = de.inum;
+      dcache_enter(dp, name, inum, off);
       return iget(dp->dev, inum);
     }
   }
 
+  dcache_enter(dp, name, 0, 0);
   return 0;
 }
 
@@ -601,6 +922,7 @@ dirlink(struct inode *dp, char *name, uint inum)
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     return -1;
+  dcache_enter(dp, name, inum, off);
 
   return 0;
 }
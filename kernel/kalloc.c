@@ -1,42 +1,344 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. Allocates whole 4096-byte pages,
+// or power-of-two runs of them with kalloc_order().
+//
+// Free memory lives in a buddy allocator, in blocks of
+// 2^0 to 2^MAXORDER pages. On top of it each CPU caches
+// single pages, so kalloc() and kfree() normally touch only
+// the local CPU's lock: an empty cache refills a batch from
+// the buddy lists, an overfull one gives a batch back. A CPU
+// that finds both empty steals from another CPU's cache.
+//
+// Unless the kernel is built with KDEBUG=0, freed and newly
+// allocated pages are filled with junk to catch dangling
+// references. Callers that need zeroed memory use kzalloc().
+//
+// Every page carries a reference count so that copy-on-write
+// fork can share it; kfree() only frees on the last reference.
+//
+// kzalloc() takes pages from a pool that the kzerod kernel
+// thread keeps topped up with zeroed pages while memory is
+// plentiful, so page faults and page-table growth don't wait
+// for a page to be cleared.
 
 #include "types.h"
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
 #include "riscv.h"
+#include "memstat.h"
+#include "proc.h"
 #include "defs.h"
 
 void freerange(void *pa_start, void *pa_end);
+static int zpool_reclaim(void);
 
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
 
+// memory kinit() frees on its own, enough to boot with; the
+// rest is freed a megapage at a time by kinitchunk() on every
+// hart, in parallel with the rest of boot.
+#define BOOTMEM (4*MEGAPGSIZE)
+
+// max number of pages moved by one steal.
+#define STEALBATCH 64
+
+// pages moved between a CPU's cache and the buddy lists at
+// a time, and the most a cache holds before giving some back.
+#define KBATCH 32
+#define KCACHEMAX (4*KBATCH)
+
+// largest buddy block: a megapage.
+#define MAXORDER MEGAORDER
+#if MAXORDER + 1 != NORDER
+#error NORDER in memstat.h must match MEGAORDER
+#endif
+
+#define NPAGE ((PHYSTOP - KERNBASE) / PGSIZE)
+#define PAGENO(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+#define PAGEADDR(n) ((void*)(KERNBASE + (uint64)(n) * PGSIZE))
+
 struct run {
   struct run *next;
 };
 
+// a free buddy block, on a circular list per order.
+struct block {
+  struct block *next;
+  struct block *prev;
+};
+
 struct {
+  struct spinlock lock;
+  struct block free[MAXORDER+1];  // list heads
+  uint64 nfree[MAXORDER+1];       // blocks on each list
+  uint64 nalloc[MAXORDER+1];      // see struct memstat
+  uint64 nfail[MAXORDER+1];
+  uint64 nsplit;
+  uint64 nmerge;
+  uchar order[NPAGE];             // 1+order of the free block
+                                  // starting at a page, else 0
+} buddy;
+
+struct kmem {
   struct spinlock lock;
   struct run *freelist;
-} kmem;
+  uint64 nfree;       // pages on freelist
+  uint64 nsteal;      // pages stolen from other CPUs
+  uint64 ncontended;  // acquires that found the lock already held
+};
+
+struct kmem kmem[NCPU];
+
+// pre-zeroed pages for kzalloc().
+#define NZPOOL   64       // pages kzerod keeps ready
+#define ZPOOLLOW 32       // wake kzerod below this many
+#define ZPOOLMIN 1024     // free pages kzerod leaves alone
+
+struct {
+  struct spinlock lock;
+  struct run *list;
+  int n;              // pages on list
+  int idle;           // is kzerod asleep?
+  uint64 nhit;        // kzalloc()s served from the pool
+  uint64 nmiss;       // ones that had to clear a page
+} zpool;
+
+static char *bootend;   // first chunk kinitchunk() frees
+static int nextchunk;   // next chunk it will free
+
+// reference counts, one per physical page, updated atomically.
+static int pageref[(PHYSTOP - KERNBASE) / PGSIZE];
+#define REF(pa) pageref[((uint64)(pa) - KERNBASE) / PGSIZE]
+
+// acquire km->lock, counting acquires that had to wait.
+static void
+kmem_lock(struct kmem *km)
+{
+  if(km->lock.locked)
+    __sync_fetch_and_add(&km->ncontended, 1);
+  acquire(&km->lock);
+}
 
 void
 kinit()
 {
-  initlock(&kmem.lock, "kmem");
-  freerange(end, (void*)PHYSTOP);
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kmem[i].lock, "kmem");
+  initlock(&buddy.lock, "buddy");
+  initlock(&zpool.lock, "zpool");
+  for(int i = 0; i <= MAXORDER; i++)
+    buddy.free[i].next = buddy.free[i].prev = &buddy.free[i];
+  bootend = (char*)((((uint64)end + MEGAPGSIZE - 1) & ~(MEGAPGSIZE - 1)) + BOOTMEM);
+  if(bootend > (char*)PHYSTOP)
+    bootend = (char*)PHYSTOP;
+  freerange(end, bootend);
+}
+
+static void
+blockpush(uint64 n, int order)
+{
+  struct block *b = PAGEADDR(n), *h = &buddy.free[order];
+
+  b->next = h->next;
+  b->prev = h;
+  h->next->prev = b;
+  h->next = b;
+  buddy.order[n] = order + 1;
+  buddy.nfree[order]++;
+}
+
+static void
+blockremove(uint64 n, int order)
+{
+  struct block *b = PAGEADDR(n);
+
+  b->prev->next = b->next;
+  b->next->prev = b->prev;
+  buddy.order[n] = 0;
+  buddy.nfree[order]--;
+}
+
+// Free the block of 2^order pages at page number n,
+// merging it with its buddy for as long as that is free.
+// Caller must hold buddy.lock.
+static void
+buddy_put(uint64 n, int order)
+{
+  uint64 b;
+
+  for(; order < MAXORDER; order++){
+    b = n ^ (1L << order);
+    if(b >= NPAGE || buddy.order[b] != order + 1)
+      break;
+    blockremove(b, order);
+    buddy.nmerge++;
+    if(b < n)
+      n = b;
+  }
+  blockpush(n, order);
+}
+
+// Take a block of 2^order pages, splitting a larger one if
+// need be. Returns its page number, or -1 if there is none.
+// Caller must hold buddy.lock.
+static long
+buddy_get(int order)
+{
+  uint64 n;
+  int o;
+
+  for(o = order; o <= MAXORDER; o++)
+    if(buddy.nfree[o] > 0)
+      break;
+  if(o > MAXORDER){
+    buddy.nfail[order]++;
+    return -1;
+  }
+  n = PAGENO(buddy.free[o].next);
+  blockremove(n, o);
+  // give back the upper halves.
+  while(o > order){
+    o--;
+    blockpush(n + (1L << o), o);
+    buddy.nsplit++;
+  }
+  buddy.nalloc[order]++;
+  return n;
 }
 
+// Free the page pa onto km's list, giving a batch back to
+// the buddy lists if the list is getting long.
+static void
+kfree_cpu(struct kmem *km, void *pa)
+{
+  struct run *r, *batch;
+
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("kfree");
+
+#if KDEBUG
+  // Fill with junk to catch dangling refs.
+  memset(pa, 1, PGSIZE);
+#endif
+
+  r = (struct run*)pa;
+
+  batch = 0;
+  kmem_lock(km);
+  r->next = km->freelist;
+  km->freelist = r;
+  km->nfree++;
+  if(km->nfree > KCACHEMAX){
+    batch = km->freelist;
+    for(int i = 0; i < KBATCH; i++){
+      r = km->freelist;
+      km->freelist = r->next;
+    }
+    r->next = 0;
+    km->nfree -= KBATCH;
+  }
+  release(&km->lock);
+
+  if(batch){
+    acquire(&buddy.lock);
+    for(r = batch; r; r = batch){
+      batch = r->next;
+      buddy_put(PAGENO(r), 0);
+    }
+    release(&buddy.lock);
+  }
+}
+
+// Give the pages in [pa_start, pa_end) to the buddy lists.
 void
 freerange(void *pa_start, void *pa_end)
 {
   char *p;
-  p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
-    kfree(p);
+
+  acquire(&buddy.lock);
+  for(p = (char*)PGROUNDUP((uint64)pa_start); p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+#if KDEBUG
+    memset(p, 1, PGSIZE);
+#endif
+    buddy_put(PAGENO(p), 0);
+  }
+  release(&buddy.lock);
+}
+
+// Free the next megapage of memory that kinit() left for
+// later, if any. Each hart calls it until it returns 0, so
+// that filling freed pages with junk is split across them,
+// and each chunk takes the buddy lock once, as one block.
+int
+kinitchunk(void)
+{
+  char *p = bootend + (uint64)__sync_fetch_and_add(&nextchunk, 1) * MEGAPGSIZE;
+
+  if(p + MEGAPGSIZE > (char*)PHYSTOP)
+    return 0;
+#if KDEBUG
+  memset(p, 1, MEGAPGSIZE);
+#endif
+  acquire(&buddy.lock);
+  buddy_put(PAGENO(p), MAXORDER);
+  release(&buddy.lock);
+  return 1;
+}
+
+// Move a batch of pages from the buddy lists onto km's list.
+// Returns the number moved.
+static int
+refill(struct kmem *km)
+{
+  struct run *head = 0, *r;
+  long pn;
+  int n;
+
+  acquire(&buddy.lock);
+  for(n = 0; n < KBATCH && (pn = buddy_get(0)) >= 0; n++){
+    r = PAGEADDR(pn);
+    r->next = head;
+    head = r;
+  }
+  release(&buddy.lock);
+  if(n == 0)
+    return 0;
+
+  kmem_lock(km);
+  for(r = head; r->next; r = r->next)
+    ;
+  r->next = km->freelist;
+  km->freelist = head;
+  km->nfree += n;
+  release(&km->lock);
+  return n;
+}
+
+// Return every CPU's cached pages to the buddy lists,
+// so they can merge into larger blocks.
+static void
+kdrain(void)
+{
+  struct run *r, *next;
+
+  for(int i = 0; i < NCPU; i++){
+    struct kmem *km = &kmem[i];
+    kmem_lock(km);
+    r = km->freelist;
+    km->freelist = 0;
+    km->nfree = 0;
+    release(&km->lock);
+
+    acquire(&buddy.lock);
+    for(; r; r = next){
+      next = r->next;
+      buddy_put(PAGENO(r), 0);
+    }
+    release(&buddy.lock);
+  }
 }
 
 // Free the page of physical memory pointed at by pa,
@@ -46,20 +348,95 @@ freerange(void *pa_start, void *pa_end)
 void
 kfree(void *pa)
 {
-  struct run *r;
+  int n;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
+  if((n = __sync_sub_and_fetch(&REF(pa), 1)) > 0)
+    return;
+  if(n < 0)
+    panic("kfree: ref");
 
-  // Fill with junk to catch dangling refs.
-  memset(pa, 1, PGSIZE);
+  push_off();
+  kfree_cpu(&kmem[cpuid()], pa);
+  pop_off();
+}
 
-  r = (struct run*)pa;
+// Move up to half of some other CPU's free pages, at most
+// STEALBATCH, onto this CPU's list. Returns the number moved.
+// Called with interrupts off and without any kmem lock held.
+static int
+steal(int id)
+{
+  struct run *head, *tail;
+  int n;
+
+  for(int i = 1; i < NCPU; i++){
+    struct kmem *v = &kmem[(id + i) % NCPU];
+    if(v->freelist == 0)
+      continue;
+    kmem_lock(v);
+    head = tail = v->freelist;
+    n = 0;
+    if(head){
+      int want = (v->nfree + 1) / 2;
+      if(want > STEALBATCH)
+        want = STEALBATCH;
+      for(n = 1; n < want && tail->next; n++)
+        tail = tail->next;
+      v->freelist = tail->next;
+      v->nfree -= n;
+    }
+    release(&v->lock);
+    if(n == 0)
+      continue;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+    struct kmem *km = &kmem[id];
+    kmem_lock(km);
+    tail->next = km->freelist;
+    km->freelist = head;
+    km->nfree += n;
+    km->nsteal += n;
+    release(&km->lock);
+    return n;
+  }
+  return 0;
+}
+
+// Take a page off this CPU's free list, refilling it from
+// the buddy lists or, failing that, stealing from other
+// CPUs if it is empty. Returns 0 if all are empty.
+static struct run*
+kpop(void)
+{
+  struct run *r;
+  struct kmem *km;
+  int id;
+
+  push_off();
+  id = cpuid();
+  km = &kmem[id];
+  for(;;){
+    kmem_lock(km);
+    r = km->freelist;
+    if(r){
+      km->freelist = r->next;
+      km->nfree--;
+    }
+    release(&km->lock);
+    if(r || (refill(km) == 0 && steal(id) == 0))
+      break;
+  }
+  pop_off();
+  return r;
+}
+
+// Ask caches of pages to give back what they can.
+// Returns the number of pages freed.
+static int
+kreclaim(void)
+{
+  return pcache_reclaim() + proc_reclaim() + slab_reclaim() + zpool_reclaim();
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -70,13 +447,239 @@ kalloc(void)
 {
   struct run *r;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  if((r = kpop()) == 0 && kreclaim() > 0)
+    r = kpop();
 
-  if(r)
+  if(r){
+#if KDEBUG
     memset((char*)r, 5, PGSIZE); // fill with junk
+#endif
+    REF(r) = 1;
+  }
   return (void*)r;
 }
+
+// Allocate 2^order physically contiguous pages, aligned to
+// their size. Returns 0 if the memory cannot be allocated.
+// Only the first page carries the reference count, until
+// ksplit() makes the pages separate.
+void *
+kalloc_order(int order)
+{
+  long n;
+  char *pa;
+
+  if(order == 0)
+    return kalloc();
+  if(order < 0 || order > MAXORDER)
+    return 0;
+  for(int try = 0; ; try++){
+    acquire(&buddy.lock);
+    n = buddy_get(order);
+    release(&buddy.lock);
+    if(n >= 0 || try == 1)
+      break;
+    // the pieces may be sitting in CPU caches. other caches
+    // aren't squeezed, as callers can fall back to pages.
+    kdrain();
+  }
+  if(n < 0)
+    return 0;
+  pa = PAGEADDR(n);
+#if KDEBUG
+  memset(pa, 5, PGSIZE << order);
+#endif
+  REF(pa) = 1;
+  return pa;
+}
+
+// Drop a reference to the block of 2^order pages at pa from
+// kalloc_order(), freeing it on the last one.
+void
+kfree_order(void *pa, int order)
+{
+  int n;
+
+  if(order == 0){
+    kfree(pa);
+    return;
+  }
+  if(((uint64)pa % (PGSIZE << order)) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("kfree_order");
+  if((n = __sync_sub_and_fetch(&REF(pa), 1)) > 0)
+    return;
+  if(n < 0)
+    panic("kfree_order: ref");
+#if KDEBUG
+  memset(pa, 1, PGSIZE << order);
+#endif
+  acquire(&buddy.lock);
+  buddy_put(PAGENO(pa), order);
+  release(&buddy.lock);
+}
+
+// Turn an unshared block from kalloc_order() into 2^order
+// pages with a reference each, to be kfree()d one by one.
+void
+ksplit(void *pa, int order)
+{
+  if(REF(pa) != 1)
+    panic("ksplit");
+  for(int i = 1; i < (1 << order); i++)
+    REF((char*)pa + i*PGSIZE) = 1;
+}
+
+// Allocate one zeroed page, or return 0.
+void *
+kzalloc(void)
+{
+  struct run *r;
+  void *pa;
+
+  acquire(&zpool.lock);
+  if((r = zpool.list) != 0){
+    zpool.list = r->next;
+    zpool.n--;
+    zpool.nhit++;
+  } else {
+    zpool.nmiss++;
+  }
+  if(zpool.n < ZPOOLLOW && zpool.idle){
+    zpool.idle = 0;
+    wakeup(&zpool);
+  }
+  release(&zpool.lock);
+  if(r){
+    r->next = 0;  // the last word the pool used
+    return (void*)r;
+  }
+
+  if((pa = kalloc()) != 0)
+    pagezero(pa);
+  return pa;
+}
+
+// is there enough free memory to spend some on the pool?
+static int
+kplenty(void)
+{
+  uint64 n = 0;
+
+  for(int i = 0; i < NCPU; i++)
+    n += kmem[i].nfree;
+  for(int i = 0; i <= MAXORDER; i++)
+    n += buddy.nfree[i] << i;
+  return n > ZPOOLMIN;
+}
+
+// Kernel thread that refills the zeroed-page pool, then
+// sleeps until kzalloc() has used half of it.
+static void
+kzerod(void *arg)
+{
+  struct run *r;
+
+  for(;;){
+    acquire(&zpool.lock);
+    while(zpool.n >= NZPOOL || !kplenty()){
+      zpool.idle = 1;
+      sleep(&zpool, &zpool.lock);
+    }
+    release(&zpool.lock);
+
+    if((r = kpop()) == 0)
+      continue;
+    REF(r) = 1;
+    pagezero(r);
+
+    acquire(&zpool.lock);
+    r->next = zpool.list;
+    zpool.list = r;
+    zpool.n++;
+    release(&zpool.lock);
+  }
+}
+
+void
+kzeroinit(void)
+{
+  if(kthread_create(kzerod, 0, "kzerod") < 0)
+    panic("kzeroinit");
+}
+
+// Give the pool's pages back. Returns the number freed.
+static int
+zpool_reclaim(void)
+{
+  struct run *r;
+  int n = 0;
+
+  acquire(&zpool.lock);
+  while((r = zpool.list) != 0){
+    zpool.list = r->next;
+    zpool.n--;
+    release(&zpool.lock);
+    kfree(r);
+    n++;
+    acquire(&zpool.lock);
+  }
+  release(&zpool.lock);
+  return n;
+}
+
+// Add a reference to the allocated page pa.
+void
+kref(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("kref");
+  if(__sync_fetch_and_add(&REF(pa), 1) < 1)
+    panic("kref: free page");
+}
+
+// Return the number of references to page pa.
+int
+krefcount(void *pa)
+{
+  return __atomic_load_n(&REF(pa), __ATOMIC_SEQ_CST);
+}
+
+// Print per-CPU allocator statistics. For debugging.
+void
+kmemdump(void)
+{
+  for(int i = 0; i < NCPU; i++){
+    struct kmem *km = &kmem[i];
+    if(km->nfree == 0 && km->nsteal == 0 && km->ncontended == 0)
+      continue;
+    printf("kmem cpu%d: free %ld stolen %ld contended %ld\n",
+           i, km->nfree, km->nsteal, km->ncontended);
+  }
+  printf("buddy free blocks:");
+  for(int i = 0; i <= MAXORDER; i++)
+    printf(" %ld", buddy.nfree[i]);
+  printf(" split %ld merged %ld\n", buddy.nsplit, buddy.nmerge);
+  printf("zpool: ready %d hit %ld miss %ld\n", zpool.n, zpool.nhit, zpool.nmiss);
+}
+
+// Copy the allocator's statistics to user address addr.
+// Returns 0, or -1 on a bad address.
+int
+memstat(uint64 addr)
+{
+  struct memstat st;
+
+  acquire(&buddy.lock);
+  for(int i = 0; i <= MAXORDER; i++){
+    st.nfree[i] = buddy.nfree[i];
+    st.nalloc[i] = buddy.nalloc[i];
+    st.nfail[i] = buddy.nfail[i];
+  }
+  st.nsplit = buddy.nsplit;
+  st.nmerge = buddy.nmerge;
+  release(&buddy.lock);
+  st.ncached = 0;
+  for(int i = 0; i < NCPU; i++)
+    st.ncached += kmem[i].nfree;
+  return copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st));
+}
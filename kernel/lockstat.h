@@ -0,0 +1,14 @@
+// Per-lock-name statistics, returned by lockstat() when the
+// kernel is built with LOCKSTAT=1. Locks initialized with the
+// same name, such as every "proc" lock, share one record.
+#define NLOCKHIST 16      // hold-time buckets
+
+struct lockstat {
+  char name[16];
+  uint64 nacquire;        // acquires
+  uint64 ncontended;      // of those, how many had to spin
+  uint64 nspin;           // failed attempts while spinning
+  uint64 holdtotal;       // r_time() ticks held, in all
+  uint64 holdmax;         // longest hold
+  uint64 hold[NLOCKHIST]; // holds of [2^(i-1), 2^i) ticks; 0 in hold[0]
+};
@@ -6,6 +6,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "trace.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -21,6 +22,15 @@
 // But if it thinks the log is close to running out, it
 // sleeps until the last outstanding end_op() commits.
 //
+// Group commit: unless the log is filling up, end_op() does
+// not commit. The committer kernel thread commits once the
+// transaction has been open for LOGWINDOW ticks and no FS
+// system calls are active, so a burst of small operations
+// shares one commit. A system call's changes are thus atomic
+// and ordered, but may reach the disk up to LOGWINDOW ticks
+// after it returns. With LOGWINDOW 0 every end_op() that
+// finds no other active operation commits, as classic xv6 does.
+//
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
 //   header block, containing block #s for block A, B, C, ...
@@ -29,6 +39,22 @@
 //   block C
 //   ...
 // Log appends are synchronous.
+//
+// write_log() and install_trans() hand the disk up to LOGBATCH
+// blocks at a time as one batch, so a commit costs a few
+// doorbells rather than one disk round trip per block.
+//
+// Ordered data: only metadata goes through the log. A file's
+// data blocks are handed to log_data() instead, which pins them
+// like log_write() does; commit() writes them straight to their
+// home locations before it writes the log, so a committed inode
+// never points at a block that doesn't yet hold its data, and
+// file data is written once instead of twice. The exception is
+// a block freed earlier in the same transaction: until the
+// commit, the old file that owned it still does, so its new
+// contents must wait until after the commit.
+
+#define LOGBATCH 16
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
@@ -37,19 +63,33 @@ struct logheader {
   int block[LOGSIZE];
 };
 
+// File data blocks waiting for the next commit.
+struct logdata {
+  int n;
+  int block[NLOGDATA];
+  char late[NLOGDATA];    // write after the commit, not before.
+  int nfreed;             // blocks freed by this transaction,
+  int freed[NLOGFREED];
+  int freedall;           // or all of them, if too many to list.
+};
+
 struct log {
   struct spinlock lock;
   int start;
   int size;
   int outstanding; // how many FS sys calls are executing.
   int committing;  // in commit(), please wait.
+  int full;        // a begin_op() is waiting for log space.
+  uint since;      // ticks when the open transaction began logging.
   int dev;
   struct logheader lh;
+  struct logdata ld;
 };
 struct log log;
 
 static void recover_from_log(void);
 static void commit();
+static void committer(void*);
 
 void
 initlog(int dev, struct superblock *sb)
@@ -62,23 +102,33 @@ initlog(int dev, struct superblock *sb)
   log.size = sb->nlog;
   log.dev = dev;
   recover_from_log();
+  if(LOGWINDOW > 0 && kthread_create(committer, 0, "logcommit") < 0)
+    panic("initlog: committer");
 }
 
 // Copy committed blocks from log to their home location
 static void
 install_trans(int recovering)
 {
-  int tail;
-
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
-    brelse(lbuf);
-    brelse(dbuf);
+  struct buf *dbuf[LOGBATCH];
+  int tail, i, n;
+
+  for (tail = 0; tail < log.lh.n; tail += n) {
+    n = log.lh.n - tail;
+    if(n > LOGBATCH)
+      n = LOGBATCH;
+    for (i = 0; i < n; i++) {
+      struct buf *lbuf = bread(log.dev, log.start+tail+i+1); // read log block
+      dbuf[i] = bread(log.dev, log.lh.block[tail+i]); // read dst
+      memmove(dbuf[i]->data, lbuf->data, BSIZE);  // copy block to dst
+      brelse(lbuf);
+    }
+    bwritev(dbuf, n);  // write dsts to disk
+    for (i = 0; i < n; i++) {
+      if(recovering == 0)
+        bunpin(dbuf[i]);
+      brelse(dbuf[i]);
+    }
   }
 }
 
@@ -122,6 +172,22 @@ recover_from_log(void)
   write_head(); // clear the log
 }
 
+// Commit the open transaction. Called with log.lock held
+// and no FS system calls active; returns with it held.
+static void
+docommit(void)
+{
+  log.committing = 1;
+  // call commit w/o holding locks, since not allowed
+  // to sleep with locks.
+  release(&log.lock);
+  commit();
+  acquire(&log.lock);
+  log.committing = 0;
+  log.full = 0;
+  wakeup(&log);
+}
+
 // called at the start of each FS system call.
 void
 begin_op(void)
@@ -130,9 +196,16 @@ begin_op(void)
   while(1){
     if(log.committing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
-      // this op might exhaust log space; wait for commit.
-      sleep(&log, &log.lock);
+    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE ||
+              log.ld.n + (log.outstanding+1)*MAXOPDATA > NLOGDATA){
+      // this op might exhaust log space; wait for commit,
+      // or commit now if no other op is active.
+      if(log.outstanding == 0){
+        docommit();
+      } else {
+        log.full = 1;
+        sleep(&log, &log.lock);
+      }
     } else {
       log.outstanding += 1;
       release(&log.lock);
@@ -142,19 +215,17 @@ begin_op(void)
 }
 
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// commits if this was the last outstanding operation
+// and the log is filling up (or group commit is off).
 void
 end_op(void)
 {
-  int do_commit = 0;
-
   acquire(&log.lock);
   log.outstanding -= 1;
   if(log.committing)
     panic("log.committing");
-  if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
+  if(log.outstanding == 0 && (LOGWINDOW == 0 || log.full)){
+    docommit();
   } else {
     // begin_op() may be waiting for log space,
     // and decrementing log.outstanding has decreased
@@ -162,15 +233,29 @@ end_op(void)
     wakeup(&log);
   }
   release(&log.lock);
+}
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
+// Kernel thread that commits the open transaction once it
+// has gathered operations for LOGWINDOW ticks.
+static void
+committer(void *arg)
+{
+  acquire(&log.lock);
+  for(;;){
+    if(log.lh.n == 0 && log.ld.n == 0){
+      // nothing logged; log_write() or log_data() will wake us.
+      sleep(&log.lh, &log.lock);
+    } else if(log.outstanding > 0 || log.committing ||
+              ticks - log.since < LOGWINDOW){
+      // check again when the window closes, or on the
+      // next tick if it already has.
+      int wait = LOGWINDOW - (int)(ticks - log.since);
+      release(&log.lock);
+      tsleep(wait > 0 ? wait : 1);
+      acquire(&log.lock);
+    } else {
+      docommit();
+    }
   }
 }
 
@@ -178,28 +263,75 @@ end_op(void)
 static void
 write_log(void)
 {
-  int tail;
+  struct buf *to[LOGBATCH];
+  int tail, i, n;
+
+  for (tail = 0; tail < log.lh.n; tail += n) {
+    n = log.lh.n - tail;
+    if(n > LOGBATCH)
+      n = LOGBATCH;
+    for (i = 0; i < n; i++) {
+      to[i] = bread(log.dev, log.start+tail+i+1); // log block
+      struct buf *from = bread(log.dev, log.lh.block[tail+i]); // cache block
+      memmove(to[i]->data, from->data, BSIZE);
+      brelse(from);
+    }
+    bwritev(to, n);  // write the log
+    for (i = 0; i < n; i++)
+      brelse(to[i]);
+  }
+}
+
+// Write the pinned data blocks home, the early ones if
+// late is 0, else the late ones.
+static void
+write_data(int late)
+{
+  struct buf *b[LOGBATCH];
+  int i, n = 0;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+  for (i = 0; i <= log.ld.n; i++) {
+    if (n == LOGBATCH || (i == log.ld.n && n > 0)) {
+      bwritev(b, n);
+      while (n > 0) {
+        n--;
+        bunpin(b[n]);
+        brelse(b[n]);
+      }
+    }
+    if (i < log.ld.n && log.ld.late[i] == late)
+      b[n++] = bread(log.dev, log.ld.block[i]);
   }
 }
 
 static void
 commit()
 {
+  uint64 t0 = r_time();
+  int n = log.lh.n;
+
+  write_data(0);     // Write file data home first
   if (log.lh.n > 0) {
     write_log();     // Write modified blocks from cache to log
     write_head();    // Write header to disk -- the real commit
     install_trans(0); // Now install writes to home locations
     log.lh.n = 0;
     write_head();    // Erase the transaction from the log
+    TRACE(TR_COMMIT, n, r_time() - t0);
   }
+  write_data(1);     // and data that had to wait for the commit
+  log.ld.n = 0;
+  log.ld.nfreed = 0;
+  log.ld.freedall = 0;
+}
+
+// Drop data entry i, returning its pin to the caller.
+static void
+dropdata(int i)
+{
+  log.ld.n--;
+  log.ld.block[i] = log.ld.block[log.ld.n];
+  log.ld.late[i] = log.ld.late[log.ld.n];
 }
 
 // Caller has modified b->data and is done with the buffer.
@@ -228,9 +360,77 @@ log_write(struct buf *b)
   }
   log.lh.block[i] = b->blockno;
   if (i == log.lh.n) {  // Add new block to log?
-    bpin(b);
-    log.lh.n++;
+    int j;
+    for (j = 0; j < log.ld.n; j++)
+      if (log.ld.block[j] == b->blockno)
+        break;
+    if (j < log.ld.n)
+      dropdata(j);  // was file data; now metadata, keep the pin
+    else
+      bpin(b);
+    if(log.lh.n++ == 0 && log.ld.n == 0){
+      // a new transaction; start the commit window.
+      log.since = ticks;
+      wakeup(&log.lh);
+    }
+  }
+  release(&log.lock);
+}
+
+// Like log_write(), but for a block of file data: commit()
+// writes it in place rather than through the log.
+void
+log_data(struct buf *b)
+{
+  int i;
+
+  acquire(&log.lock);
+  if (log.outstanding < 1)
+    panic("log_data outside of trans");
+
+  for (i = 0; i < log.lh.n; i++) {
+    if (log.lh.block[i] == b->blockno) {
+      // already logged, e.g. an indirect block freed and
+      // reallocated as data; the logged copy wins.
+      release(&log.lock);
+      log_write(b);
+      return;
+    }
+  }
+  for (i = 0; i < log.ld.n; i++) {
+    if (log.ld.block[i] == b->blockno) {  // absorption
+      release(&log.lock);
+      return;
+    }
+  }
+  if (log.ld.n >= NLOGDATA)
+    panic("too much data in a transaction");
+  log.ld.block[i] = b->blockno;
+  log.ld.late[i] = log.ld.freedall;
+  for (int j = 0; j < log.ld.nfreed; j++)
+    if (log.ld.freed[j] == b->blockno)
+      log.ld.late[i] = 1;
+  bpin(b);
+  if(log.ld.n++ == 0 && log.lh.n == 0){
+    log.since = ticks;
+    wakeup(&log.lh);
   }
   release(&log.lock);
 }
 
+// Block blockno has been freed by the open transaction.
+void
+log_freed(uint blockno)
+{
+  acquire(&log.lock);
+  // data written to it from here on belongs to its next owner.
+  for (int i = 0; i < log.ld.n; i++)
+    if (log.ld.block[i] == blockno)
+      log.ld.late[i] = 1;
+  if (log.ld.nfreed < NLOGFREED)
+    log.ld.freed[log.ld.nfreed++] = blockno;
+  else
+    log.ld.freedall = 1;
+  release(&log.lock);
+}
+
@@ -6,6 +6,32 @@
 
 volatile static int started = 0;
 
+// Boot work that any hart can pick up once hart 0 has
+// released the others: initializers that don't depend on
+// each other or on anything after them, then freeing the
+// rest of memory.
+static void (*bootjobs[])(void) = {
+  binit,           // buffer cache
+  iinit,           // inode table
+  pcacheinit,      // exec page cache
+  dcacheinit,      // directory name cache
+};
+static int nextjob;
+static volatile int jobsdone;
+
+static void
+bootwork(void)
+{
+  int i;
+
+  while((i = __sync_fetch_and_add(&nextjob, 1)) < NELEM(bootjobs)){
+    bootjobs[i]();
+    __sync_fetch_and_add(&jobsdone, 1);
+  }
+  while(kinitchunk())
+    ;
+}
+
 // start() jumps here in supervisor mode on all CPUs.
 void
 main()
@@ -16,21 +42,30 @@ main()
     printf("\n");
     printf("xv6 kernel is booting\n");
     printf("\n");
-    kinit();         // physical page allocator
+    kinit();         // physical page allocator, first few MB
+    slabinit();      // small object caches
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
     procinit();      // process table
     trapinit();      // trap vectors
+    profinit();      // sampling profiler
+    traceinit();     // event trace rings
+    vdsoinit();      // clock page for user space
     trapinithart();  // install kernel trap vector
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
-    binit();         // buffer cache
-    iinit();         // inode table
+    __sync_synchronize();
+    started = 1;     // let the other harts help with the rest
     fileinit();      // file table
+    pipeinit();      // pipe cache
+    pollinit();      // poll queues
     virtio_disk_init(); // emulated hard disk
-    userinit();      // first user process
+    bootwork();
+    while(jobsdone < NELEM(bootjobs))
+      ;
     __sync_synchronize();
-    started = 1;
+    userinit();      // first user process
+    kzeroinit();     // zeroed page daemon
   } else {
     while(started == 0)
       ;
@@ -39,6 +74,7 @@ main()
     kvminithart();    // turn on paging
     trapinithart();   // install kernel trap vector
     plicinithart();   // ask PLIC for device interrupts
+    bootwork();
   }
 
   scheduler();        
@@ -54,6 +54,8 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   VDSO (clock scale factors, read-only, shared by all)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define VDSO (TRAPFRAME - PGSIZE)
@@ -0,0 +1,11 @@
+// Physical memory allocator statistics, returned by memstat().
+#define NORDER 10         // buddy block sizes, 2^0 to 2^9 pages
+
+struct memstat {
+  uint64 nfree[NORDER];   // free blocks of each order
+  uint64 nalloc[NORDER];  // blocks of each order handed out
+  uint64 nfail[NORDER];   // requests that found no block big enough
+  uint64 nsplit;          // blocks split for a smaller request
+  uint64 nmerge;          // blocks merged with their buddy on free
+  uint64 ncached;         // pages in the per-CPU caches
+};
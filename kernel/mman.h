@@ -0,0 +1,10 @@
+// Protections and flags for mmap().
+#define PROT_READ  0x1
+#define PROT_WRITE 0x2
+#define PROT_EXEC  0x4
+
+#define MAP_SHARED    0x01  // stores reach the file, and are seen after fork()
+#define MAP_PRIVATE   0x02  // stores make private copies
+#define MAP_ANONYMOUS 0x20  // zero-filled memory, no file
+
+#define MAP_FAILED ((void*)-1)
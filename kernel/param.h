@@ -1,16 +1,53 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC        64  // default maximum number of processes
+#define NPROCMAX   1024  // largest allowed maximum, see setmaxproc()
+#define NPROCSESS    48  // maximum live processes per session
 #define NCPU          8  // maximum number of CPUs
-#define NOFILE       24  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define TICKCYCLES 1000000 // timer cycles per tick, about a tenth of a second
+#define TIMEFREQ  10000000 // timer cycles per second, qemu's virt machine
+#define IDLEMAX       5  // max ticks an idle CPU sleeps without a timer due
+#define SCHED_RR      0  // run queues in FIFO order
+#define SCHED_STRIDE  1  // stride scheduling by priority
+#define SCHEDPOLICY   SCHED_STRIDE
+#ifndef SCHEDHANDOFF
+#define SCHEDHANDOFF  1  // sched() switches straight to the next process
+#endif
+#define DEFPRIO      10  // priority of a new process
+#define MAXPRIO     100  // priorities are 1..MAXPRIO; higher gets more CPU
+#define NOFILE       24  // open files per process, at most 64
+#define UFLUSHPAGES  16  // unmaps larger than this flush the whole ASID
+#define NVMA         16  // demand-paged file regions per process
+#define NUTLB         8  // cached user translations per process
+#define NINODE       200 // maximum number of active i-nodes
+#define NIHASH       67  // inode table hash buckets (prime)
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       2000  // size of file system in blocks
+#define LOGSIZE      (MAXOPBLOCKS*12) // max data blocks in on-disk log (< 255)
+#define LOGWINDOW    1   // ticks to gather ops into one commit; 0 = commit in end_op
+#define MAXOPDATA    16  // max # of file data blocks any FS op writes
+#define NLOGDATA     (MAXOPDATA*4) // max data blocks per transaction
+#define NLOGFREED    64  // freed blocks a transaction remembers
+#define NBUF         (MAXOPBLOCKS*30) // size of disk block cache
+#define NBUCKET      13  // buffer cache hash buckets (prime)
+#define NREADAHEAD   8   // blocks read ahead of sequential readi
+#define DISKQDEPTH   8   // disk requests in flight at once
+#define DISKMERGE    16  // most adjacent blocks in one disk request
+#ifndef DISKDELAY
+#define DISKDELAY    0   // ticks an idle disk waits to merge; make DISKDELAY=1 to try
+#endif
+#define FSSIZE       200000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
 #define USERSTACK    1     // user stack pages
+#ifndef KDEBUG
+#define KDEBUG       1     // junk-fill pages in kalloc/kfree; make KDEBUG=0 to drop
+#endif
+#ifndef LOCKSTAT
+#define LOCKSTAT     0     // count spinlock contention; make LOCKSTAT=1 to add
+#endif
+#define NLOCKCLASS   64    // lock names tracked with LOCKSTAT
+#ifndef TICKETLOCK
+#define TICKETLOCK   0     // fair ticket spinlocks; make TICKETLOCK=1 to use
+#endif
 // #define NOFILE 24
 
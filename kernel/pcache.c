@@ -0,0 +1,219 @@
+// Page cache for executables.
+//
+// exec() maps read-only program segments lazily; page faults on
+// them are served from this cache of file pages, keyed by
+// (dev, inum, offset), so processes running the same binary
+// share one physical copy of its text.
+//
+// The cache holds one kalloc() reference on each of its pages
+// and every mapping holds another, so evicting or invalidating
+// an entry never pulls a page out from under a process.
+//
+// In-memory inodes count their cached pages in ip->ncached.
+// writei() copies what it writes into the pages that are still
+// mapped, so that MAP_SHARED mappers keep seeing one page, and
+// drops the rest. itrunc() drops all of a file's pages, and
+// iget() drops them before recycling the inode's slot.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "file.h"
+
+#define NPCPAGE   256  // cached pages
+#define NPCBUCKET 61
+
+struct pcpage {
+  uint dev;
+  uint inum;
+  uint off;            // page-aligned file offset
+  char *pa;            // 0 if the slot is free
+  struct inode *ip;    // in-memory inode counting this page
+  struct pcpage *next; // hash chain
+};
+
+struct {
+  struct spinlock lock;
+  struct pcpage page[NPCPAGE];
+  struct pcpage *bucket[NPCBUCKET];
+  int hand;            // next slot to evict
+  uint64 nhit;
+  uint64 nmiss;
+} pcache;
+
+static struct pcpage**
+pchash(uint dev, uint inum, uint off)
+{
+  return &pcache.bucket[(dev * 31 + inum * 17 + off / PGSIZE) % NPCBUCKET];
+}
+
+// Remove e from its hash chain and drop the cache's
+// reference to its page. Caller holds pcache.lock.
+static void
+pcdrop(struct pcpage *e)
+{
+  struct pcpage **pp;
+
+  for(pp = pchash(e->dev, e->inum, e->off); *pp; pp = &(*pp)->next){
+    if(*pp == e){
+      *pp = e->next;
+      break;
+    }
+  }
+  e->ip->ncached--;
+  kfree(e->pa);
+  e->pa = 0;
+  e->ip = 0;
+  e->next = 0;
+}
+
+void
+pcacheinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+}
+
+// Return the physical page holding ip's data at page-aligned
+// offset off, with a reference for the caller, reading it from
+// the file if it isn't cached. Bytes beyond the end of the file
+// are zero. Returns 0 if out of memory or the read fails.
+// Caller must not hold ip->lock exclusively.
+char*
+pcache_get(struct inode *ip, uint off)
+{
+  struct pcpage *e;
+  char *mem;
+  int n;
+
+  acquire(&pcache.lock);
+  for(e = *pchash(ip->dev, ip->inum, off); e; e = e->next){
+    if(e->dev == ip->dev && e->inum == ip->inum && e->off == off){
+      kref(e->pa);
+      pcache.nhit++;
+      release(&pcache.lock);
+      return e->pa;
+    }
+  }
+  pcache.nmiss++;
+  release(&pcache.lock);
+
+  if((mem = kalloc()) == 0)
+    return 0;
+
+  ilockshared(ip);
+  n = readi(ip, 0, (uint64)mem, off, PGSIZE);
+  if(n < 0){
+    iunlockshared(ip);
+    kfree(mem);
+    return 0;
+  }
+  memset(mem + n, 0, PGSIZE - n);
+
+  // insert while still holding ip->lock, so that a writei()
+  // can't slip in between the read and the insert.
+  acquire(&pcache.lock);
+  for(e = *pchash(ip->dev, ip->inum, off); e; e = e->next){
+    if(e->dev == ip->dev && e->inum == ip->inum && e->off == off){
+      // another process read it meanwhile.
+      kref(e->pa);
+      release(&pcache.lock);
+      iunlockshared(ip);
+      kfree(mem);
+      return e->pa;
+    }
+  }
+  // evict a page no process maps if there is one, so that
+  // later mappers of a shared page find the same copy.
+  for(n = 0; n < NPCPAGE; n++){
+    e = &pcache.page[(pcache.hand + n) % NPCPAGE];
+    if(e->pa == 0 || krefcount(e->pa) == 1)
+      break;
+  }
+  if(n == NPCPAGE)
+    n = 0;
+  e = &pcache.page[(pcache.hand + n) % NPCPAGE];
+  pcache.hand = (pcache.hand + n + 1) % NPCPAGE;
+  if(e->pa)
+    pcdrop(e);
+  e->dev = ip->dev;
+  e->inum = ip->inum;
+  e->off = off;
+  e->pa = mem;
+  e->ip = ip;
+  ip->ncached++;
+  e->next = *pchash(ip->dev, ip->inum, off);
+  *pchash(ip->dev, ip->inum, off) = e;
+  kref(mem);
+  release(&pcache.lock);
+  iunlockshared(ip);
+  return mem;
+}
+
+// writei() stored the n bytes at src, all within one page,
+// into ip at offset off. Copy them into that page of the cache
+// if a process maps it, else drop it: it will be read again.
+// Caller holds ip->lock exclusively.
+void
+pcache_write(struct inode *ip, uint off, char *src, uint n)
+{
+  struct pcpage *e;
+  uint pgoff = PGROUNDDOWN(off);
+
+  acquire(&pcache.lock);
+  for(e = *pchash(ip->dev, ip->inum, pgoff); e; e = e->next){
+    if(e->dev == ip->dev && e->inum == ip->inum && e->off == pgoff){
+      if(krefcount(e->pa) == 1)
+        pcdrop(e);
+      else
+        memmove(e->pa + (off - pgoff), src, n);
+      break;
+    }
+  }
+  release(&pcache.lock);
+}
+
+// Drop all of ip's cached pages, because the file
+// was truncated or its inode slot is being reused.
+void
+pcache_inval(struct inode *ip)
+{
+  struct pcpage *e;
+
+  acquire(&pcache.lock);
+  for(e = pcache.page; e < &pcache.page[NPCPAGE] && ip->ncached > 0; e++){
+    if(e->pa && e->ip == ip)
+      pcdrop(e);
+  }
+  release(&pcache.lock);
+}
+
+// Free the cached pages that no process has mapped.
+// Called by kalloc() when memory runs out.
+// Returns the number of pages freed.
+int
+pcache_reclaim(void)
+{
+  struct pcpage *e;
+  int n = 0;
+
+  acquire(&pcache.lock);
+  for(e = pcache.page; e < &pcache.page[NPCPAGE]; e++){
+    if(e->pa && krefcount(e->pa) == 1){
+      pcdrop(e);
+      n++;
+    }
+  }
+  release(&pcache.lock);
+  return n;
+}
+
+// Print cache statistics. For debugging.
+void
+pcachedump(void)
+{
+  printf("pcache: hit %ld miss %ld\n", pcache.nhit, pcache.nmiss);
+}
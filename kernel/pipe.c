@@ -7,18 +7,36 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "slab.h"
+#include "poll.h"
 
-#define PIPESIZE 512
+// The ring is a page of its own, filled and drained with
+// bulk copies. Writers wake readers only when the pipe goes
+// from empty to non-empty, and readers wake writers only when
+// it goes from full to not full, since nobody sleeps otherwise.
+#define PIPEORDER 1
+#define PIPESIZE (PGSIZE << PIPEORDER)
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *data;     // PIPESIZE-byte ring
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  struct pollent *pollq;  // processes in poll(); polllock
 };
 
+struct kmem_cache pipecache;
+
+void
+pipeinit(void)
+{
+  kmem_cache_init(&pipecache, "pipe", sizeof(struct pipe));
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,12 +46,16 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((pi = (struct pipe*)kalloc()) == 0)
+  if((pi = kmem_cache_alloc(&pipecache)) == 0)
+    goto bad;
+  pi->data = 0;
+  if((pi->data = kalloc_order(PIPEORDER)) == 0)
     goto bad;
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
   pi->nread = 0;
+  pi->pollq = 0;
   initlock(&pi->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -46,8 +68,11 @@ pipealloc(struct file **f0, struct file **f1)
   return 0;
 
  bad:
-  if(pi)
-    kfree((char*)pi);
+  if(pi){
+    if(pi->data)
+      kfree_order(pi->data, PIPEORDER);
+    kmem_cache_free(&pipecache, pi);
+  }
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -66,19 +91,29 @@ pipeclose(struct pipe *pi, int writable)
     pi->readopen = 0;
     wakeup(&pi->nwrite);
   }
+  pollwake(&pi->pollq);
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+    kfree_order(pi->data, PIPEORDER);
+    kmem_cache_free(&pipecache, pi);
   } else
     release(&pi->lock);
 }
 
+// Write n bytes from addr, a user address if user_src, else
+// a kernel one, as sendfile() passes.
 int
-pipewrite(struct pipe *pi, uint64 addr, int n)
+pipewrite(struct pipe *pi, int user_src, uint64 addr, int n)
 {
-  int i = 0;
+  int i = 0, m;
+  uint off;
   struct proc *pr = myproc();
 
+  // copyin() below can't read file pages from disk
+  // while holding pi->lock.
+  if(user_src && n > 0)
+    uvmprefault(pr, addr, n, 0);
+
   acquire(&pi->lock);
   while(i < n){
     if(pi->readopen == 0 || killed(pr)){
@@ -86,28 +121,38 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       return -1;
     }
     if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
-      wakeup(&pi->nread);
       sleep(&pi->nwrite, &pi->lock);
     } else {
-      char ch;
-      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
+      // copy as much as fits before the ring wraps.
+      off = pi->nwrite % PIPESIZE;
+      m = min(n - i, PIPESIZE - (pi->nwrite - pi->nread));
+      m = min(m, PIPESIZE - off);
+      if(either_copyin(pi->data + off, user_src, addr + i, m) == -1)
         break;
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+      if(pi->nwrite == pi->nread){
+        wakeup(&pi->nread);
+        pollwake(&pi->pollq);
+      }
+      pi->nwrite += m;
+      i += m;
     }
   }
-  wakeup(&pi->nread);
   release(&pi->lock);
 
   return i;
 }
 
 int
-piperead(struct pipe *pi, uint64 addr, int n)
+piperead(struct pipe *pi, int user_dst, uint64 addr, int n)
 {
-  int i;
+  int i, m, full;
+  uint off;
   struct proc *pr = myproc();
-  char ch;
+
+  // nor can copyout() below. one read takes at most
+  // PIPESIZE bytes.
+  if(user_dst && n > 0)
+    uvmprefault(pr, addr, min(n, PIPESIZE), 1);
 
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
@@ -117,14 +162,45 @@ piperead(struct pipe *pi, uint64 addr, int n)
     }
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
-      break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+  full = pi->nwrite == pi->nread + PIPESIZE;
+  for(i = 0; i < n && pi->nread != pi->nwrite; i += m){  //DOC: piperead-copy
+    off = pi->nread % PIPESIZE;
+    m = min(n - i, pi->nwrite - pi->nread);
+    m = min(m, PIPESIZE - off);
+    if(either_copyout(user_dst, addr + i, pi->data + off, m) == -1)
       break;
+    pi->nread += m;
+  }
+  if(full){
+    wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+    pollwake(&pi->pollq);
   }
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
   release(&pi->lock);
   return i;
 }
+
+// Put e, if not 0, on pi's poll queue, and return which of
+// POLLIN, POLLOUT and POLLHUP hold for the end of the pipe
+// that is writable or not.
+int
+pipepoll(struct pipe *pi, int writable, struct pollent *e)
+{
+  int r = 0;
+
+  if(e)
+    polladd(&pi->pollq, e);
+  acquire(&pi->lock);
+  if(writable){
+    if(pi->readopen == 0)
+      r = POLLHUP;
+    else if(pi->nwrite != pi->nread + PIPESIZE)
+      r = POLLOUT;
+  } else {
+    if(pi->nread != pi->nwrite)
+      r = POLLIN;
+    if(pi->writeopen == 0)
+      r |= POLLHUP;
+  }
+  release(&pi->lock);
+  return r;
+}
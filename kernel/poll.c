@@ -0,0 +1,157 @@
+// poll(): wait for any of several file descriptors.
+//
+// Each pipe, the console and each process's child events keep a
+// queue of pollents, one per process polling them. A poll()
+// puts an entry for each of its descriptors on the matching
+// queue, then, if none is ready yet, sleeps on its poller until
+// pollwake() fires it or its timer runs out, and looks again.
+// A file that becomes ready calls pollwake() on its queue from
+// wherever it already calls wakeup() for readers or writers.
+//
+// polllock protects every queue. It comes after the lock of the
+// object that owns the queue (a pipe's lock, cons.lock or
+// wait_lock), and before a poller's lock.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "poll.h"
+#include "timer.h"
+#include "defs.h"
+
+static struct spinlock polllock;
+
+void
+pollinit(void)
+{
+  initlock(&polllock, "poll");
+}
+
+void
+polladd(struct pollent **q, struct pollent *e)
+{
+  acquire(&polllock);
+  e->next = *q;
+  if(e->next)
+    e->next->pprev = &e->next;
+  e->pprev = q;
+  *q = e;
+  release(&polllock);
+}
+
+void
+polldel(struct pollent *e)
+{
+  acquire(&polllock);
+  if(e->pprev){
+    *e->pprev = e->next;
+    if(e->next)
+      e->next->pprev = e->pprev;
+    e->next = 0;
+    e->pprev = 0;
+  }
+  release(&polllock);
+}
+
+static void
+pollfire(struct poller *pw, int expired)
+{
+  acquire(&pw->lock);
+  pw->fired = 1;
+  if(expired)
+    pw->expired = 1;
+  wakeup(pw);
+  release(&pw->lock);
+}
+
+// Wake every process polling queue q. The unlocked look at *q
+// keeps the common case, nobody polling, as cheap as before;
+// a poller adds itself before it looks at the file, so it
+// can't miss a change it didn't see.
+void
+pollwake(struct pollent **q)
+{
+  struct pollent *e;
+
+  if(*q == 0)
+    return;
+  acquire(&polllock);
+  for(e = *q; e; e = e->next)
+    pollfire(e->pw, 0);
+  release(&polllock);
+}
+
+// The timeout; called by the clock with tickslock held.
+static void
+pollexpire(void *arg)
+{
+  pollfire((struct poller*)arg, 1);
+}
+
+// Fill in fds[i].revents for each of the n descriptors, waiting
+// up to timeout ticks (forever if negative) for one to be
+// ready. Returns how many are, 0 on timeout, or -1 if killed.
+int
+poll(struct pollfd *fds, int n, int timeout)
+{
+  struct proc *p = myproc();
+  struct poller pw;
+  struct pollent ents[NPOLL];
+  struct timer t;
+  struct file *f;
+  int i, ready, first = 1;
+
+  initlock(&pw.lock, "poller");
+  pw.fired = 0;
+  pw.expired = 0;
+  for(i = 0; i < n; i++){
+    ents[i].pw = &pw;
+    ents[i].pprev = 0;
+  }
+  t.pprev = 0;
+
+  for(;;){
+    ready = 0;
+    for(i = 0; i < n; i++){
+      fds[i].revents = 0;
+      if(fds[i].fd < 0)
+        continue;
+      if(fds[i].fd >= NOFILE || (f = p->ofile[fds[i].fd]) == 0){
+        fds[i].revents = POLLNVAL;
+      } else {
+        // register once; the entries stay queued for every look.
+        fds[i].revents = filepoll(f, first && timeout != 0 ? &ents[i] : 0);
+        fds[i].revents &= fds[i].events | POLLHUP | POLLNVAL;
+      }
+      if(fds[i].revents)
+        ready++;
+    }
+    if(first && timeout > 0)
+      tstart(&t, timeout, pollexpire, &pw);
+    first = 0;
+    if(ready || timeout == 0)
+      break;
+
+    acquire(&pw.lock);
+    while(!pw.fired && !pw.expired && !killed(p))
+      sleep(&pw, &pw.lock);
+    pw.fired = 0;
+    if(pw.expired || killed(p)){
+      release(&pw.lock);
+      ready = pw.expired ? 0 : -1;
+      break;
+    }
+    release(&pw.lock);
+  }
+
+  for(i = 0; i < n; i++)
+    polldel(&ents[i]);
+  if(timeout > 0)
+    tcancel(&t);
+  return ready;
+}
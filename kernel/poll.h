@@ -0,0 +1,13 @@
+// Descriptors and events for poll().
+#define NPOLL 16          // most descriptors in one call
+
+#define POLLIN   0x01     // read won't block
+#define POLLOUT  0x04     // write won't block
+#define POLLHUP  0x10     // other end closed, or no children left
+#define POLLNVAL 0x20     // fd isn't open
+
+struct pollfd {
+  int fd;                 // ignored if negative
+  short events;           // POLLIN, POLLOUT wanted
+  short revents;          // what is ready
+};
@@ -4,19 +4,125 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "schedstat.h"
+#include "rusage.h"
+#include "trace.h"
+#include "spawn.h"
+#include "poll.h"
 #include "defs.h"
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
+// Process structures come from a pool that grows a page at
+// a time, up to NPROCMAX, and are never freed, so a stale
+// struct proc pointer still points at some process (check
+// p->pid under p->lock). proc[i] is the i'th structure made;
+// its kernel stack lives at KSTACK(i) and is allocated when
+// the slot is first used. A free slot keeps its stack until
+// kalloc() runs short and proc_reclaim() takes it back.
+// Live processes are limited to maxproc, NPROC by default.
+struct proc *proc[NPROCMAX];
+int maxproc = NPROC;
+
+struct {
+  struct spinlock lock;
+  struct proc *free;    // unused procs, through poolnext
+  int n;                // entries in proc[]
+} procpool;
+
+// A CPU switching to a process first flushes its TLB if a
+// kernel stack has been mapped since it last did, so it can't
+// use a stale translation left by proc_reclaim().
+int kstackgen;
+
+// Live processes hashed by pid, for kill() and other lookups
+// by pid; see findproc(). Each chain has its own lock, which
+// is acquired after p->lock, never before.
+#define NPIDHASH 127
+
+struct pidhash {
+  struct spinlock lock;
+  struct proc *head;
+} pidhash[NPIDHASH];
+
+extern pagetable_t kernel_pagetable;
+
+// Per-CPU queues of RUNNABLE processes, so the scheduler
+// needn't scan proc[]. A process becoming RUNNABLE goes on
+// the queue of the CPU that made it so; an idle CPU steals
+// from the others.
+// A queue's lock is acquired after p->lock, never before.
+//
+// With SCHEDPOLICY SCHED_STRIDE a CPU runs the queued process
+// with the smallest pass, and picking a process advances its
+// pass by STRIDE1 / p->prio, so runnable processes share the
+// CPU in proportion to their priorities. A process joining a
+// queue starts no earlier than the queue's current pass, so
+// time spent asleep doesn't bank CPU time for later.
+//
+// With SCHEDHANDOFF a process giving up its CPU in sched()
+// switches straight to the next process on that CPU's queue,
+// rather than to the scheduler thread and from there to the
+// next process. It locks the next process with tryacquire(),
+// since it already holds its own p->lock; if that fails, or
+// the queue is empty, it goes through the scheduler as usual.
+// The process switched to releases the old one's lock, which
+// the scheduler would otherwise have done; see handoffdone().
+#define STRIDE1 (1 << 20)
+
+struct runq {
+  struct spinlock lock;
+  struct proc *head;
+  struct proc *tail;
+  int len;
+  uint64 pass;    // pass of the process picked last
+  uint64 nrun;    // processes this CPU has switched to
+  uint64 nsteal;  // processes it took from other queues
+} runq[NCPU];
+
+// Sleeping processes, hashed by channel, so wakeup() looks
+// only at processes that might sleep on its channel.
+// sleep() queues itself before releasing the condition lock,
+// so a waker holding that lock always finds it. A queue's
+// lock is acquired before p->lock, never after.
+#define NSLEEPQ 61
+
+struct sleepq {
+  struct spinlock lock;
+  struct proc *head;
+} sleepq[NSLEEPQ];
+
+uint64 nwakeup;       // calls to wakeup()
+uint64 nwakeupempty;  // of those, how many found no sleeper
 
 struct proc *initproc;
 
+// Sessions, for per-session quotas. A session slot is free
+// when its nproc is zero. Both counters are updated with
+// atomic adds so a full table or quota is detected without
+// scanning or locking proc[].
+//
+// setsid() alone would let any process escape its quota by
+// starting a fresh session after each fork(), so a session
+// made from any session but init's nests in its creator's
+// top session, whose nproc counts the processes of every
+// session nested in it. The hole left is init's session,
+// which holds the shell and what it runs in the foreground:
+// each session made from there gets a quota of its own.
+struct session sessions[NPROCMAX];
+int nlive;  // allocated procs
+
+// Updated with atomic adds, so fork doesn't serialize on a lock.
 int nextpid = 1;
-struct spinlock pid_lock;
+int nextkpid = -1;
 
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void addchild(struct proc *parent, struct proc *p);
+static void sessput(struct session *s);
+static struct sleepq *sqhash(void *chan);
+static void sqinsert(struct sleepq *sq, struct proc *p);
+static void sqremove(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
@@ -26,36 +132,162 @@ extern char trampoline[]; // trampoline.S
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
+// Make the page-table pages for every kernel stack slot,
+// each followed by an invalid guard page. The stacks
+// themselves are mapped on demand by kstackmap().
 void
 proc_mapstacks(pagetable_t kpgtbl)
+{
+  for(int i = 0; i < NPROCMAX; i++)
+    if(walk(kpgtbl, KSTACK(i), 1) == 0)
+      panic("proc_mapstacks");
+}
+
+// Carve the zeroed page mem into procs for the pool.
+// Caller must hold procpool.lock.
+static void
+procgrow(char *mem)
 {
   struct proc *p;
-  
-  for(p = proc; p < &proc[NPROC]; p++) {
-    char *pa = kalloc();
-    if(pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int) (p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
+
+  for(p = (struct proc*)mem; (char*)(p + 1) <= mem + PGSIZE; p++){
+    if(procpool.n >= NPROCMAX)
+      break;
+    initlock(&p->lock, "proc");
+    p->state = UNUSED;
+    p->kstack = KSTACK(procpool.n);
+    p->poolnext = procpool.free;
+    procpool.free = p;
+    proc[procpool.n] = p;
+    __sync_synchronize();
+    procpool.n++;
+  }
+}
+
+// Give p a kernel stack if proc_reclaim() took its old one.
+static int
+kstackmap(struct proc *p)
+{
+  char *pa;
+
+  if(p->kstackpa)
+    return 0;
+  if((pa = kalloc()) == 0)
+    return -1;
+  if(mappages(kernel_pagetable, p->kstack, PGSIZE, (uint64)pa, PTE_R | PTE_W) != 0){
+    kfree(pa);
+    return -1;
+  }
+  p->kstackpa = pa;
+  __sync_fetch_and_add(&kstackgen, 1);
+  return 0;
+}
+
+// Free the kernel stacks of unused procs.
+// Returns the number of pages freed.
+int
+proc_reclaim(void)
+{
+  struct proc *p;
+  int n = 0;
+
+  acquire(&procpool.lock);
+  for(p = procpool.free; p; p = p->poolnext){
+    if(p->kstackpa){
+      uvmunmap(kernel_pagetable, p->kstack, 1, 1);
+      p->kstackpa = 0;
+      n++;
+    }
   }
+  release(&procpool.lock);
+  if(n)
+    sfence_vma();
+  return n;
+}
+
+static struct pidhash*
+pidhashof(int pid)
+{
+  return &pidhash[(uint)pid % NPIDHASH];
+}
+
+static void
+pidhash_insert(struct proc *p)
+{
+  struct pidhash *h = pidhashof(p->pid);
+
+  acquire(&h->lock);
+  p->pidnext = h->head;
+  h->head = p;
+  release(&h->lock);
+}
+
+static void
+pidhash_remove(struct proc *p)
+{
+  struct pidhash *h = pidhashof(p->pid);
+  struct proc **pp;
+
+  acquire(&h->lock);
+  for(pp = &h->head; *pp; pp = &(*pp)->pidnext){
+    if(*pp == p){
+      *pp = p->pidnext;
+      break;
+    }
+  }
+  p->pidnext = 0;
+  release(&h->lock);
+}
+
+// Return the live process with the given pid, with its
+// lock held, or 0 if there is none. Every caller acts for a
+// system call, so kernel threads, which are hashed too, are
+// never found: user programs can't kill or reprioritize them.
+static struct proc*
+findproc(int pid)
+{
+  struct pidhash *h = pidhashof(pid);
+  struct proc *p;
+
+  acquire(&h->lock);
+  for(p = h->head; p; p = p->pidnext)
+    if(p->pid == pid)
+      break;
+  release(&h->lock);
+  if(p == 0)
+    return 0;
+  // p may have exited since; procs are never freed, so
+  // locking it is safe, but the pid must be checked again.
+  acquire(&p->lock);
+  if(p->pid == pid && p->state != UNUSED && p->kfn == 0)
+    return p;
+  release(&p->lock);
+  return 0;
 }
 
 // initialize the proc table.
 void
 procinit(void)
 {
-  struct proc *p;
-  
-  initlock(&pid_lock, "nextpid");
+  char *mem;
+
   initlock(&wait_lock, "wait_lock");
-  for(p = proc; p < &proc[NPROC]; p++) {
-      initlock(&p->lock, "proc");
-      p->state = UNUSED;
-      p->kstack = KSTACK((int) (p - proc));
+  for(int i = 0; i < NCPU; i++)
+    initlock(&runq[i].lock, "runq");
+  for(int i = 0; i < NSLEEPQ; i++)
+    initlock(&sleepq[i].lock, "sleepq");
+  for(int i = 0; i < NPIDHASH; i++)
+    initlock(&pidhash[i].lock, "pidhash");
+  initlock(&procpool.lock, "procpool");
+  // enough structures for the default limit; their
+  // stacks come later.
+  acquire(&procpool.lock);
+  while(procpool.n < NPROC){
+    if((mem = kzalloc()) == 0)
+      panic("procinit");
+    procgrow(mem);
   }
+  release(&procpool.lock);
 }
 
 // Must be called with interrupts disabled,
@@ -89,56 +321,349 @@ myproc(void)
   return p;
 }
 
-int
-allocpid()
+// Mark p RUNNABLE and append it to this CPU's run queue.
+// Caller must hold p->lock.
+static void
+setrunnable(struct proc *p)
 {
-  int pid;
-  
-  acquire(&pid_lock);
-  pid = nextpid;
-  nextpid = nextpid + 1;
-  release(&pid_lock);
+  struct runq *rq;
 
-  return pid;
+  if(!holding(&p->lock))
+    panic("setrunnable");
+  if(p->onrq)
+    panic("setrunnable: queued");
+  p->state = RUNNABLE;
+  p->onrq = 1;
+  p->rqnext = 0;
+  rq = &runq[cpuid()];
+  acquire(&rq->lock);
+  if(p->pass < rq->pass)
+    p->pass = rq->pass;
+  if(rq->tail)
+    rq->tail->rqnext = p;
+  else
+    rq->head = p;
+  rq->tail = p;
+  rq->len++;
+  release(&rq->lock);
 }
 
-// Look in the process table for an UNUSED proc.
-// If found, initialize state required to run in the kernel,
-// and return with p->lock held.
-// If there are no free procs, or a memory allocation fails, return 0.
+// Find the next process to run in rq, which must be locked.
+// Returns the link that points at it, and sets *prevp to the
+// process before it, or 0 if it is first.
+static struct proc**
+rqpick(struct runq *rq, struct proc **prevp)
+{
+  struct proc *q, **best;
+
+  best = &rq->head;
+  *prevp = 0;
+  if(SCHEDPOLICY == SCHED_STRIDE && rq->head){
+    for(q = rq->head; q->rqnext; q = q->rqnext){
+      if(q->rqnext->pass < (*best)->pass){
+        best = &q->rqnext;
+        *prevp = q;
+      }
+    }
+  }
+  return best;
+}
+
+// Take the process that rqpick() found off rq.
+static void
+rqtake(struct runq *rq, struct proc **best, struct proc *prev)
+{
+  struct proc *p = *best;
+
+  *best = p->rqnext;
+  if(rq->tail == p)
+    rq->tail = prev;
+  rq->len--;
+  p->rqnext = 0;
+  p->onrq = 0;
+  rq->pass = p->pass;
+  p->pass += STRIDE1 / p->prio;
+}
+
+// Remove and return the next process to run from rq, or 0.
 static struct proc*
-allocproc(void)
+dequeue(struct runq *rq)
+{
+  struct proc *p, *prev, **best;
+
+  if(rq->head == 0)
+    return 0;
+  acquire(&rq->lock);
+  best = rqpick(rq, &prev);
+  if((p = *best) != 0)
+    rqtake(rq, best, prev);
+  release(&rq->lock);
+  return p;
+}
+
+// For sched(): remove and return the next process to run
+// from this CPU's queue, locked, if it isn't p and its lock
+// is free. Otherwise leave the queue alone and return 0.
+static struct proc*
+handoff(struct proc *p)
+{
+  struct runq *rq = &runq[cpuid()];
+  struct proc *np, *prev, **best;
+
+  if(rq->head == 0)
+    return 0;
+  acquire(&rq->lock);
+  best = rqpick(rq, &prev);
+  np = *best;
+  // a free lock means np has finished switching away.
+  if(np && np != p && tryacquire(&np->lock))
+    rqtake(rq, best, prev);
+  else
+    np = 0;
+  release(&rq->lock);
+  return np;
+}
+
+// Count the switch away from p, which has set its state.
+static void
+countswitch(struct proc *p)
+{
+  if(p->state == SLEEPING)
+    p->nvcsw++;
+  else if(p->state == RUNNABLE)
+    p->nivcsw++;
+}
+
+// Make p, whose lock the caller holds, the process running
+// on this CPU, just before swtch()ing to it.
+static void
+runproc(struct cpu *c, struct proc *p)
 {
+  p->state = RUNNING;
+  c->proc = p;
+  runq[cpuid()].nrun++;
+  if(c->kstackgen != kstackgen){
+    c->kstackgen = kstackgen;
+    sfence_vma();
+  }
+  TRACE(TR_SWTCH, p->pid, p->prio);
+}
+
+// Called by a process as soon as it is switched to: if
+// another process handed it the CPU in sched(), that one is
+// now off its stack, and its lock can be released.
+// intena was the other process's; a new process expects it
+// as the scheduler leaves it, and sched() restores its own.
+static void
+handoffdone(void)
+{
+  struct cpu *c = mycpu();
+  struct proc *prev = c->prev;
+
+  if(prev){
+    c->prev = 0;
+    c->intena = 1;
+    release(&prev->lock);
+  }
+}
+
+// Take a process from the longest other run queue.
+static struct proc*
+steal(int id)
+{
+  struct runq *victim = 0;
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
-      release(&p->lock);
+  for(int i = 0; i < NCPU; i++){
+    if(i != id && runq[i].len > 0 &&
+       (victim == 0 || runq[i].len > victim->len))
+      victim = &runq[i];
+  }
+  if(victim == 0 || (p = dequeue(victim)) == 0)
+    return 0;
+  runq[id].nsteal++;
+  return p;
+}
+
+// Count a new process against session s and the
+// session it nests in. Returns -1 if either is at
+// its quota.
+static int
+sessget(struct session *s)
+{
+  if(__sync_add_and_fetch(&s->nproc, 1) > NPROCSESS){
+    __sync_sub_and_fetch(&s->nproc, 1);
+    return -1;
+  }
+  if(s->top != s && __sync_add_and_fetch(&s->top->nproc, 1) > NPROCSESS){
+    __sync_sub_and_fetch(&s->top->nproc, 1);
+    __sync_sub_and_fetch(&s->nproc, 1);
+    return -1;
+  }
+  return 0;
+}
+
+static void
+sessput(struct session *s)
+{
+  struct session *top = s->top;
+
+  if(__sync_sub_and_fetch(&s->nproc, 1) < 0)
+    panic("sessput");
+  if(top != s && __sync_sub_and_fetch(&top->nproc, 1) < 0)
+    panic("sessput top");
+}
+
+// Claim a free session for leader sid, a process moving
+// out of session from, or return 0 if every slot is taken.
+// The new session nests in from's top one unless from is
+// init's. The caller then drops the process from from.
+static struct session*
+sessalloc(int sid, struct session *from)
+{
+  struct session *s;
+
+  for(s = sessions; s < &sessions[NPROCMAX]; s++){
+    if(__sync_bool_compare_and_swap(&s->nproc, 0, 1)){
+      s->sid = sid;
+      s->top = from == &sessions[0] ? s : from->top;
+      // charge top before from lets the process go,
+      // so that top's count never drops to zero.
+      if(s->top != s)
+        __sync_add_and_fetch(&s->top->nproc, 1);
+      return s;
     }
   }
   return 0;
+}
 
-found:
-  p->pid = allocpid();
+// Make the current process the leader of a new session,
+// and of a new process group in it.
+// Returns the new session ID, or -1 if it already leads one.
+int
+setsid(void)
+{
+  struct proc *p = myproc();
+  struct session *s;
+
+  if(p->sess->sid == p->pid)
+    return -1;
+  if((s = sessalloc(p->pid, p->sess)) == 0)
+    return -1;
+  sessput(p->sess);
+  p->sess = s;
+  acquire(&p->lock);
+  p->pgid = p->pid;
+  release(&p->lock);
+  return s->sid;
+}
+
+// Return the number of live processes in session sid and
+// the sessions nested in it, or in the whole system if sid
+// is 0; -1 if there is no such session.
+int
+nprocs(int sid)
+{
+  struct session *s;
+  int n;
+
+  if(sid == 0)
+    return nlive;
+  for(s = sessions; s < &sessions[NPROCMAX]; s++){
+    if((n = s->nproc) > 0 && s->sid == sid)
+      return n;
+  }
+  return -1;
+}
+
+int
+allocpid()
+{
+  return __sync_fetch_and_add(&nextpid, 1);
+}
+
+// Kernel threads get negative pids, so that user
+// processes keep getting the same pids as without them.
+static int
+allockpid()
+{
+  return __sync_fetch_and_sub(&nextkpid, 1);
+}
+
+// Take an UNUSED proc from the pool, growing it if need be,
+// and mark it USED, without a pid. Returns with p->lock held,
+// or 0 if maxproc processes are live or memory is short.
+static struct proc*
+allocslot(void)
+{
+  struct proc *p;
+  char *mem;
+
+  // fail fast if every slot is taken.
+  if(__sync_add_and_fetch(&nlive, 1) > maxproc)
+    goto fail;
+
+  acquire(&procpool.lock);
+  if((p = procpool.free) != 0)
+    procpool.free = p->poolnext;
+  release(&procpool.lock);
+  if(p == 0){
+    if(procpool.n >= NPROCMAX || (mem = kzalloc()) == 0)
+      goto fail;
+    acquire(&procpool.lock);
+    if(procpool.n < NPROCMAX)
+      procgrow(mem);
+    else
+      kfree(mem);
+    if((p = procpool.free) != 0)
+      procpool.free = p->poolnext;
+    release(&procpool.lock);
+    if(p == 0)
+      goto fail;
+  }
+
+  if(kstackmap(p) < 0){
+    acquire(&procpool.lock);
+    p->poolnext = procpool.free;
+    procpool.free = p;
+    release(&procpool.lock);
+    goto fail;
+  }
+
+  acquire(&p->lock);
   p->state = USED;
+  p->prio = DEFPRIO;
+  p->pass = 0;
+  p->asid = 0;
+  p->utime = p->stime = 0;
+  p->nvcsw = p->nivcsw = 0;
+  p->nfault = p->ninblock = 0;
+  p->cutime = p->cstime = 0;
+  p->cnvcsw = p->cnivcsw = 0;
+  p->cnfault = p->cninblock = 0;
+  return p;
+
+fail:
+  __sync_sub_and_fetch(&nlive, 1);
+  return 0;
+}
 
+// Give p, fresh from allocslot(), what it needs to run
+// in user space: a trapframe, an empty user page table,
+// and a context that starts at forkret.
+// Returns -1 if memory is short.
+static int
+allocuser(struct proc *p)
+{
   // Allocate a trapframe page.
-  if((p->trapframe = (struct trapframe *)kalloc()) == 0){
-    freeproc(p);
-    release(&p->lock);
-    return 0;
-  }
+  if((p->trapframe = (struct trapframe *)kalloc()) == 0)
+    return -1;
 
   // An empty user page table.
   p->pagetable = proc_pagetable(p);
-  if(p->pagetable == 0){
-    freeproc(p);
-    release(&p->lock);
-    return 0;
-  }
+  if(p->pagetable == 0)
+    return -1;
+  memset(p->tlb, 0, sizeof(p->tlb));
 
   // Set up new context to start executing at forkret,
   // which returns to user space.
@@ -146,6 +671,29 @@ found:
   p->context.ra = (uint64)forkret;
   p->context.sp = p->kstack + PGSIZE;
 
+  return 0;
+}
+
+// Look in the process table for an UNUSED proc.
+// If found, initialize state required to run in the kernel,
+// and return with p->lock held.
+// If there are no free procs, or a memory allocation fails, return 0.
+static struct proc*
+allocproc(void)
+{
+  struct proc *p;
+
+  if((p = allocslot()) == 0)
+    return 0;
+  p->pid = allocpid();
+  pidhash_insert(p);
+
+  if(allocuser(p) < 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+
   return p;
 }
 
@@ -155,6 +703,11 @@ found:
 static void
 freeproc(struct proc *p)
 {
+  if(p->state != UNUSED)
+    __sync_sub_and_fetch(&nlive, 1);
+  if(p->sess)
+    sessput(p->sess);
+  p->sess = 0;
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
@@ -162,13 +715,26 @@ freeproc(struct proc *p)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
   p->sz = 0;
+  if(p->pid)
+    pidhash_remove(p);
   p->pid = 0;
+  p->pgid = 0;
   p->parent = 0;
+  p->children = 0;
+  p->zombies = 0;
+  p->zombietail = 0;
+  p->sibling = 0;
+  p->sibprev = 0;
+  p->chldq = 0;
   p->name[0] = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
   p->state = UNUSED;
+  acquire(&procpool.lock);
+  p->poolnext = procpool.free;
+  procpool.free = p;
+  release(&procpool.lock);
 }
 
 // Create a user page table for a given process, with no user memory,
@@ -202,6 +768,14 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // the clock page, which user code may read but not write.
+  if(mappages(pagetable, VDSO, PGSIZE, (uint64)vdsopage, PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
   return pagetable;
 }
 
@@ -212,6 +786,7 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, VDSO, 1, 0);
   uvmfree(pagetable, sz);
 }
 
@@ -236,6 +811,11 @@ userinit(void)
 
   p = allocproc();
   initproc = p;
+  sessions[0].sid = p->pid;
+  sessions[0].nproc = 1;
+  sessions[0].top = &sessions[0];
+  p->sess = &sessions[0];
+  p->pgid = p->pid;
   
   // allocate one user page and copy initcode's instructions
   // and data into it.
@@ -249,12 +829,13 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&p->lock);
 }
 
 // Grow or shrink user memory by n bytes.
+// Growth only moves p->sz; pages are filled in when touched.
 // Return 0 on success, -1 on failure.
 int
 growproc(int n)
@@ -264,11 +845,15 @@ growproc(int n)
 
   sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
+    // allocated lazily, on first touch; see uvmfault().
+    if(sz + n > mmapbase(p))
       return -1;
-    }
+    sz += n;
   } else if(n < 0){
+    if(uvmsplitat(p->pagetable, PGROUNDUP(sz + n)) < 0)
+      return -1;
     sz = uvmdealloc(p->pagetable, sz, sz + n);
+    vmatrim(p->vma, sz);
   }
   p->sz = sz;
   return 0;
@@ -284,9 +869,13 @@ fork(void)
   struct proc *p = myproc();
 
   // Allocate process.
+  if(sessget(p->sess) < 0)
+    return -1;
   if((np = allocproc()) == 0){
+    sessput(p->sess);
     return -1;
   }
+  np->sess = p->sess;
 
   // Copy user memory from parent to child.
   if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
@@ -295,6 +884,11 @@ fork(void)
     return -1;
   }
   np->sz = p->sz;
+  if(vmacopy(p, np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -303,46 +897,244 @@ fork(void)
   np->trapframe->a0 = 0;
 
   // increment reference counts on open file descriptors.
-  for(i = 0; i < NOFILE; i++)
-    if(p->ofile[i])
-      np->ofile[i] = filedup(p->ofile[i]);
+  np->fdmap = 0;
+  for(uint64 m = p->fdmap; m; m &= m - 1){
+    i = __builtin_ctzl(m);
+    if((np->ofile[i] = fileinherit(p->ofile[i])) != 0)
+      np->fdmap |= 1UL << i;
+  }
   np->cwd = idup(p->cwd);
+  for(i = 0; i < NVMA; i++){
+    np->vma[i] = p->vma[i];
+    if(np->vma[i].ip)
+      idup(np->vma[i].ip);
+  }
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
   pid = np->pid;
+  np->pgid = p->pgid;
 
   release(&np->lock);
 
   acquire(&wait_lock);
   np->parent = p;
+  addchild(p, np);
   release(&wait_lock);
 
+  // a child forked while killpg() kills the group is
+  // either seen by its next pass or killed here.
+  if(killed(p))
+    setkilled(np);
+
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  setrunnable(np);
   release(&np->lock);
 
   return pid;
 }
 
-// Pass p's abandoned children to init.
+// Create a child running the program at path, without
+// copying the parent's memory first as fork() then exec()
+// would. The child inherits the parent's open files, less
+// the nact file actions in acts, and its cwd.
+// Returns the child's pid; -1 if no process can be made;
+// -2 if the program can't be loaded, in which case no pid
+// is used up.
+int
+spawn(char *path, char **argv, struct spawnact *acts, int nact, int flags)
+{
+  int i, argc, pid;
+  struct proc *np;
+  struct proc *p = myproc();
+  struct session *s;
+
+  if(sessget(p->sess) < 0)
+    return -1;
+  if((np = allocslot()) == 0){
+    sessput(p->sess);
+    return -1;
+  }
+  np->sess = p->sess;
+  if(allocuser(np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  // np has no pid yet, so nothing else can find it,
+  // and loading the program may sleep.
+  release(&np->lock);
+
+  memset(np->trapframe, 0, sizeof(*np->trapframe));
+  if((argc = execproc(np, path, argv)) < 0){
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
+    return -2;
+  }
+  np->trapframe->a0 = argc;
+
+  np->fdmap = 0;
+  for(uint64 m = p->fdmap; m; m &= m - 1){
+    i = __builtin_ctzl(m);
+    if((np->ofile[i] = fileinherit(p->ofile[i])) != 0)
+      np->fdmap |= 1UL << i;
+  }
+  np->cwd = idup(p->cwd);
+  for(i = 0; i < nact; i++){
+    struct spawnact *a = &acts[i];
+    if(a->fd < 0 || a->fd >= NOFILE || np->ofile[a->fd] == 0)
+      continue;
+    if(a->op == SPAWN_DUP){
+      if(a->newfd < 0 || a->newfd >= NOFILE || a->newfd == a->fd)
+        continue;
+      if(np->ofile[a->newfd])
+        fileclose(np->ofile[a->newfd]);
+      np->ofile[a->newfd] = filedup(np->ofile[a->fd]);
+      np->fdmap |= 1UL << a->newfd;
+    } else if(a->op == SPAWN_CLOSE){
+      fileclose(np->ofile[a->fd]);
+      np->ofile[a->fd] = 0;
+      np->fdmap &= ~(1UL << a->fd);
+    }
+  }
+
+  acquire(&np->lock);
+  pid = np->pid = allocpid();
+  pidhash_insert(np);
+  np->pgid = p->pgid;
+  release(&np->lock);
+
+  // as setsid() would in a fork child; if no session
+  // is free, the child stays in the parent's.
+  if((flags & SPAWN_SETSID) && (s = sessalloc(pid, np->sess)) != 0){
+    sessput(np->sess);
+    np->sess = s;
+    acquire(&np->lock);
+    np->pgid = pid;
+    release(&np->lock);
+  }
+
+  acquire(&wait_lock);
+  np->parent = p;
+  addchild(p, np);
+  release(&wait_lock);
+
+  if(killed(p))
+    setkilled(np);
+
+  acquire(&np->lock);
+  setrunnable(np);
+  release(&np->lock);
+
+  return pid;
+}
+
+// Add p to the front of parent's list of live children.
+// Caller must hold wait_lock.
+static void
+addchild(struct proc *parent, struct proc *p)
+{
+  p->sibling = parent->children;
+  if(p->sibling)
+    p->sibling->sibprev = &p->sibling;
+  p->sibprev = &parent->children;
+  parent->children = p;
+}
+
+// Move p from its parent's live children to the end
+// of the parent's zombies. Caller must hold wait_lock.
+static void
+addzombie(struct proc *p)
+{
+  struct proc *parent = p->parent;
+
+  *p->sibprev = p->sibling;
+  if(p->sibling)
+    p->sibling->sibprev = p->sibprev;
+  p->sibprev = 0;
+  p->sibling = 0;
+  if(parent->zombietail)
+    parent->zombietail->sibling = p;
+  else
+    parent->zombies = p;
+  parent->zombietail = p;
+}
+
+// Pass p's abandoned children to init by splicing
+// p's lists onto init's.
 // Caller must hold wait_lock.
 void
 reparent(struct proc *p)
 {
-  struct proc *pp;
+  struct proc *pp, *last;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
-      pp->parent = initproc;
-      wakeup(initproc);
-    }
+  if(p->children == 0 && p->zombies == 0)
+    return;
+
+  last = 0;
+  for(pp = p->children; pp; pp = pp->sibling){
+    pp->parent = initproc;
+    last = pp;
+  }
+  if(last){
+    last->sibling = initproc->children;
+    if(last->sibling)
+      last->sibling->sibprev = &last->sibling;
+    p->children->sibprev = &initproc->children;
+    initproc->children = p->children;
+    p->children = 0;
   }
+
+  for(pp = p->zombies; pp; pp = pp->sibling)
+    pp->parent = initproc;
+  if(p->zombies){
+    if(initproc->zombietail)
+      initproc->zombietail->sibling = p->zombies;
+    else
+      initproc->zombies = p->zombies;
+    initproc->zombietail = p->zombietail;
+    p->zombies = p->zombietail = 0;
+  }
+
+  wakeup(initproc);
+}
+
+// Free p's first zombie child, copying its exit status
+// to user address addr if addr != 0.
+// Returns the child's pid, or -1 if the copyout failed.
+// Caller must hold wait_lock; p->zombies must be non-empty.
+static int
+reap(struct proc *p, uint64 addr)
+{
+  struct proc *pp = p->zombies;
+  int pid;
+
+  // make sure the child isn't still in exit() or swtch().
+  acquire(&pp->lock);
+  pid = pp->pid;
+  if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
+                          sizeof(pp->xstate)) < 0) {
+    release(&pp->lock);
+    return -1;
+  }
+  p->zombies = pp->sibling;
+  if(p->zombies == 0)
+    p->zombietail = 0;
+  p->cutime += pp->utime + pp->cutime;
+  p->cstime += pp->stime + pp->cstime;
+  p->cnvcsw += pp->nvcsw + pp->cnvcsw;
+  p->cnivcsw += pp->nivcsw + pp->cnivcsw;
+  p->cnfault += pp->nfault + pp->cnfault;
+  p->cninblock += pp->ninblock + pp->cninblock;
+  freeproc(pp);
+  release(&pp->lock);
+  return pid;
 }
 
 // Exit the current process.  Does not return.
-// An exited process remains in the zombie state
-// until its parent calls wait().
+// An exited process remains in the zombie state, with only
+// its pid, exit status and usage, until its parent calls wait().
 void
 exit(int status)
 {
@@ -352,26 +1144,40 @@ exit(int status)
     panic("init exiting");
 
   // Close all open files.
-  for(int fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd]){
-      struct file *f = p->ofile[fd];
-      fileclose(f);
-      p->ofile[fd] = 0;
-    }
+  while(p->fdmap){
+    int fd = __builtin_ctzl(p->fdmap);
+    struct file *f = p->ofile[fd];
+    p->ofile[fd] = 0;
+    p->fdmap &= ~(1UL << fd);
+    fileclose(f);
   }
 
+  munmapall(p);
   begin_op();
   iput(p->cwd);
+  vmafree(p->vma);
   end_op();
   p->cwd = 0;
 
+  // Free user memory and the trapframe now rather than when
+  // the parent reaps us, so an unreaped zombie holds nothing
+  // but its struct proc. From here on we run only in the
+  // kernel, on the kernel page table.
+  proc_freepagetable(p->pagetable, p->sz);
+  p->pagetable = 0;
+  p->sz = 0;
+  kfree((void*)p->trapframe);
+  p->trapframe = 0;
+
   acquire(&wait_lock);
 
   // Give any children to init.
   reparent(p);
 
-  // Parent might be sleeping in wait().
+  // Parent might be sleeping in wait(), or polling for it.
+  addzombie(p);
   wakeup(p->parent);
+  pollwake(&p->parent->chldq);
   
   acquire(&p->lock);
 
@@ -390,41 +1196,21 @@ exit(int status)
 int
 wait(uint64 addr)
 {
-  struct proc *pp;
-  int havekids, pid;
+  int pid;
   struct proc *p = myproc();
 
   acquire(&wait_lock);
 
   for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(pp = proc; pp < &proc[NPROC]; pp++){
-      if(pp->parent == p){
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&pp->lock);
-
-        havekids = 1;
-        if(pp->state == ZOMBIE){
-          // Found one.
-          pid = pp->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
-                                  sizeof(pp->xstate)) < 0) {
-            release(&pp->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(pp);
-          release(&pp->lock);
-          release(&wait_lock);
-          return pid;
-        }
-        release(&pp->lock);
-      }
+    if(p->zombies){
+      // Found one.
+      pid = reap(p, addr);
+      release(&wait_lock);
+      return pid;
     }
 
     // No point waiting if we don't have any children.
-    if(!havekids || killed(p)){
+    if(p->children == 0 || killed(p)){
       release(&wait_lock);
       return -1;
     }
@@ -434,22 +1220,83 @@ wait(uint64 addr)
   }
 }
 
+// Reap an exited child without waiting.
+// Returns its pid, 0 if no child has exited, or -1
+// if the status can't be copied to uva_status.
 int
 wait_noblock(uint64 uva_status) {
   struct proc *p = myproc();
-  for(struct proc *pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p && pp->state == ZOMBIE){
-      int pid = pp->pid;
-      if(copyout(p->pagetable, uva_status, (char*)&pp->xstate, sizeof(int)) < 0)
-        return -1;
-      freeproc(pp);
-      return pid;
+  int pid = 0;
+
+  acquire(&wait_lock);
+  if(p->zombies)
+    pid = reap(p, uva_status);
+  release(&wait_lock);
+  return pid;
+}
+
+// Reap up to n exited children without waiting, storing
+// a (pid, status) pair of ints for each at user address addr.
+// Returns the number reaped, or -1 if addr is bad.
+int
+wait_batch(uint64 addr, int n)
+{
+  return reapn(addr, n, 0);
+}
+
+// Reap up to n exited children as wait_batch() does; if
+// block is set, first wait until one has exited, unless
+// there are no children at all. Returns the number reaped,
+// or -1 if addr is bad or the caller was killed waiting.
+int
+reapn(uint64 addr, int n, int block)
+{
+  struct proc *p = myproc();
+  int pid, nreaped = 0;
+  uint64 rec;
+
+  acquire(&wait_lock);
+  while(block && n > 0 && p->zombies == 0 && p->children){
+    if(killed(p)){
+      release(&wait_lock);
+      return -1;
     }
+    sleep(p, &wait_lock);
   }
-  return 0;
+  while(nreaped < n && p->zombies){
+    rec = addr + nreaped * 2 * sizeof(int);
+    pid = p->zombies->pid;
+    if(copyout(p->pagetable, rec, (char *)&pid, sizeof(pid)) < 0 ||
+       reap(p, rec + sizeof(int)) < 0){
+      if(nreaped == 0)
+        nreaped = -1;
+      break;
+    }
+    nreaped++;
+  }
+  release(&wait_lock);
+  return nreaped;
 }
 
+// Put e, if not 0, on the current process's queue of child
+// events, and return POLLIN if a child has exited, POLLHUP
+// if it has no children at all, as for chldfd() reads.
+int
+chldpoll(struct pollent *e)
+{
+  struct proc *p = myproc();
+  int r = 0;
 
+  if(e)
+    polladd(&p->chldq, e);
+  acquire(&wait_lock);
+  if(p->zombies)
+    r = POLLIN;
+  else if(p->children == 0)
+    r = POLLHUP;
+  release(&wait_lock);
+  return r;
+}
 
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
@@ -463,6 +1310,7 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid();
 
   c->proc = 0;
   for(;;){
@@ -471,29 +1319,41 @@ scheduler(void)
     // processes are waiting.
     intr_on();
 
-    int found = 0;
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-        found = 1;
-      }
-      release(&p->lock);
-    }
-    if(found == 0) {
-      // nothing to run; stop running on this core until an interrupt.
+    if((p = dequeue(&runq[id])) == 0 && (p = steal(id)) == 0){
+      // nothing to run; stop running on this core until an
+      // interrupt, skipping clock ticks until a timer is due.
+      intr_off();
+      w_stimecmp(timeridle());
+      c->tickless = 1;
       intr_on();
       asm volatile("wfi");
+      continue;
+    }
+    if(c->tickless){
+      // busy again; resume regular ticks for preemption.
+      c->tickless = 0;
+      w_stimecmp(r_time() + TICKCYCLES);
+    }
+
+    // p may still be switching away on the CPU that queued
+    // it; acquiring p->lock waits for that to finish.
+    acquire(&p->lock);
+    if(p->state == RUNNABLE) {
+      // Switch to chosen process.  It is the process's job
+      // to release its lock and then reacquire it
+      // before jumping back to us.
+      runproc(c, p);
+      swtch(&c->context, &p->context);
+
+      // A process is done running for now: p, or one that
+      // p or its successors handed the CPU to in sched().
+      // It should have changed its p->state before coming back:
+      // to SLEEPING if it blocked, RUNNABLE if it was preempted.
+      p = c->proc;
+      c->proc = 0;
+      countswitch(p);
     }
+    release(&p->lock);
   }
 }
 
@@ -509,6 +1369,7 @@ sched(void)
 {
   int intena;
   struct proc *p = myproc();
+  struct proc *np;
 
   if(!holding(&p->lock))
     panic("sched p->lock");
@@ -520,7 +1381,16 @@ sched(void)
     panic("sched interruptible");
 
   intena = mycpu()->intena;
-  swtch(&p->context, &mycpu()->context);
+  if(SCHEDHANDOFF && (np = handoff(p)) != 0){
+    countswitch(p);
+    runproc(mycpu(), np);
+    mycpu()->prev = p;
+    swtch(&p->context, &np->context);
+  } else {
+    swtch(&p->context, &mycpu()->context);
+  }
+  // maybe on another CPU now.
+  handoffdone();
   mycpu()->intena = intena;
 }
 
@@ -530,11 +1400,49 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  setrunnable(p);
   sched();
   release(&p->lock);
 }
 
+// A kernel thread's first scheduling swtches here.
+static void
+kthreadret(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler or sched().
+  handoffdone();
+  release(&p->lock);
+
+  p->kfn(p->karg);
+  panic("kthread returned");
+}
+
+// Start a kernel thread running fn(arg). It has no user
+// memory, is nobody's child, and must never return.
+// Returns its (negative) pid, or -1 if the table is full.
+int
+kthread_create(void (*fn)(void*), void *arg, char *name)
+{
+  struct proc *p;
+  int pid;
+
+  if((p = allocslot()) == 0)
+    return -1;
+  p->pid = pid = allockpid();
+  pidhash_insert(p);
+  p->kfn = fn;
+  p->karg = arg;
+  safestrcpy(p->name, name, sizeof(p->name));
+  memset(&p->context, 0, sizeof(p->context));
+  p->context.ra = (uint64)kthreadret;
+  p->context.sp = p->kstack + PGSIZE;
+  setrunnable(p);
+  release(&p->lock);
+  return pid;
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch to forkret.
 void
@@ -542,7 +1450,8 @@ forkret(void)
 {
   static int first = 1;
 
-  // Still holding p->lock from scheduler.
+  // Still holding p->lock from scheduler or sched().
+  handoffdone();
   release(&myproc()->lock);
 
   if (first) {
@@ -565,7 +1474,14 @@ void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
-  
+  struct sleepq *sq = sqhash(chan);
+
+  // Join chan's queue while still holding lk, so that
+  // a wakeup() made under lk will find this process.
+  acquire(&sq->lock);
+  sqinsert(sq, p);
+  release(&sq->lock);
+
   // Must acquire p->lock in order to
   // change p->state and then call sched.
   // Once we hold p->lock, we can be
@@ -579,33 +1495,151 @@ sleep(void *chan, struct spinlock *lk)
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  TRACE(TR_SLEEP, (uint64)chan, 0);
 
   sched();
 
   // Tidy up.
   p->chan = 0;
+  release(&p->lock);
+
+  // still queued if kill() rather than wakeup() woke us.
+  acquire(&sq->lock);
+  if(p->sqprev)
+    sqremove(p);
+  release(&sq->lock);
 
   // Reacquire original lock.
-  release(&p->lock);
   acquire(lk);
 }
 
+static struct sleepq*
+sqhash(void *chan)
+{
+  return &sleepq[((uint64)chan >> 3) % NSLEEPQ];
+}
+
+// Add p to sq. Caller holds sq->lock.
+static void
+sqinsert(struct sleepq *sq, struct proc *p)
+{
+  p->sqnext = sq->head;
+  if(p->sqnext)
+    p->sqnext->sqprev = &p->sqnext;
+  p->sqprev = &sq->head;
+  sq->head = p;
+}
+
+// Take p off its sleep queue. Caller holds the queue's lock.
+static void
+sqremove(struct proc *p)
+{
+  *p->sqprev = p->sqnext;
+  if(p->sqnext)
+    p->sqnext->sqprev = p->sqprev;
+  p->sqnext = 0;
+  p->sqprev = 0;
+}
+
 // Wake up all processes sleeping on chan.
 // Must be called without any p->lock.
 void
 wakeup(void *chan)
 {
-  struct proc *p;
+  struct proc *p, *next;
+  struct sleepq *sq = sqhash(chan);
+  int woke = 0;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
+  acquire(&sq->lock);
+  for(p = sq->head; p; p = next){
+    next = p->sqnext;
     if(p != myproc()){
       acquire(&p->lock);
       if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
+        sqremove(p);
+        setrunnable(p);
+        TRACE(TR_WAKEUP, (uint64)chan, p->pid);
+        woke = 1;
       }
       release(&p->lock);
     }
   }
+  release(&sq->lock);
+  __sync_fetch_and_add(&nwakeup, 1);
+  if(!woke)
+    __sync_fetch_and_add(&nwakeupempty, 1);
+}
+
+// Set the scheduling priority of process pid, or of the
+// caller if pid is 0. New processes start at DEFPRIO and
+// don't inherit their parent's priority.
+// Returns 0, or -1 if there is no such process or prio
+// is out of range.
+int
+setpriority(int pid, int prio)
+{
+  struct proc *p;
+
+  if(prio < 1 || prio > MAXPRIO)
+    return -1;
+  if(pid == 0)
+    pid = myproc()->pid;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  p->prio = prio;
+  release(&p->lock);
+  return 0;
+}
+
+// Copy the resource usage selected by who to user address addr:
+// RUSAGE_SELF, RUSAGE_CHILDREN for reaped descendants, or
+// a pid, to watch another live process.
+// Returns 0, or -1 if there is no such process or addr is bad.
+int
+getrusage(int who, uint64 addr)
+{
+  struct rusage ru;
+  struct proc *p = myproc();
+
+  if(who == RUSAGE_CHILDREN){
+    acquire(&wait_lock);
+    ru.utime = p->cutime;
+    ru.stime = p->cstime;
+    ru.nvcsw = p->cnvcsw;
+    ru.nivcsw = p->cnivcsw;
+    ru.nfault = p->cnfault;
+    ru.ninblock = p->cninblock;
+    release(&wait_lock);
+  } else {
+    if(who == RUSAGE_SELF)
+      who = p->pid;
+    if((p = findproc(who)) == 0)
+      return -1;
+    ru.utime = p->utime;
+    ru.stime = p->stime;
+    ru.nvcsw = p->nvcsw;
+    ru.nivcsw = p->nivcsw;
+    ru.nfault = p->nfault;
+    ru.ninblock = p->ninblock;
+    release(&p->lock);
+  }
+  if(copyout(myproc()->pagetable, addr, (char *)&ru, sizeof(ru)) < 0)
+    return -1;
+  return 0;
+}
+
+// Set the limit on live processes to n, if n is positive.
+// Returns the old limit, or -1 if n is out of range.
+int
+setmaxproc(int n)
+{
+  int old = maxproc;
+
+  if(n < 0 || n > NPROCMAX)
+    return -1;
+  if(n > 0)
+    maxproc = n;
+  return old;
 }
 
 // Kill the process with the given pid.
@@ -616,20 +1650,79 @@ kill(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    // Wake process from sleep().
+    setrunnable(p);
+  }
+  release(&p->lock);
+  return 0;
+}
+
+// Put process pid (0 for the caller), which must be the
+// caller or one of its children, in process group pgid
+// (0 for a new group named after pid).
+int
+setpgid(int pid, int pgid)
+{
+  struct proc *me = myproc();
+  struct proc *p;
+
+  if(pid < 0 || pgid < 0)
+    return -1;
+  if(pid == 0)
+    pid = me->pid;
+  if(pgid == 0)
+    pgid = pid;
+  acquire(&wait_lock);
+  if((p = findproc(pid)) == 0){
+    release(&wait_lock);
+    return -1;
+  }
+  if(p != me && p->parent != me){
+    release(&p->lock);
+    release(&wait_lock);
+    return -1;
+  }
+  p->pgid = pgid;
+  release(&p->lock);
+  release(&wait_lock);
+  return 0;
+}
+
+// Kill every process in group pgid in one call. Members
+// forked during a pass are caught by the next one, which
+// finds nothing new once every member is killed (see fork()).
+// Returns the number killed, or -1 if there were none.
+int
+killpg(int pgid)
+{
+  struct proc *p;
+  int n, total = 0;
+
+  if(pgid <= 0)
+    return -1;
+  do {
+    n = 0;
+    for(int i = 0; i < procpool.n; i++){
+      p = proc[i];
+      if(p->pgid != pgid)
+        continue;
+      acquire(&p->lock);
+      if(p->pgid == pgid && p->state != UNUSED &&
+         p->state != ZOMBIE && !p->killed){
+        p->killed = 1;
+        if(p->state == SLEEPING)
+          setrunnable(p);
+        n++;
       }
       release(&p->lock);
-      return 0;
     }
-    release(&p->lock);
-  }
-  return -1;
+    total += n;
+  } while(n > 0);
+  return total > 0 ? total : -1;
 }
 
 void
@@ -699,7 +1792,8 @@ procdump(void)
   char *state;
 
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
+  for(int i = 0; i < procpool.n; i++){
+    p = proc[i];
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
@@ -707,6 +1801,39 @@ procdump(void)
     else
       state = "???";
     printf("%d %s %s", p->pid, state, p->name);
+    printf(" u %ld s %ld cs %ld/%ld", p->utime, p->stime, p->nvcsw, p->nivcsw);
     printf("\n");
   }
+  for(int i = 0; i < NCPU; i++){
+    struct runq *rq = &runq[i];
+    if(rq->nrun == 0 && rq->len == 0)
+      continue;
+    printf("runq cpu%d: runnable %d ran %ld stolen %ld\n",
+           i, rq->len, rq->nrun, rq->nsteal);
+  }
+  printf("procs: live %d max %d pool %d\n", nlive, maxproc, procpool.n);
+  printf("wakeup: calls %ld empty %ld\n", nwakeup, nwakeupempty);
+  kmemdump();
+  pcachedump();
+  dcachedump();
+  slabdump();
+}
+
+// Copy up to n per-CPU schedstat records to user address addr.
+// Returns the number of CPUs, or -1 on a bad address.
+int
+schedstat(uint64 addr, int n)
+{
+  struct schedstat st;
+  struct proc *p = myproc();
+
+  for(int i = 0; i < n && i < NCPU; i++){
+    st.runnable = runq[i].len;
+    st.pad = 0;
+    st.nrun = runq[i].nrun;
+    st.nsteal = runq[i].nsteal;
+    if(copyout(p->pagetable, addr + i*sizeof(st), (char*)&st, sizeof(st)) < 0)
+      return -1;
+  }
+  return NCPU;
 }
@@ -24,6 +24,10 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  int tickless;               // Idle with the timer set past the next tick?
+  int kstackgen;              // kstackgen at this CPU's last TLB flush
+  uint64 asidgen;             // ASID generation of its last full flush
+  struct proc *prev;          // handed this cpu over; still locked
 };
 
 extern struct cpu cpus[NCPU];
@@ -79,6 +83,42 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
+// A region of user memory paged in on demand from a file
+// through the page cache, or zero-filled; see uvmfault().
+// exec() makes file regions inside p->sz; mmap() makes
+// VMA_MMAP regions of either kind between p->sz and VDSO.
+struct vma {
+  uint64 start;                // Page-aligned first address
+  uint64 end;                  // Page-aligned end
+  uint64 off;                  // File offset of start
+  int perm;                    // PTE_R, PTE_W, PTE_X, PTE_U
+  int flags;                   // VMA_ flags below
+  struct inode *ip;            // File, or 0 if anonymous
+};
+
+#define VMA_MMAP   0x1         // made by mmap(); not trimmed by sbrk()
+#define VMA_SHARED 0x2         // stores are shared, and written back
+
+// is the slot in use?
+#define VMAUSED(v) ((v)->ip || (v)->flags)
+
+// A user translation cached for copyin() and copyout().
+struct utlb {
+  uint64 va;                   // Page-aligned user address
+  uint64 pa;                   // Physical page
+  uint64 flags;                // PTE flags, or 0 if the entry is empty
+};
+
+// A session groups processes for the per-session process quota.
+// A session made from inside another one that isn't init's
+// nests in it: its processes count against the quota of the
+// outermost such session, top, as well as its own.
+struct session {
+  int sid;                     // Session ID, the leader's pid
+  int nproc;                   // Live processes; updated atomically
+  struct session *top;         // Quota it nests in, or itself
+};
+
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -91,17 +131,55 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int pgid;                    // Process group ID, for killpg()
+  int prio;                    // Scheduling priority, 1..MAXPRIO
+  uint64 pass;                 // Stride scheduling pass; runq lock
+  int onrq;                    // On a run queue?
+  struct proc *rqnext;         // Next on run queue; runq lock
+  struct proc *sqnext;         // Next on sleep queue; sleepq lock
+  struct proc **sqprev;        // Link to this proc on its sleep queue
+  struct proc *pidnext;        // Next in pid hash chain; its lock
+  struct proc *poolnext;       // Next unused proc; procpool lock
 
-  // wait_lock must be held when using this:
+  // wait_lock must be held when using these:
   struct proc *parent;         // Parent process
+  struct proc *children;       // Live children, through sibling
+  struct proc *zombies;        // Exited children in exit order
+  struct proc *zombietail;     // Last of zombies
+  struct proc *sibling;        // Next on parent's children or zombies
+  struct proc **sibprev;       // Link to this proc on parent's children
+  struct pollent *chldq;       // Pollers of its child events; polllock
+  uint64 cutime;               // Reaped descendants' usage; see reap()
+  uint64 cstime;
+  uint64 cnvcsw;
+  uint64 cnivcsw;
+  uint64 cnfault;
+  uint64 cninblock;
 
   // these are private to the process, so p->lock need not be held.
+  struct session *sess;        // Session, counting against its quota
   uint64 kstack;               // Virtual address of kernel stack
+  void *kstackpa;              // Its physical page, 0 if reclaimed
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
   struct trapframe *trapframe; // data page for trampoline.S
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
+  uint64 fdmap;                // Bit fd set if ofile[fd] is in use
   struct inode *cwd;           // Current directory
+  struct vma vma[NVMA];        // Demand-paged file regions
+  struct utlb tlb[NUTLB];      // Recent translations; see utlbflush()
+  uint64 asid;                 // Address space ID and generation; see asidswitch()
+  int asidcpu;                 // CPU it last entered user space on
   char name[16];               // Process name (debugging)
+  void (*kfn)(void*);          // Kernel thread function, if a kthread
+  void *karg;                  // Its argument
+
+  // resource usage, written only on the CPU running the process.
+  uint64 utime;                // Clock ticks in user mode
+  uint64 stime;                // Clock ticks in the kernel
+  uint64 nvcsw;                // Voluntary context switches
+  uint64 nivcsw;               // Involuntary ones, by preemption
+  uint64 nfault;               // Page faults handled
+  uint64 ninblock;             // Blocks read from disk
 };
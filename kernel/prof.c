@@ -0,0 +1,97 @@
+// Sampling profiler.
+//
+// While profiling is on, each timer interrupt records where
+// its CPU was: the interrupted pc, whether that was in user
+// space, and the running process. Samples go into a ring per
+// CPU; profread() drains them, and a full ring drops new
+// samples rather than old ones.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "prof.h"
+#include "defs.h"
+
+#define NPROFSAMPLE 256
+
+struct profring {
+  struct spinlock lock;
+  struct profsample s[NPROFSAMPLE];
+  uint head;       // next sample to read
+  uint tail;       // next slot to fill
+  uint64 ndrop;    // samples lost to a full ring
+} profring[NCPU];
+
+int profon;
+
+void
+profinit(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    initlock(&profring[i].lock, "prof");
+}
+
+// Record a sample for this CPU; called from the timer
+// interrupt with interrupts off.
+void
+profsample(uint64 pc, int user)
+{
+  struct profring *r = &profring[cpuid()];
+  struct proc *p = mycpu()->proc;
+  struct profsample *s;
+
+  acquire(&r->lock);
+  if(r->tail - r->head == NPROFSAMPLE){
+    r->ndrop++;
+  } else {
+    s = &r->s[r->tail++ % NPROFSAMPLE];
+    s->pc = pc;
+    s->user = user;
+    s->pid = p ? p->pid : 0;
+    if(p)
+      safestrcpy(s->name, p->name, sizeof(s->name));
+    else
+      safestrcpy(s->name, "idle", sizeof(s->name));
+  }
+  release(&r->lock);
+}
+
+// Turn profiling on or off. Returns the old setting.
+int
+profile(int on)
+{
+  int old = profon;
+
+  profon = on != 0;
+  return old;
+}
+
+// Move up to n samples from the rings to the user array
+// of struct profsample at addr. Returns the number moved,
+// or -1 on a bad address.
+int
+profread(uint64 addr, int n)
+{
+  struct profsample s;
+  int got = 0;
+
+  for(int i = 0; i < NCPU && got < n; i++){
+    struct profring *r = &profring[i];
+    while(got < n){
+      acquire(&r->lock);
+      if(r->head == r->tail){
+        release(&r->lock);
+        break;
+      }
+      s = r->s[r->head++ % NPROFSAMPLE];
+      release(&r->lock);
+      if(copyout(myproc()->pagetable, addr + got*sizeof(s), (char*)&s, sizeof(s)) < 0)
+        return -1;
+      got++;
+    }
+  }
+  return got;
+}
@@ -0,0 +1,7 @@
+// A profiling sample, returned by profread().
+struct profsample {
+  uint64 pc;       // interrupted pc
+  int pid;         // running process, or 0 if idle
+  int user;        // was pc in user space?
+  char name[16];   // process name
+};
@@ -0,0 +1,12 @@
+// Resource usage of a process, returned by getrusage().
+#define RUSAGE_SELF      0    // the calling process
+#define RUSAGE_CHILDREN  (-1) // its reaped descendants, summed
+
+struct rusage {
+  uint64 utime;     // clock ticks in user mode
+  uint64 stime;     // clock ticks in the kernel
+  uint64 nvcsw;     // voluntary context switches (sleeps)
+  uint64 nivcsw;    // involuntary ones (preemptions)
+  uint64 nfault;    // page faults handled
+  uint64 ninblock;  // blocks read from disk
+};
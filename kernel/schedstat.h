@@ -0,0 +1,7 @@
+// Per-CPU scheduler statistics, returned by sched_stat().
+struct schedstat {
+  int runnable;   // processes waiting on this CPU's run queue
+  int pad;
+  uint64 nrun;    // processes this CPU has switched to
+  uint64 nsteal;  // processes it took from other CPUs' queues
+};
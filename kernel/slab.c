@@ -0,0 +1,261 @@
+// Slab allocator for small kernel objects.
+//
+// A kmem_cache hands out objects of one size, carved from
+// pages (slabs) that start with a struct slab header, so
+// that an object's slab is found by rounding its address
+// down. Each CPU keeps a magazine of recently freed objects,
+// and kmem_cache_alloc() and kmem_cache_free() normally touch
+// only that: an empty magazine refills half of itself from
+// the slabs, a full one gives half back. Slabs whose objects
+// are all free are kept until kalloc() runs short and calls
+// slab_reclaim().
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "slab.h"
+#include "defs.h"
+
+struct slab {
+  struct slab *next;      // on the cache's partial or empty list
+  struct slab **prev;     // link to this slab on that list
+  void *free;             // free objects, through their first word
+  int nfree;
+};
+
+struct {
+  struct spinlock lock;
+  struct kmem_cache *list;
+} slabs;
+
+void
+slabinit(void)
+{
+  initlock(&slabs.lock, "slabs");
+}
+
+void
+kmem_cache_init(struct kmem_cache *c, char *name, uint size)
+{
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = (size + 7) & ~7;
+  c->perslab = (PGSIZE - sizeof(struct slab)) / c->size;
+  if(c->perslab < 1)
+    panic("kmem_cache_init");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&c->mag[i].lock, "magazine");
+  acquire(&slabs.lock);
+  c->next = slabs.list;
+  slabs.list = c;
+  release(&slabs.lock);
+}
+
+static void
+slabpush(struct slab **list, struct slab *s)
+{
+  s->next = *list;
+  if(*list)
+    (*list)->prev = &s->next;
+  s->prev = list;
+  *list = s;
+}
+
+static void
+slabremove(struct slab *s)
+{
+  *s->prev = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+  s->next = 0;
+  s->prev = 0;
+}
+
+// Take a free object from c's slabs, or return 0.
+// Caller must hold c->lock.
+static void*
+slabget(struct kmem_cache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  if((s = c->partial) == 0){
+    if((s = c->empty) == 0)
+      return 0;
+    slabremove(s);
+    slabpush(&c->partial, s);
+  }
+  obj = s->free;
+  s->free = *(void**)obj;
+  if(--s->nfree == 0)
+    slabremove(s);  // full slabs are on no list
+  return obj;
+}
+
+// Return obj to its slab. Caller must hold c->lock.
+static void
+slabput(struct kmem_cache *c, void *obj)
+{
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint64)obj);
+
+  *(void**)obj = s->free;
+  s->free = obj;
+  if(++s->nfree == 1)
+    slabpush(&c->partial, s);
+  else if(s->nfree == c->perslab){
+    slabremove(s);
+    slabpush(&c->empty, s);
+  }
+}
+
+// Add a new slab to c. Returns -1 if out of memory.
+static int
+slabgrow(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *obj;
+
+  if((s = kalloc()) == 0)
+    return -1;
+  s->free = 0;
+  s->nfree = 0;
+  obj = (char*)s + sizeof(struct slab);
+  for(int i = 0; i < c->perslab; i++, obj += c->size){
+    *(void**)obj = s->free;
+    s->free = obj;
+    s->nfree++;
+  }
+  acquire(&c->lock);
+  slabpush(&c->empty, s);
+  c->nslab++;
+  release(&c->lock);
+  return 0;
+}
+
+// Lock and return this CPU's magazine of c.
+static struct magazine*
+maglock(struct kmem_cache *c)
+{
+  struct magazine *m;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  acquire(&m->lock);
+  pop_off();
+  return m;
+}
+
+// Allocate an object from c, or return 0.
+// Its contents are undefined.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct magazine *m;
+  void *obj;
+
+  for(;;){
+    m = maglock(c);
+    if(m->n == 0){
+      acquire(&c->lock);
+      while(m->n < MAGSIZE/2 && (obj = slabget(c)) != 0)
+        m->obj[m->n++] = obj;
+      c->nrefill++;
+      release(&c->lock);
+    }
+    if(m->n > 0)
+      break;
+    // no memory held on m's lock, since kalloc() may
+    // call slab_reclaim().
+    release(&m->lock);
+    if(slabgrow(c) < 0)
+      return 0;
+  }
+  obj = m->obj[--m->n];
+  c->nalloc++;
+  release(&m->lock);
+  return obj;
+}
+
+// Give back obj, which came from kmem_cache_alloc(c).
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  struct magazine *m;
+
+#if KDEBUG
+  memset(obj, 1, c->size);
+#endif
+  m = maglock(c);
+  if(m->n == MAGSIZE){
+    acquire(&c->lock);
+    while(m->n > MAGSIZE/2)
+      slabput(c, m->obj[--m->n]);
+    release(&c->lock);
+  }
+  m->obj[m->n++] = obj;
+  release(&m->lock);
+}
+
+// Empty c's magazines and free its empty slabs.
+// Returns the number of pages freed.
+static int
+kmem_cache_reclaim(struct kmem_cache *c)
+{
+  struct slab *s, *list;
+  int n = 0;
+
+  for(int i = 0; i < NCPU; i++){
+    struct magazine *m = &c->mag[i];
+    acquire(&m->lock);
+    acquire(&c->lock);
+    while(m->n > 0)
+      slabput(c, m->obj[--m->n]);
+    release(&c->lock);
+    release(&m->lock);
+  }
+
+  acquire(&c->lock);
+  list = c->empty;
+  c->empty = 0;
+  for(s = list; s; s = s->next)
+    c->nslab--;
+  release(&c->lock);
+
+  for(; list; list = s){
+    s = list->next;
+    kfree(list);
+    n++;
+  }
+  return n;
+}
+
+// Give back memory held by every cache.
+// Returns the number of pages freed.
+int
+slab_reclaim(void)
+{
+  struct kmem_cache *c;
+  int n = 0;
+
+  acquire(&slabs.lock);
+  for(c = slabs.list; c; c = c->next)
+    n += kmem_cache_reclaim(c);
+  release(&slabs.lock);
+  return n;
+}
+
+// Print per-cache statistics. For debugging.
+void
+slabdump(void)
+{
+  struct kmem_cache *c;
+
+  for(c = slabs.list; c; c = c->next){
+    if(c->nalloc == 0)
+      continue;
+    printf("slab %s: size %d slabs %d allocs %ld refills %ld\n",
+           c->name, c->size, c->nslab, c->nalloc, c->nrefill);
+  }
+}
@@ -0,0 +1,23 @@
+// A cache of equal-sized kernel objects; see slab.c.
+#define MAGSIZE 16  // objects per CPU magazine
+
+// Objects freed on one CPU, for it to hand out again.
+struct magazine {
+  struct spinlock lock;  // only slab_reclaim() contends
+  int n;
+  void *obj[MAGSIZE];
+};
+
+struct kmem_cache {
+  struct spinlock lock;
+  char *name;
+  uint size;              // object size, a multiple of 8
+  int perslab;            // objects per slab
+  struct slab *partial;   // slabs with some objects in use
+  struct slab *empty;     // slabs with none in use
+  int nslab;              // slabs held
+  uint64 nalloc;          // objects handed out
+  uint64 nrefill;         // magazine refills from slabs
+  struct kmem_cache *next; // in the list of all caches
+  struct magazine mag[NCPU];
+};
@@ -1,4 +1,11 @@
 // Sleeping locks
+//
+// A sleeplock is held either exclusively by one process, or
+// shared by any number that only read what it protects. A
+// shared acquire waits only for an exclusive holder, not for
+// waiting ones, so a reader may take a lock shared that it
+// already holds shared; writers can wait behind a steady
+// stream of readers.
 
 #include "types.h"
 #include "riscv.h"
@@ -15,6 +22,7 @@ initsleeplock(struct sleeplock *lk, char *name)
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  lk->readers = 0;
   lk->pid = 0;
 }
 
@@ -22,7 +30,7 @@ void
 acquiresleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
-  while (lk->locked) {
+  while (lk->locked || lk->readers) {
     sleep(lk, &lk->lk);
   }
   lk->locked = 1;
@@ -40,6 +48,29 @@ releasesleep(struct sleeplock *lk)
   release(&lk->lk);
 }
 
+void
+acquiresleepshared(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  while (lk->locked) {
+    sleep(lk, &lk->lk);
+  }
+  lk->readers++;
+  release(&lk->lk);
+}
+
+void
+releasesleepshared(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  if(lk->readers == 0)
+    panic("releasesleepshared");
+  if(--lk->readers == 0)
+    wakeup(lk);
+  release(&lk->lk);
+}
+
+// Does this process hold lk exclusively?
 int
 holdingsleep(struct sleeplock *lk)
 {
@@ -1,6 +1,8 @@
-// Long-term locks for processes
+// Long-term locks for processes.
+// Held either exclusively, or shared by any number of readers.
 struct sleeplock {
-  uint locked;       // Is the lock held?
+  uint locked;       // Is the lock held exclusively?
+  uint readers;      // Holders in shared mode
   struct spinlock lk; // spinlock protecting this sleep lock
   
   // For debugging:
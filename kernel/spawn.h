@@ -0,0 +1,13 @@
+// File actions and flags for spawn().
+#define NSPAWNACT 8       // most file actions in one call
+
+#define SPAWN_CLOSE 1     // close fd in the child
+#define SPAWN_DUP   2     // make newfd a copy of fd in the child
+
+#define SPAWN_SETSID 0x1  // child leads a new session, as after setsid()
+
+struct spawnact {
+  int op;                 // SPAWN_CLOSE or SPAWN_DUP
+  int fd;
+  int newfd;              // for SPAWN_DUP
+};
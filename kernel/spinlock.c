@@ -1,4 +1,9 @@
 // Mutual exclusion spin locks.
+//
+// By default a lock is a test-and-set flag. A kernel built
+// with TICKETLOCK=1 uses ticket locks instead, which are fair
+// under contention and keep waiters off the lock's cache line
+// until it is their turn; LOCKSTAT=1 shows the difference.
 
 #include "types.h"
 #include "param.h"
@@ -6,14 +11,98 @@
 #include "spinlock.h"
 #include "riscv.h"
 #include "proc.h"
+#include "lockstat.h"
 #include "defs.h"
 
+#if LOCKSTAT
+// one record per lock name, found by initlock(). a bare
+// test-and-set guards the table, which can't use a spinlock.
+struct lockstat lockstats[NLOCKCLASS];
+int nlockstats;
+uint lockstatlock;
+
+static struct lockstat*
+lockstatof(char *name)
+{
+  struct lockstat *st = 0;
+  int i;
+
+  push_off();
+  while(__sync_lock_test_and_set(&lockstatlock, 1) != 0)
+    ;
+  for(i = 0; i < nlockstats; i++){
+    if(strncmp(lockstats[i].name, name, sizeof(st->name)) == 0){
+      st = &lockstats[i];
+      break;
+    }
+  }
+  if(st == 0 && nlockstats < NLOCKCLASS){
+    st = &lockstats[nlockstats];
+    safestrcpy(st->name, name, sizeof(st->name));
+    __sync_synchronize();
+    nlockstats++;
+  }
+  __sync_lock_release(&lockstatlock);
+  pop_off();
+  return st;
+}
+
+// Account for a hold of lk that is ending now.
+static void
+lockstat_release(struct spinlock *lk)
+{
+  struct lockstat *st = lk->stat;
+  uint64 held, max;
+  int b;
+
+  if(st == 0)
+    return;
+  held = r_time() - lk->start;
+  __sync_fetch_and_add(&st->holdtotal, held);
+  while((max = st->holdmax) < held &&
+        !__sync_bool_compare_and_swap(&st->holdmax, max, held))
+    ;
+  b = held ? 64 - __builtin_clzl(held) : 0;
+  if(b >= NLOCKHIST)
+    b = NLOCKHIST - 1;
+  __sync_fetch_and_add(&st->hold[b], 1);
+}
+
+// Copy up to n lockstat records to user address addr.
+// Returns the number of records, or -1 on a bad address.
+int
+lockstat(uint64 addr, int n)
+{
+  int i;
+
+  for(i = 0; i < n && i < nlockstats; i++){
+    if(copyout(myproc()->pagetable, addr + i*sizeof(struct lockstat),
+               (char*)&lockstats[i], sizeof(struct lockstat)) < 0)
+      return -1;
+  }
+  return nlockstats;
+}
+#else
+int
+lockstat(uint64 addr, int n)
+{
+  return -1;
+}
+#endif
+
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
   lk->locked = 0;
   lk->cpu = 0;
+#if TICKETLOCK
+  lk->next = 0;
+  lk->serving = 0;
+#endif
+#if LOCKSTAT
+  lk->stat = lockstatof(name);
+#endif
 }
 
 // Acquire the lock.
@@ -25,12 +114,31 @@ acquire(struct spinlock *lk)
   if(holding(lk))
     panic("acquire");
 
+#if LOCKSTAT
+  uint64 spins = 0;
+#define SPIN spins++
+#else
+#define SPIN
+#endif
+
+#if TICKETLOCK
+  // Take a ticket and wait for it to be served, so that waiters
+  // get the lock in arrival order, spinning only on loads.
+  uint ticket = __sync_fetch_and_add(&lk->next, 1);
+  while(__atomic_load_n(&lk->serving, __ATOMIC_ACQUIRE) != ticket){
+    SPIN;
+  }
+  lk->locked = 1;
+#else
   // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
   //   a5 = 1
   //   s1 = &lk->locked
   //   amoswap.w.aq a5, a5, (s1)
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+  while(__sync_lock_test_and_set(&lk->locked, 1) != 0){
+    SPIN;
+  }
+#endif
+#undef SPIN
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +148,53 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+#if LOCKSTAT
+  if(lk->stat){
+    __sync_fetch_and_add(&lk->stat->nacquire, 1);
+    if(spins){
+      __sync_fetch_and_add(&lk->stat->ncontended, 1);
+      __sync_fetch_and_add(&lk->stat->nspin, spins);
+    }
+    lk->start = r_time();
+  }
+#endif
+}
+
+// Acquire the lock only if it is free, without spinning.
+// Returns 1 if it did. For taking a lock out of the usual
+// order, where waiting for it could deadlock.
+int
+tryacquire(struct spinlock *lk)
+{
+  push_off();
+  if(holding(lk))
+    panic("tryacquire");
+
+#if TICKETLOCK
+  // free means nobody holds a ticket past the one being
+  // served; take the next ticket only if that is still so.
+  uint ticket = __atomic_load_n(&lk->serving, __ATOMIC_ACQUIRE);
+  if(!__sync_bool_compare_and_swap(&lk->next, ticket, ticket + 1)){
+    pop_off();
+    return 0;
+  }
+  lk->locked = 1;
+#else
+  if(__sync_lock_test_and_set(&lk->locked, 1) != 0){
+    pop_off();
+    return 0;
+  }
+#endif
+
+  __sync_synchronize();
+  lk->cpu = mycpu();
+#if LOCKSTAT
+  if(lk->stat){
+    __sync_fetch_and_add(&lk->stat->nacquire, 1);
+    lk->start = r_time();
+  }
+#endif
+  return 1;
 }
 
 // Release the lock.
@@ -49,6 +204,9 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+#if LOCKSTAT
+  lockstat_release(lk);
+#endif
   lk->cpu = 0;
 
   // Tell the C compiler and the CPU to not move loads or stores
@@ -59,6 +217,11 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
+#if TICKETLOCK
+  // Serve the next ticket.
+  lk->locked = 0;
+  __atomic_store_n(&lk->serving, lk->serving + 1, __ATOMIC_RELEASE);
+#else
   // Release the lock, equivalent to lk->locked = 0.
   // This code doesn't use a C assignment, since the C standard
   // implies that an assignment might be implemented with
@@ -67,6 +230,7 @@ release(struct spinlock *lk)
   //   s1 = &lk->locked
   //   amoswap.w zero, zero, (s1)
   __sync_lock_release(&lk->locked);
+#endif
 
   pop_off();
 }
@@ -1,9 +1,17 @@
 // Mutual exclusion lock.
 struct spinlock {
   uint locked;       // Is the lock held?
+#if TICKETLOCK
+  uint next;         // Next ticket to hand out
+  uint serving;      // Ticket that holds the lock
+#endif
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+#if LOCKSTAT
+  struct lockstat *stat; // Shared by locks of this name
+  uint64 start;      // r_time() when acquired
+#endif
 };
 
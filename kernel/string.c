@@ -1,13 +1,38 @@
 #include "types.h"
+#include "riscv.h"
+
+// memset, memmove and memcmp work a uint64 at a time once
+// the pointers are 8-byte aligned, and 64 bytes per loop
+// trip for long runs. Unaligned heads and tails, and moves
+// between pointers with different alignment, go byte by byte.
+
+#define WMASK 7
+#define aligned(p) (((uint64)(p) & WMASK) == 0)
 
 void*
 memset(void *dst, int c, uint n)
 {
   char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uint64 w, *wd;
+
+  while(n > 0 && !aligned(cdst)){
+    *cdst++ = c;
+    n--;
   }
+  w = (uchar)c;
+  w |= w << 8;
+  w |= w << 16;
+  w |= w << 32;
+  wd = (uint64*)cdst;
+  for(; n >= 64; n -= 64, wd += 8){
+    wd[0] = w; wd[1] = w; wd[2] = w; wd[3] = w;
+    wd[4] = w; wd[5] = w; wd[6] = w; wd[7] = w;
+  }
+  for(; n >= 8; n -= 8)
+    *wd++ = w;
+  cdst = (char*)wd;
+  while(n-- > 0)
+    *cdst++ = c;
   return dst;
 }
 
@@ -18,6 +43,13 @@ memcmp(const void *v1, const void *v2, uint n)
 
   s1 = v1;
   s2 = v2;
+  if(aligned(s1) && aligned(s2)){
+    // skip equal words; the byte loop finds the difference.
+    while(n >= 8 && *(uint64*)s1 == *(uint64*)s2){
+      s1 += 8, s2 += 8;
+      n -= 8;
+    }
+  }
   while(n-- > 0){
     if(*s1 != *s2)
       return *s1 - *s2;
@@ -41,15 +73,65 @@ memmove(void *dst, const void *src, uint n)
   if(s < d && s + n > d){
     s += n;
     d += n;
+    if((((uint64)s ^ (uint64)d) & WMASK) == 0){
+      while(n > 0 && !aligned(d)){
+        *--d = *--s;
+        n--;
+      }
+      for(; n >= 8; n -= 8){
+        d -= 8, s -= 8;
+        *(uint64*)d = *(const uint64*)s;
+      }
+    }
     while(n-- > 0)
       *--d = *--s;
-  } else
+  } else {
+    if((((uint64)s ^ (uint64)d) & WMASK) == 0){
+      while(n > 0 && !aligned(d)){
+        *d++ = *s++;
+        n--;
+      }
+      for(; n >= 64; n -= 64, d += 64, s += 64){
+        const uint64 *ws = (const uint64*)s;
+        uint64 *wd = (uint64*)d;
+        wd[0] = ws[0]; wd[1] = ws[1]; wd[2] = ws[2]; wd[3] = ws[3];
+        wd[4] = ws[4]; wd[5] = ws[5]; wd[6] = ws[6]; wd[7] = ws[7];
+      }
+      for(; n >= 8; n -= 8, d += 8, s += 8)
+        *(uint64*)d = *(const uint64*)s;
+    }
     while(n-- > 0)
       *d++ = *s++;
+  }
 
   return dst;
 }
 
+// Zero the page-aligned page pa.
+void
+pagezero(void *pa)
+{
+  uint64 *p = (uint64*)pa;
+
+  for(int i = 0; i < PGSIZE/8; i += 8){
+    p[i+0] = 0; p[i+1] = 0; p[i+2] = 0; p[i+3] = 0;
+    p[i+4] = 0; p[i+5] = 0; p[i+6] = 0; p[i+7] = 0;
+  }
+}
+
+// Copy the page-aligned page src to dst.
+void
+pagecopy(void *dst, const void *src)
+{
+  uint64 *d = (uint64*)dst;
+  const uint64 *s = (const uint64*)src;
+
+  for(int i = 0; i < PGSIZE/8; i += 8){
+    d[i+0] = s[i+0]; d[i+1] = s[i+1]; d[i+2] = s[i+2]; d[i+3] = s[i+3];
+    d[i+4] = s[i+4]; d[i+5] = s[i+5]; d[i+6] = s[i+6]; d[i+7] = s[i+7];
+  }
+}
+
 // memcpy exists to placate GCC.  Use memmove.
 void*
 memcpy(void *dst, const void *src, uint n)
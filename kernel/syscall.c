@@ -5,6 +5,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "syscall.h"
+#include "trace.h"
 #include "defs.h"
 
 // Fetch the uint64 at addr from the current process.
@@ -102,6 +103,30 @@ extern uint64 sys_link(void);
 extern uint64 sys_mkdir(void);
 extern uint64 sys_close(void);
 extern uint64 sys_wait_noblock(void);
+extern uint64 sys_sched_stat(void);
+extern uint64 sys_wait_batch(void);
+extern uint64 sys_setsid(void);
+extern uint64 sys_nprocs(void);
+extern uint64 sys_setpriority(void);
+extern uint64 sys_setmaxproc(void);
+extern uint64 sys_setpgid(void);
+extern uint64 sys_killpg(void);
+extern uint64 sys_memstat(void);
+extern uint64 sys_lockstat(void);
+extern uint64 sys_profile(void);
+extern uint64 sys_profread(void);
+extern uint64 sys_getrusage(void);
+extern uint64 sys_trace(void);
+extern uint64 sys_traceread(void);
+extern uint64 sys_uring_enter(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
+extern uint64 sys_spawn(void);
+extern uint64 sys_chldfd(void);
+extern uint64 sys_poll(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
+extern uint64 sys_sendfile(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -128,6 +153,30 @@ static uint64 (*syscalls[])(void) = {
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
 [SYS_wait_noblock] sys_wait_noblock,
+[SYS_sched_stat] sys_sched_stat,
+[SYS_wait_batch] sys_wait_batch,
+[SYS_setsid]  sys_setsid,
+[SYS_nprocs]  sys_nprocs,
+[SYS_setpriority] sys_setpriority,
+[SYS_setmaxproc] sys_setmaxproc,
+[SYS_setpgid] sys_setpgid,
+[SYS_killpg] sys_killpg,
+[SYS_memstat] sys_memstat,
+[SYS_lockstat] sys_lockstat,
+[SYS_profile] sys_profile,
+[SYS_profread] sys_profread,
+[SYS_getrusage] sys_getrusage,
+[SYS_trace]   sys_trace,
+[SYS_traceread] sys_traceread,
+[SYS_uring_enter] sys_uring_enter,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_spawn]   sys_spawn,
+[SYS_chldfd]  sys_chldfd,
+[SYS_poll]    sys_poll,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_sendfile] sys_sendfile,
 };
 
 void
@@ -140,7 +189,9 @@ syscall(void)
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     // Use num to lookup the system call function for num, call it,
     // and store its return value in p->trapframe->a0
+    TRACE(TR_SYSENTER, num, p->trapframe->a0);
     p->trapframe->a0 = syscalls[num]();
+    TRACE(TR_SYSEXIT, num, p->trapframe->a0);
   } else {
     printf("%d %s: unknown sys call %d\n",
             p->pid, p->name, num);
@@ -21,3 +21,27 @@
 #define SYS_mkdir  20
 #define SYS_close  21
 #define SYS_wait_noblock 22
+#define SYS_sched_stat 23
+#define SYS_wait_batch 24
+#define SYS_setsid 25
+#define SYS_nprocs 26
+#define SYS_setpriority 27
+#define SYS_setmaxproc 28
+#define SYS_setpgid 29
+#define SYS_killpg 30
+#define SYS_memstat 31
+#define SYS_lockstat 32
+#define SYS_profile 33
+#define SYS_profread 34
+#define SYS_getrusage 35
+#define SYS_trace 36
+#define SYS_traceread 37
+#define SYS_uring_enter 38
+#define SYS_readv 39
+#define SYS_writev 40
+#define SYS_spawn 41
+#define SYS_chldfd 42
+#define SYS_poll 43
+#define SYS_mmap 44
+#define SYS_munmap 45
+#define SYS_sendfile 46
@@ -15,6 +15,10 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
+#include "spawn.h"
+#include "poll.h"
+#include "mman.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -34,7 +38,7 @@ argfd(int n, int *pfd, struct file **pf)
   return 0;
 }
 
-// Allocate a file descriptor for the given file.
+// Allocate the lowest free file descriptor for the given file.
 // Takes over file reference from caller on success.
 static int
 fdalloc(struct file *f)
@@ -42,13 +46,22 @@ fdalloc(struct file *f)
   int fd;
   struct proc *p = myproc();
 
-  for(fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd] == 0){
-      p->ofile[fd] = f;
-      return fd;
-    }
-  }
-  return -1;
+  if(~p->fdmap == 0)
+    return -1;
+  fd = __builtin_ctzl(~p->fdmap);
+  if(fd >= NOFILE)
+    return -1;
+  p->ofile[fd] = f;
+  p->fdmap |= 1UL << fd;
+  return fd;
+}
+
+// Release file descriptor fd, without closing its file.
+static void
+fdfree(struct proc *p, int fd)
+{
+  p->ofile[fd] = 0;
+  p->fdmap &= ~(1UL << fd);
 }
 
 uint64
@@ -94,6 +107,66 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+// copy in the iovec array for readv/writev, checking
+// that the lengths are sane.
+static int
+argiov(int n, struct iovec *iov, int *cnt)
+{
+  uint64 addr;
+  uint64 tot = 0;
+
+  argaddr(n, &addr);
+  argint(n+1, cnt);
+  if(*cnt < 0 || *cnt > IOV_MAX)
+    return -1;
+  if(copyin(myproc()->pagetable, (char*)iov, addr, *cnt * sizeof(iov[0])) < 0)
+    return -1;
+  for(int i = 0; i < *cnt; i++){
+    tot += iov[i].iov_len;
+    if(iov[i].iov_len > 0x7fffffff || tot > 0x7fffffff)
+      return -1;
+  }
+  return 0;
+}
+
+// sendfile(out, in, n): copy up to n bytes from in to out
+// inside the kernel.
+uint64
+sys_sendfile(void)
+{
+  struct file *out, *in;
+  int n;
+
+  argint(2, &n);
+  if(argfd(0, 0, &out) < 0 || argfd(1, 0, &in) < 0)
+    return -1;
+  return filesend(out, in, n);
+}
+
+uint64
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int n;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &n) < 0)
+    return -1;
+  return filereadv(f, iov, n);
+}
+
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int n;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &n) < 0)
+    return -1;
+  return filewritev(f, iov, n);
+}
+
 uint64
 sys_close(void)
 {
@@ -102,7 +175,7 @@ sys_close(void)
 
   if(argfd(0, &fd, &f) < 0)
     return -1;
-  myproc()->ofile[fd] = 0;
+  fdfree(myproc(), fd);
   fileclose(f);
   return 0;
 }
@@ -222,6 +295,7 @@ sys_unlink(void)
   memset(&de, 0, sizeof(de));
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
+  dcache_enter(dp, name, 0, 0);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -431,47 +505,180 @@ sys_chdir(void)
   return 0;
 }
 
-uint64
-sys_exec(void)
+// Fetch the user argv array at uargv into kernel pages
+// in argv, which must hold MAXARG zeroed pointers.
+static int
+argvfetch(uint64 uargv, char **argv)
 {
-  char path[MAXPATH], *argv[MAXARG];
   int i;
-  uint64 uargv, uarg;
+  uint64 uarg;
 
-  argaddr(1, &uargv);
-  if(argstr(0, path, MAXPATH) < 0) {
-    return -1;
-  }
-  memset(argv, 0, sizeof(argv));
   for(i=0;; i++){
-    if(i >= NELEM(argv)){
-      goto bad;
-    }
-    if(fetchaddr(uargv+sizeof(uint64)*i, (uint64*)&uarg) < 0){
-      goto bad;
-    }
+    if(i >= MAXARG)
+      return -1;
+    if(fetchaddr(uargv+sizeof(uint64)*i, (uint64*)&uarg) < 0)
+      return -1;
     if(uarg == 0){
       argv[i] = 0;
-      break;
+      return 0;
     }
     argv[i] = kalloc();
     if(argv[i] == 0)
-      goto bad;
+      return -1;
     if(fetchstr(uarg, argv[i], PGSIZE) < 0)
-      goto bad;
+      return -1;
   }
+}
 
-  int ret = exec(path, argv);
+static void
+argvfree(char **argv)
+{
+  int i;
 
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
+  for(i = 0; i < MAXARG && argv[i] != 0; i++)
     kfree(argv[i]);
+}
 
+uint64
+sys_exec(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  uint64 uargv;
+  int ret;
+
+  argaddr(1, &uargv);
+  if(argstr(0, path, MAXPATH) < 0) {
+    return -1;
+  }
+  memset(argv, 0, sizeof(argv));
+  if(argvfetch(uargv, argv) < 0){
+    argvfree(argv);
+    return -1;
+  }
+
+  ret = exec(path, argv);
+  argvfree(argv);
   return ret;
+}
 
- bad:
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
-  return -1;
+uint64
+sys_spawn(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  struct spawnact acts[NSPAWNACT];
+  uint64 uargv, uacts;
+  int nact, flags, ret;
+
+  argaddr(1, &uargv);
+  argaddr(2, &uacts);
+  argint(3, &nact);
+  argint(4, &flags);
+  if(argstr(0, path, MAXPATH) < 0)
+    return -1;
+  if(nact < 0 || nact > NSPAWNACT)
+    return -1;
+  if(nact > 0 && copyin(myproc()->pagetable, (char*)acts, uacts,
+                        nact*sizeof(acts[0])) < 0)
+    return -1;
+  memset(argv, 0, sizeof(argv));
+  if(argvfetch(uargv, argv) < 0){
+    argvfree(argv);
+    return -1;
+  }
+
+  ret = spawn(path, argv, acts, nact, flags);
+  argvfree(argv);
+  return ret;
+}
+
+// A descriptor whose reads reap the caller's exited
+// children, for waiting on them alongside other files.
+uint64
+sys_chldfd(void)
+{
+  struct file *f;
+  int fd, flags;
+
+  argint(0, &flags);
+  if((f = filealloc()) == 0)
+    return -1;
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
+  f->type = FD_CHILD;
+  f->readable = 1;
+  f->writable = 0;
+  f->owner = myproc()->pid;
+  f->nonblock = (flags & CHLD_NONBLOCK) != 0;
+  return fd;
+}
+
+// mmap(addr, len, prot, flags, fd, off). The address is
+// only a hint, and is ignored.
+uint64
+sys_mmap(void)
+{
+  uint64 len, off;
+  int prot, flags, perm = 0;
+  struct file *f = 0;
+  struct inode *ip = 0;
+
+  argaddr(1, &len);
+  argint(2, &prot);
+  argint(3, &flags);
+  argaddr(5, &off);
+  if((flags & (MAP_SHARED|MAP_PRIVATE)) == 0 ||
+     (flags & (MAP_SHARED|MAP_PRIVATE)) == (MAP_SHARED|MAP_PRIVATE))
+    return -1;
+  if((flags & MAP_ANONYMOUS) == 0){
+    if(argfd(4, 0, &f) < 0 || f->type != FD_INODE || off % PGSIZE)
+      return -1;
+    // a shared writable mapping writes the file.
+    if(!f->readable || ((prot & PROT_WRITE) && (flags & MAP_SHARED) && !f->writable))
+      return -1;
+    ip = f->ip;
+  }
+  if(prot & PROT_READ)
+    perm |= PTE_R;
+  if(prot & PROT_WRITE)
+    perm |= PTE_W;
+  if(prot & PROT_EXEC)
+    perm |= PTE_X;
+  return mmap(len, perm, (flags & MAP_SHARED) ? VMA_SHARED : 0, ip, off);
+}
+
+uint64
+sys_munmap(void)
+{
+  uint64 addr, len;
+
+  argaddr(0, &addr);
+  argaddr(1, &len);
+  return munmap(addr, len);
+}
+
+// poll(fds, n, timeout): timeout in ticks, negative for none.
+uint64
+sys_poll(void)
+{
+  struct pollfd fds[NPOLL];
+  uint64 addr;
+  int n, timeout, r;
+  struct proc *p = myproc();
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  argint(2, &timeout);
+  if(n < 0 || n > NPOLL)
+    return -1;
+  if(copyin(p->pagetable, (char*)fds, addr, n * sizeof(fds[0])) < 0)
+    return -1;
+  if((r = poll(fds, n, timeout)) < 0)
+    return -1;
+  if(copyout(p->pagetable, addr, (char*)fds, n * sizeof(fds[0])) < 0)
+    return -1;
+  return r;
 }
 
 uint64
@@ -488,18 +695,27 @@ sys_pipe(void)
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
     if(fd0 >= 0)
-      p->ofile[fd0] = 0;
+      fdfree(p, fd0);
     fileclose(rf);
     fileclose(wf);
     return -1;
   }
   if(copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
      copyout(p->pagetable, fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
-    p->ofile[fd0] = 0;
-    p->ofile[fd1] = 0;
+    fdfree(p, fd0);
+    fdfree(p, fd1);
     fileclose(rf);
     fileclose(wf);
     return -1;
   }
   return 0;
 }
+
+uint64
+sys_uring_enter(void)
+{
+  uint64 ring; // user pointer to struct uring
+
+  argaddr(0, &ring);
+  return uring_enter(ring);
+}
@@ -52,22 +52,11 @@ uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   argint(0, &n);
   if(n < 0)
     n = 0;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(killed(myproc())){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  return tsleep(n);
 }
 
 uint64
@@ -100,3 +89,174 @@ sys_wait_noblock(void)
   argaddr(0, &uva_status);
   return wait_noblock(uva_status);
 }
+
+// reap up to arg 1 exited children, storing (pid, status)
+// int pairs in the user array at arg 0.
+uint64
+sys_wait_batch(void)
+{
+  uint64 addr;
+  int n;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  return wait_batch(addr, n);
+}
+
+// copy per-CPU run queue statistics to the user array
+// of struct schedstat in arg 0, holding arg 1 entries.
+uint64
+sys_sched_stat(void)
+{
+  uint64 addr;
+  int n;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  return schedstat(addr, n);
+}
+
+uint64
+sys_setsid(void)
+{
+  return setsid();
+}
+
+// number of live processes in session arg 0,
+// or in the system if it is 0.
+uint64
+sys_nprocs(void)
+{
+  int sid;
+
+  argint(0, &sid);
+  return nprocs(sid);
+}
+
+// set the priority of process arg 0 (0 for the caller)
+// to arg 1.
+uint64
+sys_setpriority(void)
+{
+  int pid, prio;
+
+  argint(0, &pid);
+  argint(1, &prio);
+  return setpriority(pid, prio);
+}
+
+// set the limit on live processes to arg 0, if positive.
+// returns the old limit.
+uint64
+sys_setmaxproc(void)
+{
+  int n;
+
+  argint(0, &n);
+  return setmaxproc(n);
+}
+
+// put process arg 0 in process group arg 1.
+uint64
+sys_setpgid(void)
+{
+  int pid, pgid;
+
+  argint(0, &pid);
+  argint(1, &pgid);
+  return setpgid(pid, pgid);
+}
+
+// kill every process in process group arg 0.
+uint64
+sys_killpg(void)
+{
+  int pgid;
+
+  argint(0, &pgid);
+  return killpg(pgid);
+}
+
+// copy physical memory allocator statistics to the
+// user struct memstat at arg 0.
+uint64
+sys_memstat(void)
+{
+  uint64 addr;
+
+  argaddr(0, &addr);
+  return memstat(addr);
+}
+
+// copy per-lock-name statistics to the user array of
+// struct lockstat in arg 0, holding arg 1 entries.
+uint64
+sys_lockstat(void)
+{
+  uint64 addr;
+  int n;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  return lockstat(addr, n);
+}
+
+// turn the sampling profiler on if arg 0 is non-zero,
+// else off.
+uint64
+sys_profile(void)
+{
+  int on;
+
+  argint(0, &on);
+  return profile(on);
+}
+
+// move profiling samples to the user array of
+// struct profsample in arg 0, holding arg 1 entries.
+uint64
+sys_profread(void)
+{
+  uint64 addr;
+  int n;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  return profread(addr, n);
+}
+
+// copy the resource usage of arg 0 (RUSAGE_SELF,
+// RUSAGE_CHILDREN or a pid) to the struct rusage in arg 1.
+uint64
+sys_getrusage(void)
+{
+  int who;
+  uint64 addr;
+
+  argint(0, &who);
+  argaddr(1, &addr);
+  return getrusage(who, addr);
+}
+
+// record the trace event types in the mask in arg 0.
+uint64
+sys_trace(void)
+{
+  int mask;
+
+  argint(0, &mask);
+  return trace(mask);
+}
+
+// move trace events to the user array of
+// struct traceevent in arg 0, holding arg 1 entries.
+uint64
+sys_traceread(void)
+{
+  uint64 addr;
+  int n;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  return traceread(addr, n);
+}
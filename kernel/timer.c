@@ -0,0 +1,188 @@
+// Timer wheel for sleeping processes.
+//
+// A process sleeping for some ticks puts a timer, on its own
+// kernel stack, into the wheel slot for its deadline, and
+// sleeps on that timer. Each clock tick looks only at the one
+// slot whose turn it is and wakes the timers there that are
+// due, rather than every sleeper in the system. Timers more
+// than NTWHEEL ticks out stay in their slot for more turns.
+//
+// tickslock protects the wheel, as it protects ticks.
+//
+// ticks follows the time register rather than counting
+// interrupts: any CPU taking a timer interrupt advances it
+// past every tick period that has elapsed. So a CPU with
+// nothing to run can sleep until the next timer is due
+// (timeridle()) instead of waking for every tick.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "proc.h"
+#include "vdso.h"
+#include "timer.h"
+#include "defs.h"
+
+#define NTWHEEL 64     // slots; a power of two
+
+static struct timer *wheel[NTWHEEL];
+static uint64 nexttick;  // time of the next tick
+
+// has tick a reached tick b? copes with wrap-around.
+#define reached(a, b) ((int)((a) - (b)) >= 0)
+
+static void
+tadd(struct timer *t)
+{
+  struct timer **slot = &wheel[t->deadline % NTWHEEL];
+
+  t->next = *slot;
+  if(t->next)
+    t->next->pprev = &t->next;
+  t->pprev = slot;
+  *slot = t;
+}
+
+static void
+tdel(struct timer *t)
+{
+  if(t->pprev == 0)
+    return;
+  *t->pprev = t->next;
+  if(t->next)
+    t->next->pprev = t->pprev;
+  t->next = 0;
+  t->pprev = 0;
+}
+
+// Sleep for n ticks. Returns 0, or -1 if the process
+// was killed first.
+int
+tsleep(uint n)
+{
+  struct timer t;
+
+  acquire(&tickslock);
+  t.deadline = ticks + n;
+  t.pprev = 0;
+  t.fn = 0;
+  while(!reached(ticks, t.deadline)){
+    if(killed(myproc())){
+      tdel(&t);
+      release(&tickslock);
+      return -1;
+    }
+    if(t.pprev == 0)
+      tadd(&t);
+    sleep(&t, &tickslock);
+  }
+  tdel(&t);
+  release(&tickslock);
+  return 0;
+}
+
+// Call fn(arg) from the clock interrupt n ticks from now,
+// with tickslock held, unless tcancel(t) comes first.
+void
+tstart(struct timer *t, uint n, void (*fn)(void*), void *arg)
+{
+  acquire(&tickslock);
+  t->deadline = ticks + (n ? n : 1);
+  t->fn = fn;
+  t->arg = arg;
+  tadd(t);
+  release(&tickslock);
+}
+
+void
+tcancel(struct timer *t)
+{
+  acquire(&tickslock);
+  tdel(t);
+  release(&tickslock);
+}
+
+// Wake the timers that are due at this tick.
+// Called with tickslock held.
+static void
+timertick(void)
+{
+  struct timer *t, *next;
+
+  for(t = wheel[ticks % NTWHEEL]; t; t = next){
+    next = t->next;
+    if(reached(ticks, t->deadline)){
+      tdel(t);
+      if(t->fn)
+        t->fn(t->arg);
+      else
+        wakeup(t);
+    }
+  }
+}
+
+// The clock page, mapped read-only at VDSO in every process,
+// so that user code can turn the time register, which it may
+// read itself (see timerinit()), into seconds without a
+// system call. A whole page, so that nothing else shows.
+char vdsopage[PGSIZE] __attribute__((aligned(PGSIZE)));
+
+void
+vdsoinit(void)
+{
+  struct vdso *v = (struct vdso*)vdsopage;
+
+  v->freq = TIMEFREQ;
+  v->tickcycles = TICKCYCLES;
+  v->boottime = r_time();
+}
+
+// Advance ticks to the current time, waking due timers.
+// Returns the time of the next tick.
+// Called by clockintr().
+uint64
+clocktick(void)
+{
+  uint64 now = r_time(), next;
+
+  acquire(&tickslock);
+  if(nexttick == 0)
+    nexttick = now;
+  while(now >= nexttick){
+    ticks++;
+    timertick();
+    nexttick += TICKCYCLES;
+  }
+  next = nexttick;
+  release(&tickslock);
+  return next;
+}
+
+// Return the time at which an idle CPU should next wake:
+// when the earliest timer is due, but at most IDLEMAX ticks
+// from now, so that it still looks for work to steal.
+uint64
+timeridle(void)
+{
+  struct timer *t;
+  uint next;
+  uint64 at;
+
+  acquire(&tickslock);
+  next = ticks + IDLEMAX;
+  for(int i = 0; i < NTWHEEL; i++){
+    for(t = wheel[i]; t; t = t->next){
+      if(!reached(t->deadline, next))
+        next = t->deadline;
+    }
+  }
+  if(!reached(next, ticks + 1))
+    next = ticks + 1;
+  if(nexttick == 0)
+    at = r_time() + TICKCYCLES;
+  else
+    at = nexttick + (uint64)(next - ticks - 1) * TICKCYCLES;
+  release(&tickslock);
+  return at;
+}
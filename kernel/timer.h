@@ -0,0 +1,8 @@
+// A timer in the wheel; see timer.c.
+struct timer {
+  uint deadline;       // tick at which to wake
+  struct timer *next;  // wheel slot list
+  struct timer **pprev;
+  void (*fn)(void*);   // called at the deadline, or 0 to wakeup(t)
+  void *arg;
+};
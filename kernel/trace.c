@@ -0,0 +1,120 @@
+// Event tracing.
+//
+// Tracepoints in the syscall path, the scheduler, sleep and
+// wakeup, the disk driver and the log call TRACE(), which
+// costs one load and branch unless trace() has enabled that
+// event type. Enabled events go into a ring per CPU, so
+// CPUs don't contend; traceread() drains them, and a full
+// ring drops new events and reports how many as TR_LOST.
+// The process that turned tracing on isn't traced, so a tool
+// printing the events doesn't fill the rings with its own.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "trace.h"
+#include "defs.h"
+
+#define NTRACEEVENT 512
+
+struct tracering {
+  struct spinlock lock;
+  struct traceevent e[NTRACEEVENT];
+  uint head;       // next event to read
+  uint tail;       // next slot to fill
+  uint64 ndrop;    // events lost to a full ring
+} tracering[NCPU];
+
+int tracemask;
+int tracepid;      // the tracer, whose events are skipped
+
+void
+traceinit(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    initlock(&tracering[i].lock, "trace");
+}
+
+// Record an event on this CPU's ring. Called through
+// TRACE(), from any context, holding any locks.
+void
+tracerec(int type, uint64 a, uint64 b)
+{
+  struct tracering *r;
+  struct traceevent *e;
+  struct proc *p;
+
+  push_off();
+  r = &tracering[cpuid()];
+  p = mycpu()->proc;
+  if(p && p->pid == tracepid){
+    pop_off();
+    return;
+  }
+  acquire(&r->lock);
+  if(r->tail - r->head == NTRACEEVENT){
+    r->ndrop++;
+  } else {
+    e = &r->e[r->tail++ % NTRACEEVENT];
+    e->time = r_time();
+    e->a = a;
+    e->b = b;
+    e->pid = p ? p->pid : 0;
+    e->cpu = cpuid();
+    e->type = type;
+  }
+  release(&r->lock);
+  pop_off();
+}
+
+// Record the event types in mask from now on, except
+// the caller's own. Returns the old mask.
+int
+trace(int mask)
+{
+  int old = tracemask;
+
+  tracepid = myproc()->pid;
+  tracemask = mask & TRACEALL;
+  return old;
+}
+
+// Move up to n events from the rings to the user array of
+// struct traceevent at addr, CPU by CPU. Returns the number
+// moved, or -1 on a bad address.
+int
+traceread(uint64 addr, int n)
+{
+  struct traceevent e;
+  int got = 0;
+
+  for(int i = 0; i < NCPU && got < n; i++){
+    struct tracering *r = &tracering[i];
+    while(got < n){
+      acquire(&r->lock);
+      if(r->head != r->tail){
+        e = r->e[r->head++ % NTRACEEVENT];
+      } else if(r->ndrop){
+        // the dropped events came after everything in the ring.
+        e.time = r_time();
+        e.a = r->ndrop;
+        e.b = 0;
+        e.pid = 0;
+        e.cpu = i;
+        e.type = TR_LOST;
+        r->ndrop = 0;
+      } else {
+        release(&r->lock);
+        break;
+      }
+      release(&r->lock);
+      if(copyout(myproc()->pagetable, addr + got*sizeof(e), (char*)&e, sizeof(e)) < 0)
+        return -1;
+      got++;
+    }
+  }
+  return got;
+}
@@ -0,0 +1,23 @@
+// Kernel trace events, returned by traceread().
+// trace(mask) records the types whose bit (1 << type) is set.
+#define TR_SYSENTER  0  // a = syscall number, b = first argument
+#define TR_SYSEXIT   1  // a = syscall number, b = return value
+#define TR_SWTCH     2  // a = pid switched to, b = its priority
+#define TR_SLEEP     3  // a = channel
+#define TR_WAKEUP    4  // a = channel, b = pid made runnable
+#define TR_DISKSUB   5  // a = block number, b = 1 if a write
+#define TR_DISKDONE  6  // a = block number
+#define TR_COMMIT    7  // a = blocks committed, b = cycles it took
+#define NTRACE       8
+#define TR_LOST      NTRACE  // a = events this CPU dropped
+
+#define TRACEALL ((1 << NTRACE) - 1)
+
+struct traceevent {
+  uint64 time;     // r_time() when recorded
+  uint64 a;
+  uint64 b;
+  int pid;         // running process, or 0 on the scheduler
+  short cpu;
+  short type;      // TR_*
+};
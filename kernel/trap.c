@@ -67,6 +67,10 @@ usertrap(void)
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
+  } else if((r_scause() == 12 || r_scause() == 13 || r_scause() == 15) &&
+            uvmfault(p, r_stval(), r_scause() == 15) == 0){
+    // lazy, demand-paged or copy-on-write page; now mapped.
+    p->nfault++;
   } else {
     printf("usertrap(): unexpected scause 0x%lx pid=%d\n", r_scause(), p->pid);
     printf("            sepc=0x%lx stval=0x%lx\n", r_sepc(), r_stval());
@@ -76,9 +80,12 @@ usertrap(void)
   if(killed(p))
     exit(-1);
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
+  // charge the tick to user time and give up the CPU
+  // if this is a timer interrupt.
+  if(which_dev == 2){
+    p->utime++;
     yield();
+  }
 
   usertrapret();
 }
@@ -119,8 +126,9 @@ usertrapret(void)
   // set S Exception Program Counter to the saved user pc.
   w_sepc(p->trapframe->epc);
 
-  // tell trampoline.S the user page table to switch to.
-  uint64 satp = MAKE_SATP(p->pagetable);
+  // tell trampoline.S the user page table to switch to,
+  // and the address space ID that tags its TLB entries.
+  uint64 satp = MAKE_SATP(p->pagetable) | SATP_ASID(asidswitch(p));
 
   // jump to userret in trampoline.S at the top of memory, which 
   // switches to the user page table, restores user registers,
@@ -150,9 +158,12 @@ kerneltrap()
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0)
+  // charge the tick to system time and give up the CPU
+  // if this is a timer interrupt.
+  if(which_dev == 2 && myproc() != 0){
+    myproc()->stime++;
     yield();
+  }
 
   // the yield() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
@@ -163,17 +174,11 @@ kerneltrap()
 void
 clockintr()
 {
-  if(cpuid() == 0){
-    acquire(&tickslock);
-    ticks++;
-    wakeup(&ticks);
-    release(&tickslock);
-  }
-
+  // advance ticks, on whichever CPU gets here first, and
   // ask for the next timer interrupt. this also clears
-  // the interrupt request. 1000000 is about a tenth
-  // of a second.
-  w_stimecmp(r_time() + 1000000);
+  // the interrupt request.
+  w_stimecmp(clocktick());
+  virtio_disk_tick();
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -209,6 +214,8 @@ devintr()
     return 1;
   } else if(scause == 0x8000000000000005L){
     // timer interrupt.
+    if(profon)
+      profsample(r_sepc(), (r_sstatus() & SSTATUS_SPP) == 0);
     clockintr();
     return 2;
   } else {
@@ -38,12 +38,17 @@
 #define ReadReg(reg) (*(Reg(reg)))
 #define WriteReg(reg, v) (*(Reg(reg)) = (v))
 
-// the transmit output buffer.
+// the transmit output buffer. writers that find it full
+// sleep until it drains to UART_TX_LOWAT, rather than being
+// woken as each byte goes out.
 struct spinlock uart_tx_lock;
-#define UART_TX_BUF_SIZE 32
+#define UART_TX_BUF_SIZE 2048
+#define UART_TX_LOWAT (UART_TX_BUF_SIZE / 4)
+#define UART_FIFO_SIZE 16     // THR bytes we can give an idle UART
 char uart_tx_buf[UART_TX_BUF_SIZE];
 uint64 uart_tx_w; // write next to uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE]
 uint64 uart_tx_r; // read next from uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]
+int uart_tx_waiting; // is a writer sleeping on uart_tx_r?
 
 extern volatile int panicked; // from printf.c
 
@@ -77,14 +82,14 @@ uartinit(void)
   initlock(&uart_tx_lock, "uart");
 }
 
-// add a character to the output buffer and tell the
+// add n characters to the output buffer and tell the
 // UART to start sending if it isn't already.
-// blocks if the output buffer is full.
+// blocks while the output buffer is full.
 // because it may block, it can't be called
 // from interrupts; it's only suitable for use
 // by write().
 void
-uartputc(int c)
+uartwrite(char *s, int n)
 {
   acquire(&uart_tx_lock);
 
@@ -92,19 +97,31 @@ uartputc(int c)
     for(;;)
       ;
   }
-  while(uart_tx_w == uart_tx_r + UART_TX_BUF_SIZE){
-    // buffer is full.
-    // wait for uartstart() to open up space in the buffer.
-    sleep(&uart_tx_r, &uart_tx_lock);
+  while(n > 0){
+    while(uart_tx_w == uart_tx_r + UART_TX_BUF_SIZE){
+      // buffer is full.
+      // wait for uartstart() to open up space in the buffer.
+      uart_tx_waiting = 1;
+      sleep(&uart_tx_r, &uart_tx_lock);
+    }
+    // copy as much as fits before the free space wraps.
+    int i = uart_tx_w % UART_TX_BUF_SIZE;
+    int m = UART_TX_BUF_SIZE - (uart_tx_w - uart_tx_r);
+    if(m > UART_TX_BUF_SIZE - i)
+      m = UART_TX_BUF_SIZE - i;
+    if(m > n)
+      m = n;
+    memmove(&uart_tx_buf[i], s, m);
+    uart_tx_w += m;
+    s += m;
+    n -= m;
+    uartstart();
   }
-  uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE] = c;
-  uart_tx_w += 1;
-  uartstart();
   release(&uart_tx_lock);
 }
 
 
-// alternate version of uartputc() that doesn't 
+// alternate version of uartwrite() that doesn't
 // use interrupts, for use by kernel printf() and
 // to echo characters. it spins waiting for the uart's
 // output register to be empty.
@@ -126,8 +143,8 @@ uartputc_sync(int c)
   pop_off();
 }
 
-// if the UART is idle, and a character is waiting
-// in the transmit buffer, send it.
+// if the UART is idle, and characters are waiting
+// in the transmit buffer, refill its FIFO.
 // caller must hold uart_tx_lock.
 // called from both the top- and bottom-half.
 void
@@ -137,23 +154,27 @@ uartstart()
     if(uart_tx_w == uart_tx_r){
       // transmit buffer is empty.
       ReadReg(ISR);
-      return;
+      break;
     }
     
     if((ReadReg(LSR) & LSR_TX_IDLE) == 0){
       // the UART transmit holding register is full,
       // so we cannot give it another byte.
       // it will interrupt when it's ready for a new byte.
-      return;
+      break;
     }
     
-    int c = uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE];
-    uart_tx_r += 1;
-    
-    // maybe uartputc() is waiting for space in the buffer.
+    // the FIFO is empty; fill it.
+    for(int i = 0; i < UART_FIFO_SIZE && uart_tx_r != uart_tx_w; i++){
+      WriteReg(THR, uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]);
+      uart_tx_r += 1;
+    }
+  }
+
+  // maybe uartwrite() is waiting for space in the buffer.
+  if(uart_tx_waiting && uart_tx_w - uart_tx_r <= UART_TX_LOWAT){
+    uart_tx_waiting = 0;
     wakeup(&uart_tx_r);
-    
-    WriteReg(THR, c);
   }
 }
 
@@ -0,0 +1,7 @@
+// Buffers for readv() and writev().
+#define IOV_MAX 16        // most buffers in one call
+
+struct iovec {
+  void *iov_base;         // user address
+  uint64 iov_len;         // bytes
+};
@@ -0,0 +1,82 @@
+//
+// Batched system calls through rings in user memory.
+// uring_enter() runs every queued submission in order,
+// as if the process had made each call itself, and posts
+// the results, all in one trip through the kernel.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "uring.h"
+
+static int
+uring_op(struct uring_sqe *e)
+{
+  struct proc *p = myproc();
+  struct file *f = 0;
+
+  if(e->op == URING_READ || e->op == URING_WRITE){
+    if(e->fd < 0 || e->fd >= NOFILE || (f = p->ofile[e->fd]) == 0)
+      return -1;
+  }
+  switch(e->op){
+  case URING_NOP:
+    return 0;
+  case URING_READ:
+    return fileread(f, e->addr, e->n);
+  case URING_WRITE:
+    return filewrite(f, e->addr, e->n);
+  case URING_WAIT:
+    return wait_noblock(e->addr);
+  case URING_SLEEP:
+    return tsleep(e->n < 0 ? 0 : e->n);
+  }
+  return -1;
+}
+
+// Run the submissions queued in the struct uring at user
+// address addr, stopping early if the completion ring fills
+// or the process is killed. Returns the number run, or -1
+// if the ring is bad.
+int
+uring_enter(uint64 addr)
+{
+  struct proc *p = myproc();
+  struct uring *r = (struct uring *)addr;  // user address
+  struct uring_sqe e;
+  struct uring_cqe c;
+  uint idx[4];  // sqhead, sqtail, cqhead, cqtail
+  int n = 0;
+
+  if(copyin(p->pagetable, (char *)idx, addr, sizeof(idx)) < 0)
+    return -1;
+  if(idx[1] - idx[0] > NSQE || idx[3] - idx[2] > NCQE)
+    return -1;
+
+  while(idx[0] != idx[1] && idx[3] - idx[2] < NCQE && !killed(p)){
+    if(copyin(p->pagetable, (char *)&e, (uint64)&r->sq[idx[0] % NSQE],
+              sizeof(e)) < 0)
+      return -1;
+    c.data = e.data;
+    c.res = uring_op(&e);
+    c.pad = 0;
+    if(copyout(p->pagetable, (uint64)&r->cq[idx[3] % NCQE], (char *)&c,
+               sizeof(c)) < 0)
+      return -1;
+    idx[0]++;
+    idx[3]++;
+    n++;
+  }
+
+  if(copyout(p->pagetable, (uint64)&r->sqhead, (char *)&idx[0], sizeof(uint)) < 0 ||
+     copyout(p->pagetable, (uint64)&r->cqtail, (char *)&idx[3], sizeof(uint)) < 0)
+    return -1;
+  return n;
+}
@@ -0,0 +1,39 @@
+// Submission and completion rings for uring_enter(), which
+// runs a batch of system calls for the price of one trap.
+// The process fills sq[sqtail % NSQE] and bumps sqtail; the
+// kernel consumes entries from sqhead and posts one result
+// per entry at cq[cqtail % NCQE]. The process consumes
+// results from cqhead.
+#define NSQE 32
+#define NCQE 64
+
+// Operations.
+#define URING_NOP    0  // res = 0
+#define URING_READ   1  // read(fd, addr, n)
+#define URING_WRITE  2  // write(fd, addr, n)
+#define URING_WAIT   3  // wait_noblock((int*)addr)
+#define URING_SLEEP  4  // sleep(n)
+
+struct uring_sqe {
+  int op;          // URING_*
+  int fd;
+  uint64 addr;
+  int n;
+  int pad;
+  uint64 data;     // copied to the completion
+};
+
+struct uring_cqe {
+  uint64 data;     // from the submission
+  int res;         // what the system call returned
+  int pad;
+};
+
+struct uring {
+  uint sqhead;     // next submission; written by the kernel
+  uint sqtail;     // next free submission slot
+  uint cqhead;     // next completion to consume
+  uint cqtail;     // next completion; written by the kernel
+  struct uring_sqe sq[NSQE];
+  struct uring_cqe cq[NCQE];
+};
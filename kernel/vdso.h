@@ -0,0 +1,6 @@
+// The clock page at VDSO; see timer.c.
+struct vdso {
+  uint64 freq;            // time register cycles per second
+  uint64 tickcycles;      // cycles per uptime() tick
+  uint64 boottime;        // time register when the kernel booted
+};
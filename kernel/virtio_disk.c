@@ -15,6 +15,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "trace.h"
 
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
@@ -40,16 +41,23 @@ static struct disk {
 
   // our own book-keeping.
   char free[NUM];  // is a descriptor free?
+  int nfree;       // how many are
   uint16 used_idx; // we've looked this far in used[2..NUM].
 
   // track info about in-flight operations,
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
   struct {
-    struct buf *b;
+    struct buf *b; // first of the request's bufs, linked by qnext
     char status;
   } info[NUM];
 
+  // requests not yet started; see dispatch().
+  struct buf *queue;  // sorted by blockno, linked by qnext
+  uint qtick;         // when the queue last became non-empty
+  uint nextblock;     // block after the last request started
+  int inflight;       // requests the device has
+
   // disk command headers.
   // one-for-one with descriptors, for convenience.
   struct virtio_blk_req ops[NUM];
@@ -118,14 +126,11 @@ virtio_disk_init(void)
     panic("virtio disk max queue too short");
 
   // allocate and zero queue memory.
-  disk.desc = kalloc();
-  disk.avail = kalloc();
-  disk.used = kalloc();
+  disk.desc = kzalloc();
+  disk.avail = kzalloc();
+  disk.used = kzalloc();
   if(!disk.desc || !disk.avail || !disk.used)
     panic("virtio disk kalloc");
-  memset(disk.desc, 0, PGSIZE);
-  memset(disk.avail, 0, PGSIZE);
-  memset(disk.used, 0, PGSIZE);
 
   // set queue size.
   *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
@@ -144,6 +149,7 @@ virtio_disk_init(void)
   // all NUM descriptors start out unused.
   for(int i = 0; i < NUM; i++)
     disk.free[i] = 1;
+  disk.nfree = NUM;
 
   // tell device we're completely ready.
   status |= VIRTIO_CONFIG_S_DRIVER_OK;
@@ -159,10 +165,11 @@ alloc_desc()
   for(int i = 0; i < NUM; i++){
     if(disk.free[i]){
       disk.free[i] = 0;
+      disk.nfree--;
       return i;
     }
   }
-  return -1;
+  panic("alloc_desc");
 }
 
 // mark a descriptor as free.
@@ -178,7 +185,7 @@ free_desc(int i)
   disk.desc[i].flags = 0;
   disk.desc[i].next = 0;
   disk.free[i] = 1;
-  wakeup(&disk.free[0]);
+  disk.nfree++;
 }
 
 // free a chain of descriptors.
@@ -196,104 +203,203 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
-static int
-alloc3_desc(int *idx)
-{
-  for(int i = 0; i < 3; i++){
-    idx[i] = alloc_desc();
-    if(idx[i] < 0){
-      for(int j = 0; j < i; j++)
-        free_desc(idx[j]);
-      return -1;
-    }
-  }
-  return 0;
-}
-
-void
-virtio_disk_rw(struct buf *b, int write)
+// format one request for the n bufs linked from b by qnext,
+// which hold consecutive blocks, and put it on the avail ring.
+// doesn't notify the device. needs n+2 free descriptors.
+static void
+submit(struct buf *b, int n, int write)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
-
-  acquire(&disk.vdisk_lock);
+  int head, d, prev;
+  struct buf *x;
 
   // the spec's Section 5.2 says that legacy block operations use
-  // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
-
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
-  }
+  // a descriptor for type/reserved/sector, then the data, then
+  // one for a 1-byte status result. the data may span any
+  // number of descriptors, a buf each here.
 
-  // format the three descriptors.
+  // format the descriptors.
   // qemu's virtio-blk.c reads them.
 
-  struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
+  head = alloc_desc();
+  struct virtio_blk_req *buf0 = &disk.ops[head];
 
   if(write)
     buf0->type = VIRTIO_BLK_T_OUT; // write the disk
   else
     buf0->type = VIRTIO_BLK_T_IN; // read the disk
   buf0->reserved = 0;
-  buf0->sector = sector;
-
-  disk.desc[idx[0]].addr = (uint64) buf0;
-  disk.desc[idx[0]].len = sizeof(struct virtio_blk_req);
-  disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-  disk.desc[idx[0]].next = idx[1];
-
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  buf0->sector = b->blockno * (BSIZE / 512);
+
+  disk.desc[head].addr = (uint64) buf0;
+  disk.desc[head].len = sizeof(struct virtio_blk_req);
+  disk.desc[head].flags = VRING_DESC_F_NEXT;
+
+  prev = head;
+  for(x = b; n-- > 0; x = x->qnext){
+    d = alloc_desc();
+    disk.desc[prev].next = d;
+    disk.desc[d].addr = (uint64) x->data;
+    disk.desc[d].len = BSIZE;
+    if(write)
+      disk.desc[d].flags = 0; // device reads x->data
+    else
+      disk.desc[d].flags = VRING_DESC_F_WRITE; // device writes x->data
+    disk.desc[d].flags |= VRING_DESC_F_NEXT;
+    TRACE(TR_DISKSUB, x->blockno, write);
+    x->disk = 1;
+    prev = d;
+  }
 
-  disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+  d = alloc_desc();
+  disk.desc[prev].next = d;
+  disk.info[head].status = 0xff; // device writes 0 on success
+  disk.desc[d].addr = (uint64) &disk.info[head].status;
+  disk.desc[d].len = 1;
+  disk.desc[d].flags = VRING_DESC_F_WRITE; // device writes the status
+  disk.desc[d].next = 0;
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  // record the bufs for virtio_disk_intr().
+  disk.info[head].b = b;
 
   // tell the device the first index in our chain of descriptors.
-  disk.avail->ring[disk.avail->idx % NUM] = idx[0];
+  disk.avail->ring[disk.avail->idx % NUM] = head;
 
   __sync_synchronize();
 
   // tell the device another avail ring entry is available.
   disk.avail->idx += 1; // not % NUM ...
+}
 
-  __sync_synchronize();
+// Requests wait in disk.queue, sorted by block number, until
+// the device has room for them: fewer than DISKQDEPTH requests
+// in flight. Each time, dispatch() starts the queued buf at or
+// after the block where the last request ended, or failing
+// that the lowest one (a one-way elevator), merged with up to
+// DISKMERGE-1 bufs after it that hold the next blocks and go
+// the same way. So a log commit's run of blocks goes out as a
+// few requests, not one per block.
+//
+// With DISKDELAY > 0, a request that finds the device idle
+// waits up to that many ticks for others to merge with;
+// virtio_disk_tick() lets it go.
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+// add b to the queue, in block order.
+// caller holds disk.vdisk_lock.
+static void
+enqueue(struct buf *b, int write, int *pending)
+{
+  struct buf **pp;
+
+  if(disk.queue == 0)
+    disk.qtick = ticks;
+  b->qwrite = write;
+  b->qpending = pending;
+  for(pp = &disk.queue; *pp && (*pp)->blockno < b->blockno; pp = &(*pp)->qnext)
+    ;
+  b->qnext = *pp;
+  *pp = b;
+}
 
-  // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
+// start queued requests while the device has room, ringing
+// the doorbell once. caller holds disk.vdisk_lock.
+static void
+dispatch(void)
+{
+  struct buf **pp, *b, *x;
+  int n, max, started = 0;
+
+  while(disk.queue && disk.inflight < DISKQDEPTH){
+    max = disk.nfree - 2;
+    if(max > DISKMERGE)
+      max = DISKMERGE;
+    if(max < 1)
+      break;
+    for(pp = &disk.queue; *pp && (*pp)->blockno < disk.nextblock; pp = &(*pp)->qnext)
+      ;
+    if(*pp == 0)
+      pp = &disk.queue;
+    b = x = *pp;
+    for(n = 1; n < max && x->qnext && x->qnext->blockno == x->blockno + 1 &&
+          x->qnext->qwrite == b->qwrite; n++)
+      x = x->qnext;
+    *pp = x->qnext;
+    x->qnext = 0;
+    submit(b, n, b->qwrite);
+    disk.nextblock = b->blockno + n;
+    disk.inflight++;
+    started = 1;
   }
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+  if(started){
+    __sync_synchronize();
+    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+  }
+}
+
+// queue n bufs and start them, unless they wait for company.
+// caller holds disk.vdisk_lock.
+static void
+queue(struct buf **bufs, int n, int write, int *pending)
+{
+  for(int i = 0; i < n; i++)
+    enqueue(bufs[i], write, pending);
+  if(DISKDELAY == 0 || disk.inflight > 0)
+    dispatch();
+}
+
+// read or write n bufs as one batch and wait until all of
+// them are done. virtio_disk_intr() retires each buf and
+// wakes us only when the last one of the batch finishes.
+void
+virtio_disk_rwv(struct buf **bufs, int n, int write)
+{
+  int pending = n;
+
+  acquire(&disk.vdisk_lock);
+  queue(bufs, n, write, &pending);
+
+  // Wait for virtio_disk_intr() to say the batch has finished.
+  while(pending > 0)
+    sleep(&pending, &disk.vdisk_lock);
+
+  release(&disk.vdisk_lock);
+}
+
+// start reading n locked bufs and return without waiting.
+// virtio_disk_intr() hands each one to bdone() when it arrives.
+void
+virtio_disk_read_async(struct buf **bufs, int n)
+{
+  acquire(&disk.vdisk_lock);
+  queue(bufs, n, 0, 0);
+  release(&disk.vdisk_lock);
+}
+
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  virtio_disk_rwv(&b, 1, write);
+}
 
+// Called on each clock tick: start requests that have
+// waited DISKDELAY ticks for the idle device.
+void
+virtio_disk_tick(void)
+{
+  if(DISKDELAY == 0 || disk.queue == 0)
+    return;
+  acquire(&disk.vdisk_lock);
+  if(disk.queue && disk.inflight == 0 && ticks - disk.qtick >= DISKDELAY)
+    dispatch();
   release(&disk.vdisk_lock);
 }
 
 void
 virtio_disk_intr()
 {
+  struct buf *b, *next;
+  int *pending;
+
   acquire(&disk.vdisk_lock);
 
   // the device won't raise another interrupt until we tell it
@@ -316,12 +422,27 @@ virtio_disk_intr()
     if(disk.info[id].status != 0)
       panic("virtio_disk_intr status");
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    for(b = disk.info[id].b; b; b = next){
+      next = b->qnext;
+      pending = b->qpending;
+      b->qnext = 0;
+      b->qpending = 0;
+      b->disk = 0;   // disk is done with buf
+      TRACE(TR_DISKDONE, b->blockno, 0);
+      if(pending == 0)
+        bdone(b);
+      else if(--*pending == 0)
+        wakeup(pending);
+    }
+    disk.info[id].b = 0;
+    free_chain(id);
+    disk.inflight--;
 
     disk.used_idx += 1;
   }
 
+  // the device has room again.
+  dispatch();
+
   release(&disk.vdisk_lock);
 }
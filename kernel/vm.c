@@ -5,6 +5,10 @@
 #include "riscv.h"
 #include "defs.h"
 #include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "file.h"
 
 /*
  * the kernel's page table.
@@ -15,14 +19,30 @@ extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
 
+// Address space IDs. Each process's page table gets an ASID
+// to tag its TLB entries, so that switching satp between it
+// and the kernel's (ASID 0) needn't flush the TLB. ASIDs are
+// handed out in order, never reused within a generation;
+// when they run out a new generation starts, and each CPU
+// flushes its whole TLB before it next enters user space.
+// p->asid holds the generation above the ASID bits.
+static struct spinlock asidlock;
+static uint64 asidgen = MAXASID + 1;  // current generation
+static uint64 asidnext = 1;           // next ASID to hand out
+static uint64 asidmax;                // 0 if the hardware has none
+
+#define ASIDGEN(a) ((a) & ~MAXASID)
+
+static pte_t *walklevel(pagetable_t, uint64, int, int);
+static int uvmsplit(pte_t *);
+
 // Make a direct-map page table for the kernel.
 pagetable_t
 kvmmake(void)
 {
   pagetable_t kpgtbl;
 
-  kpgtbl = (pagetable_t) kalloc();
-  memset(kpgtbl, 0, PGSIZE);
+  kpgtbl = (pagetable_t) kzalloc();
 
   // uart registers
   kvmmap(kpgtbl, UART0, UART0, PGSIZE, PTE_R | PTE_W);
@@ -43,7 +63,7 @@ kvmmake(void)
   // the highest virtual address in the kernel.
   kvmmap(kpgtbl, TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
 
-  // allocate and map a kernel stack for each process.
+  // page-table pages for the kernel stacks, mapped on demand.
   proc_mapstacks(kpgtbl);
   
   return kpgtbl;
@@ -54,6 +74,7 @@ void
 kvminit(void)
 {
   kernel_pagetable = kvmmake();
+  initlock(&asidlock, "asid");
 }
 
 // Switch h/w page table register to the kernel's page table,
@@ -64,12 +85,71 @@ kvminithart()
   // wait for any previous writes to the page table memory to finish.
   sfence_vma();
 
+  // the ASID field keeps only the bits the hardware has.
+  w_satp(MAKE_SATP(kernel_pagetable) | SATP_ASID(MAXASID));
+  asidmax = SATP2ASID(r_satp());
   w_satp(MAKE_SATP(kernel_pagetable));
 
   // flush stale entries from the TLB.
   sfence_vma();
 }
 
+// Get p ready to enter user space on this CPU, interrupts
+// off: give it an ASID of the current generation, and flush
+// any of its TLB entries here that could be stale, those left
+// from before it last ran elsewhere. Returns its ASID.
+uint64
+asidswitch(struct proc *p)
+{
+  struct cpu *c = mycpu();
+  int id = cpuid();
+  uint64 gen;
+
+  if(asidmax == 0){
+    // one address space: flush it all, every time.
+    sfence_vma();
+    return 0;
+  }
+  gen = asidgen;
+  if(ASIDGEN(p->asid) != gen){
+    acquire(&asidlock);
+    if(asidnext > asidmax){
+      asidgen += MAXASID + 1;
+      asidnext = 1;
+    }
+    gen = asidgen;
+    p->asid = gen | asidnext++;
+    release(&asidlock);
+    p->asidcpu = id;  // a fresh ASID has no entries anywhere
+  }
+  if(c->asidgen != gen){
+    c->asidgen = gen;
+    sfence_vma();
+  } else if(p->asidcpu != id){
+    sfence_vma_asid(p->asid & MAXASID);
+  }
+  p->asidcpu = id;
+  return p->asid & MAXASID;
+}
+
+// Drop this CPU's TLB entries for va in pagetable's address
+// space, or for all of it if va is -1, after its PTEs change.
+// Only the current process's entries need go: the kernel
+// changes no other live page table, and entries a process
+// left on CPUs it ran on before go when it returns to them.
+void
+uvmflush(pagetable_t pagetable, uint64 va)
+{
+  struct proc *p = myproc();
+
+  if(asidmax == 0 || p == 0 || p->pagetable != pagetable)
+    return;
+  if(va == -1)
+    sfence_vma_asid(p->asid & MAXASID);
+  else
+    sfence_vma_page(va, p->asid & MAXASID);
+}
+
 // Return the address of the PTE in page table pagetable
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page-table pages.
@@ -82,24 +162,36 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
+//
+// If va lies in a megapage, returns the megapage's PTE,
+// which has PTE_MEGA set; see ptepa().
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
+{
+  return walklevel(pagetable, va, alloc, 0);
+}
+
+// Like walk(), but return the PTE at the given level, 1 to
+// map a megapage. Stops early at a leaf above that level.
+static pte_t *
+walklevel(pagetable_t pagetable, uint64 va, int alloc, int leaf)
 {
   if(va >= MAXVA)
     panic("walk");
 
-  for(int level = 2; level > 0; level--) {
+  for(int level = 2; level > leaf; level--) {
     pte_t *pte = &pagetable[PX(level, va)];
     if(*pte & PTE_V) {
+      if(PTE_LEAF(*pte))
+        return pte;
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      if(!alloc || (pagetable = (pde_t*)kzalloc()) == 0)
         return 0;
-      memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
-  return &pagetable[PX(0, va)];
+  return &pagetable[PX(leaf, va)];
 }
 
 // Look up a virtual address, return the physical address,
@@ -121,10 +213,20 @@ walkaddr(pagetable_t pagetable, uint64 va)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
-  pa = PTE2PA(*pte);
+  pa = ptepa(*pte, va);
   return pa;
 }
 
+// The physical address of the page containing va,
+// given the leaf PTE that maps it.
+uint64
+ptepa(pte_t pte, uint64 va)
+{
+  if(pte & PTE_MEGA)
+    return PTE2PA(pte) + (PGROUNDDOWN(va) & (MEGAPGSIZE - 1));
+  return PTE2PA(pte);
+}
+
 // add a mapping to the kernel page table.
 // only used when booting.
 // does not flush TLB or enable paging.
@@ -138,6 +240,9 @@ kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa.
 // va and size MUST be page-aligned.
+// Kernel (non-PTE_U) mappings use megapages wherever va, pa
+// and the remaining size allow, which keeps the kernel's direct
+// map to a few page-table pages and TLB entries.
 // Returns 0 on success, -1 if walk() couldn't
 // allocate a needed page-table page.
 int
@@ -158,6 +263,19 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
   a = va;
   last = va + size - PGSIZE;
   for(;;){
+    if((perm & PTE_U) == 0 && a % MEGAPGSIZE == 0 &&
+       pa % MEGAPGSIZE == 0 && last - a >= MEGAPGSIZE - PGSIZE){
+      if((pte = walklevel(pagetable, a, 1, 1)) == 0)
+        return -1;
+      if(*pte & PTE_V)
+        panic("mappages: remap");
+      *pte = PA2PTE(pa) | perm | PTE_MEGA | PTE_V;
+      if(last - a == MEGAPGSIZE - PGSIZE)
+        break;
+      a += MEGAPGSIZE;
+      pa += MEGAPGSIZE;
+      continue;
+    }
     if((pte = walk(pagetable, a, 1)) == 0)
       return -1;
     if(*pte & PTE_V)
@@ -171,8 +289,144 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
   return 0;
 }
 
+// Each process caches a few recent user translations in
+// p->tlb, so that copyin() and friends on the same pages
+// skip the page-table walk. Anything that removes a mapping
+// or takes away a permission must call utlbflush() first.
+void
+utlbflush(pagetable_t pagetable)
+{
+  struct proc *p = myproc();
+
+  if(p && p->pagetable == pagetable)
+    memset(p->tlb, 0, sizeof(p->tlb));
+}
+
+// The current process, if pagetable is its page table, for
+// use with utlblookup() and utlbfill(); otherwise 0.
+static struct proc*
+utlbproc(pagetable_t pagetable)
+{
+  struct proc *p = myproc();
+
+  if(p && p->pagetable == pagetable)
+    return p;
+  return 0;
+}
+
+// Return the cached physical page for user page va0 if its
+// PTE had all the flags in need, or 0.
+static uint64
+utlblookup(struct proc *p, uint64 va0, uint64 need)
+{
+  struct utlb *t;
+
+  if(p == 0)
+    return 0;
+  t = &p->tlb[(va0 / PGSIZE) % NUTLB];
+  if(t->flags && t->va == va0 && (t->flags & need) == need)
+    return t->pa;
+  return 0;
+}
+
+static void
+utlbfill(struct proc *p, uint64 va0, uint64 pa, uint64 flags)
+{
+  struct utlb *t;
+
+  if(p == 0)
+    return;
+  t = &p->tlb[(va0 / PGSIZE) % NUTLB];
+  t->va = va0;
+  t->pa = pa;
+  t->flags = flags;
+}
+
+// Map a megapage of user memory at va, which must be
+// 2MB-aligned. Returns -1 if part of the range is already
+// in use or a page-table page can't be allocated.
+static int
+mapmega(pagetable_t pagetable, uint64 va, uint64 pa, int perm)
+{
+  pte_t *pte;
+
+  if((pte = walklevel(pagetable, va, 1, 1)) == 0 || (*pte & PTE_V))
+    return -1;
+  *pte = PA2PTE(pa) | perm | PTE_MEGA | PTE_V;
+  return 0;
+}
+
+// Allocate a zeroed megapage and map it at va, if va starts
+// an aligned 2MB range none of which is mapped yet.
+// Returns 0 on success, -1 to fall back to ordinary pages.
+static int
+uvmallocmega(pagetable_t pagetable, uint64 va, int perm)
+{
+  pte_t *pte;
+  char *mem;
+
+  if(va % MEGAPGSIZE || va + MEGAPGSIZE > VDSO)
+    return -1;
+  // a stretch that already has a page-table page, such as
+  // the one holding text and data or a split megapage, keeps
+  // its ordinary pages: don't allocate and zero 2MB to find
+  // that out from mapmega().
+  if((pte = walklevel(pagetable, va, 0, 1)) != 0 && (*pte & PTE_V))
+    return -1;
+  if((mem = kalloc_order(MEGAORDER)) == 0)
+    return -1;
+  for(int i = 0; i < MEGAPGSIZE; i += PGSIZE)
+    pagezero(mem + i);
+  if(mapmega(pagetable, va, (uint64)mem, perm) != 0){
+    kfree_order(mem, MEGAORDER);
+    return -1;
+  }
+  return 0;
+}
+
+// Break the megapage mapped by *pte into ordinary PTEs for
+// the same memory, so that its pages can be unmapped or
+// shared one by one. Returns -1 if out of memory.
+static int
+uvmsplit(pte_t *pte)
+{
+  pagetable_t pt;
+  uint64 pa = PTE2PA(*pte);
+  int flags = PTE_FLAGS(*pte) & ~PTE_MEGA;
+
+  if((pt = (pagetable_t)kalloc()) == 0)
+    return -1;
+  for(int i = 0; i < 512; i++)
+    pt[i] = PA2PTE(pa + i*PGSIZE) | flags;
+  ksplit((void*)pa, MEGAORDER);
+  *pte = PA2PTE(pt) | PTE_V;
+  return 0;
+}
+
+// If va is inside a megapage but not at its start, split the
+// megapage, so that memory from va on can be unmapped.
+// Returns -1 if out of memory.
+int
+uvmsplitat(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+
+  if(va % MEGAPGSIZE == 0 || va >= MAXVA)
+    return 0;
+  pte = walk(pagetable, va, 0);
+  if(pte == 0 || (*pte & PTE_MEGA) == 0)
+    return 0;
+  utlbflush(pagetable);
+  if(uvmsplit(pte) < 0)
+    return -1;
+  uvmflush(pagetable, -1);
+  return 0;
+}
+
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
+// page-aligned. Pages of a lazily grown heap that were never
+// touched have no mapping and are skipped. A megapage must
+// lie wholly inside the range; see uvmsplitat().
 // Optionally free the physical memory.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
@@ -182,20 +436,34 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
+  utlbflush(pagetable);
 
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
-    if((*pte & PTE_V) == 0)
-      panic("uvmunmap: not mapped");
+    if((pte = walk(pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+      continue;
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
+    if(*pte & PTE_MEGA){
+      if(a % MEGAPGSIZE || a + MEGAPGSIZE > va + npages*PGSIZE)
+        panic("uvmunmap: part of a megapage");
+      if(do_free)
+        kfree_order((void*)PTE2PA(*pte), MEGAORDER);
+      *pte = 0;
+      if(npages <= UFLUSHPAGES)
+        uvmflush(pagetable, a);
+      a += MEGAPGSIZE - PGSIZE;
+      continue;
+    }
     if(do_free){
       uint64 pa = PTE2PA(*pte);
       kfree((void*)pa);
     }
     *pte = 0;
+    if(npages <= UFLUSHPAGES)
+      uvmflush(pagetable, a);
   }
+  if(npages > UFLUSHPAGES)
+    uvmflush(pagetable, -1);
 }
 
 // create an empty user page table.
@@ -204,10 +472,9 @@ pagetable_t
 uvmcreate()
 {
   pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable = (pagetable_t) kzalloc();
   if(pagetable == 0)
     return 0;
-  memset(pagetable, 0, PGSIZE);
   return pagetable;
 }
 
@@ -221,14 +488,14 @@ uvmfirst(pagetable_t pagetable, uchar *src, uint sz)
 
   if(sz >= PGSIZE)
     panic("uvmfirst: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kzalloc();
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U);
   memmove(mem, src, sz);
 }
 
 // Allocate PTEs and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
+// Aligned 2MB stretches get megapages when memory allows.
 uint64
 uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 {
@@ -240,12 +507,16 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    if(a % MEGAPGSIZE == 0 && a + MEGAPGSIZE <= newsz &&
+       uvmallocmega(pagetable, a, PTE_R|PTE_U|xperm) == 0){
+      a += MEGAPGSIZE - PGSIZE;
+      continue;
+    }
+    mem = kzalloc();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_R|PTE_U|xperm) != 0){
       kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
@@ -303,10 +574,12 @@ uvmfree(pagetable_t pagetable, uint64 sz)
   freewalk(pagetable);
 }
 
-// Given a parent process's page table, copy
-// its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// Given a parent process's page table, share
+// its memory with a child's page table.
+// Writable pages become read-only copy-on-write
+// pages in both; uvmcow() copies them on the
+// first store. The parent's megapages are split
+// first, so that their pages are shared one by one.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
@@ -315,30 +588,456 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   pte_t *pte;
   uint64 pa, i;
   uint flags;
-  char *mem;
 
+  utlbflush(old);
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+    if((pte = walk(old, i, 0)) == 0 || (*pte & PTE_V) == 0)
+      continue;  // not yet touched lazy page
+    if((*pte & PTE_MEGA) && uvmsplit(pte) != 0)
+      goto err;
+    pte = walk(old, i, 0);
+    if(*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
+    if(mappages(new, i, PGSIZE, pa, flags) != 0)
       goto err;
-    }
+    kref((void*)pa);
   }
+  uvmflush(old, -1);
   return 0;
 
  err:
+  uvmflush(old, -1);
   uvmunmap(new, 0, i / PGSIZE, 1);
   return -1;
 }
 
+// Give the process a private writable copy of the
+// copy-on-write page containing va.
+// Returns 0 on success, -1 if va is not a copy-on-write
+// page or memory is exhausted.
+int
+uvmcow(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  char *mem;
+
+  if(va >= MAXVA)
+    return -1;
+  pte = walk(pagetable, va, 0);
+  if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0 ||
+     (*pte & PTE_COW) == 0)
+    return -1;
+  pa = PTE2PA(*pte);
+  utlbflush(pagetable);
+  if(krefcount((void*)pa) == 1){
+    // no one else shares it any more.
+    *pte = (*pte & ~PTE_COW) | PTE_W;
+    uvmflush(pagetable, va);
+    return 0;
+  }
+  if((mem = kalloc()) == 0)
+    return -1;
+  pagecopy(mem, (char*)pa);
+  *pte = PA2PTE(mem) | ((PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W);
+  uvmflush(pagetable, va);
+  kfree((void*)pa);
+  return 0;
+}
+
+// Return p's vma containing va, or 0.
+static struct vma*
+findvma(struct proc *p, uint64 va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(VMAUSED(v) && va >= v->start && va < v->end)
+      return v;
+  }
+  return 0;
+}
+
+// Does any of p's vmas overlap [start, end)?
+static int
+vmaoverlap(struct proc *p, uint64 start, uint64 end)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(VMAUSED(v) && v->start < end && v->end > start)
+      return 1;
+  }
+  return 0;
+}
+
+// Handle a page fault at user address va in process p:
+// map a page of a vma from the page cache, map a zeroed page
+// at a lazily allocated heap address, or, for a store, copy
+// a copy-on-write page.
+// Returns 0 if the access can be retried, or -1 if the
+// fault is a real one or memory is exhausted.
+int
+uvmfault(struct proc *p, uint64 va, int write)
+{
+  pte_t *pte;
+  struct vma *v;
+  char *mem;
+  int perm;
+  uint64 a;
+
+  if(va >= MAXVA)
+    return -1;
+  pte = walk(p->pagetable, va, 0);
+  if(pte && (*pte & PTE_V)){
+    if(write && (*pte & PTE_COW))
+      return uvmcow(p->pagetable, va);
+    // the first store to a shared file page marks it dirty.
+    if(write && (v = findvma(p, va)) != 0 && (v->flags & VMA_SHARED) &&
+       (v->perm & PTE_W) && (*pte & PTE_W) == 0){
+      utlbflush(p->pagetable);
+      *pte |= PTE_W | PTE_D;
+      uvmflush(p->pagetable, va);
+      return 0;
+    }
+    return -1;
+  }
+
+  va = PGROUNDDOWN(va);
+  if((v = findvma(p, va)) != 0){
+    if(write && (v->perm & PTE_W) == 0)
+      return -1;
+    perm = v->perm;
+    if(v->ip == 0){
+      // private anonymous; shared ones are filled by mmap().
+      if((mem = kzalloc()) == 0)
+        return -1;
+    } else {
+      // reading the file would deadlock if this process
+      // is in the middle of writing it. writers fault their
+      // source in before they lock the inode, so this is
+      // only a backstop.
+      if(holdingsleep(&v->ip->lock))
+        return -1;
+      if((mem = pcache_get(v->ip, v->off + (va - v->start))) == 0)
+        return -1;
+      // the page is shared with the cache. a shared mapping
+      // stores into it, read-only until the first store so
+      // that munmap() knows which pages to write back; a
+      // private one gets its own copy on first store.
+      if((perm & PTE_W) && (v->flags & VMA_SHARED))
+        perm = write ? perm | PTE_D : perm & ~PTE_W;
+      else if(perm & PTE_W)
+        perm = (perm & ~PTE_W) | PTE_COW;
+    }
+  } else {
+    if(va >= p->sz)
+      return -1;
+    perm = PTE_R|PTE_W|PTE_U;
+    // a heap touched inside a 2MB stretch it fully covers
+    // gets the whole stretch as a megapage.
+    a = PGROUNDDOWN(va) & ~(MEGAPGSIZE - 1);
+    if(a + MEGAPGSIZE <= p->sz && !vmaoverlap(p, a, a + MEGAPGSIZE) &&
+       uvmallocmega(p->pagetable, a, perm) == 0){
+      uvmflush(p->pagetable, va);
+      return 0;
+    }
+    if((mem = kzalloc()) == 0)
+      return -1;
+  }
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)mem, perm) != 0){
+    kfree(mem);
+    return -1;
+  }
+  // order the PTE store before the page walk that uses it.
+  uvmflush(p->pagetable, va);
+  return 0;
+}
+
+// Fault in the not yet mapped vma pages of p in [va, va+len),
+// for a store if write, so that a later copyin() or copyout()
+// needn't read the file and can be done while holding a
+// spinlock.
+void
+uvmprefault(struct proc *p, uint64 va, uint64 len, int write)
+{
+  struct vma *v;
+  uint64 a, lo, hi;
+  pte_t *pte;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->ip == 0)
+      continue;
+    lo = va > v->start ? PGROUNDDOWN(va) : v->start;
+    hi = va + len < v->end ? va + len : v->end;
+    for(a = lo; a < hi; a += PGSIZE){
+      pte = walk(p->pagetable, a, 0);
+      if(pte == 0 || (*pte & PTE_V) == 0)
+        uvmfault(p, a, write);
+    }
+  }
+}
+
+// Release the files of an array of NVMA vmas.
+// Caller must be inside a transaction.
+void
+vmafree(struct vma *vma)
+{
+  for(struct vma *v = vma; v < &vma[NVMA]; v++){
+    if(v->ip)
+      iput(v->ip);
+    v->ip = 0;
+    v->flags = 0;
+  }
+}
+
+// Stop an array of NVMA vmas from faulting in pages at or
+// above sz, after the process shrinks below them.
+void
+vmatrim(struct vma *vma, uint64 sz)
+{
+  sz = PGROUNDUP(sz);
+  for(struct vma *v = vma; v < &vma[NVMA]; v++){
+    if(v->ip && (v->flags & VMA_MMAP) == 0 && v->end > sz)
+      v->end = v->start > sz ? v->start : sz;
+  }
+}
+
+// The lowest address of p's mmap() regions, or VDSO if it
+// has none: the heap may grow up to here.
+uint64
+mmapbase(struct proc *p)
+{
+  uint64 base = VDSO;
+
+  for(struct vma *v = p->vma; v < &p->vma[NVMA]; v++){
+    if((v->flags & VMA_MMAP) && v->start < base)
+      base = v->start;
+  }
+  return base;
+}
+
+// Map len bytes of ip from page-aligned offset off, or of
+// zeroes if ip is 0, into the current process, at the highest
+// free addresses below VDSO. perm holds PTE_R, PTE_W, PTE_X;
+// flags is 0 or VMA_SHARED. File pages are faulted in from
+// the page cache. A shared anonymous region is filled now, so
+// that fork() shares every page of it.
+// Returns the address, or -1.
+uint64
+mmap(uint64 len, int perm, int flags, struct inode *ip, uint64 off)
+{
+  struct proc *p = myproc();
+  struct vma *v, *nv = 0;
+  uint64 a, end;
+  char *mem;
+  int moved;
+
+  len = PGROUNDUP(len);
+  if(len == 0 || len > VDSO)
+    return -1;
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(!VMAUSED(v))
+      nv = v;
+  }
+  if(nv == 0)
+    return -1;
+
+  // the highest gap of len bytes among the other regions.
+  end = VDSO;
+  do {
+    moved = 0;
+    for(v = p->vma; v < &p->vma[NVMA]; v++){
+      if(VMAUSED(v) && v->start < end && v->end + len > end){
+        end = v->start;
+        moved = 1;
+      }
+    }
+  } while(moved && end >= len);
+  if(end < len || end - len < PGROUNDUP(p->sz))
+    return -1;
+
+  nv->start = end - len;
+  nv->end = end;
+  nv->off = off;
+  nv->perm = perm | PTE_R | PTE_U;  // no write-only pages on RISC-V
+  nv->flags = VMA_MMAP | flags;
+  nv->ip = ip ? idup(ip) : 0;
+  if(ip == 0 && (flags & VMA_SHARED)){
+    for(a = nv->start; a < nv->end; a += PGSIZE){
+      if((mem = kzalloc()) == 0 ||
+         mappages(p->pagetable, a, PGSIZE, (uint64)mem, nv->perm) != 0){
+        if(mem)
+          kfree(mem);
+        uvmunmap(p->pagetable, nv->start, (a - nv->start) / PGSIZE, 1);
+        nv->flags = 0;
+        return -1;
+      }
+    }
+  }
+  return nv->start;
+}
+
+// Write the dirty pages of shared file region v in [lo, hi)
+// back to the file, not past its end. Starts its own
+// transactions, so the caller must not be inside one.
+static void
+vmasync(struct proc *p, struct vma *v, uint64 lo, uint64 hi)
+{
+  int max = (MAXOPDATA-2) * BSIZE;
+  uint64 a, pa;
+  uint off, n, i, n1;
+  pte_t *pte;
+
+  if(v->ip == 0 || (v->flags & VMA_SHARED) == 0)
+    return;
+  for(a = lo; a < hi; a += PGSIZE){
+    pte = walk(p->pagetable, a, 0);
+    if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_D) == 0)
+      continue;
+    pa = PTE2PA(*pte);
+    off = v->off + (a - v->start);
+    // as in filewrite(), a few blocks per transaction.
+    for(i = 0; i < PGSIZE; i += n1){
+      begin_op();
+      ilock(v->ip);
+      n = v->ip->size > off + i ? v->ip->size - off - i : 0;
+      n1 = n < PGSIZE - i ? n : PGSIZE - i;
+      if(n1 > max)
+        n1 = max;
+      if(n1 > 0)
+        writei(v->ip, 0, pa + i, off + i, n1);
+      iunlock(v->ip);
+      end_op();
+      if(n1 == 0)
+        break;
+    }
+  }
+}
+
+// Unmap [addr, addr+len) of the current process's mmap()
+// regions, writing shared file pages back. Addresses outside
+// them are left alone. Returns 0, or -1 if addr isn't
+// page-aligned or punching a hole needs a vma slot and there
+// is none.
+int
+munmap(uint64 addr, uint64 len)
+{
+  struct proc *p = myproc();
+  struct vma *v, *nv = 0;
+  uint64 lo, hi, end;
+
+  if(addr % PGSIZE || len == 0 || addr + len < addr || addr + len > VDSO)
+    return -1;
+  end = PGROUNDUP(addr + len);
+
+  // a hole in the middle of a region splits it in two.
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if((v->flags & VMA_MMAP) && addr > v->start && end < v->end){
+      for(nv = p->vma; nv < &p->vma[NVMA] && VMAUSED(nv); nv++)
+        ;
+      if(nv == &p->vma[NVMA])
+        return -1;
+      *nv = *v;
+      nv->start = end;
+      nv->off += end - v->start;
+      if(nv->ip)
+        idup(nv->ip);
+      break;
+    }
+  }
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v == nv || (v->flags & VMA_MMAP) == 0 || v->start >= end || v->end <= addr)
+      continue;
+    lo = addr > v->start ? addr : v->start;
+    hi = end < v->end ? end : v->end;
+    vmasync(p, v, lo, hi);
+    uvmunmap(p->pagetable, lo, (hi - lo) / PGSIZE, 1);
+    if(lo == v->start && hi == v->end){
+      if(v->ip){
+        begin_op();
+        iput(v->ip);
+        end_op();
+      }
+      v->ip = 0;
+      v->flags = 0;
+    } else if(lo == v->start){
+      v->off += hi - v->start;
+      v->start = hi;
+    } else {
+      v->end = lo;  // the tail, or, after a split, the hole and above
+    }
+  }
+  return 0;
+}
+
+// Write back and unmap all of p's mmap() regions, as exit()
+// and exec() drop its address space; vmafree() then releases
+// their files. Caller must not be inside a transaction.
+void
+munmapall(struct proc *p)
+{
+  for(struct vma *v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->flags & VMA_MMAP){
+      vmasync(p, v, v->start, v->end);
+      uvmunmap(p->pagetable, v->start, (v->end - v->start) / PGSIZE, 1);
+    }
+  }
+}
+
+// Map p's mmap() regions into child np, as fork() does: the
+// pages of shared regions stay shared, and writable pages of
+// private ones become copy-on-write, as in uvmcopy().
+// Returns 0, or -1 with nothing mapped.
+int
+vmacopy(struct proc *p, struct proc *np)
+{
+  struct vma *v;
+  pte_t *pte;
+  uint64 a;
+
+  utlbflush(p->pagetable);
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if((v->flags & VMA_MMAP) == 0)
+      continue;
+    for(a = v->start; a < v->end; a += PGSIZE){
+      if((pte = walk(p->pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+        continue;
+      if((v->flags & VMA_SHARED) == 0 && (*pte & PTE_W))
+        *pte = (*pte & ~PTE_W) | PTE_COW;
+      if(mappages(np->pagetable, a, PGSIZE, PTE2PA(*pte), PTE_FLAGS(*pte)) != 0)
+        goto err;
+      kref((void*)PTE2PA(*pte));
+    }
+  }
+  uvmflush(p->pagetable, -1);
+  return 0;
+
+ err:
+  uvmflush(p->pagetable, -1);
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->flags & VMA_MMAP)
+      uvmunmap(np->pagetable, v->start, (v->end - v->start) / PGSIZE, 1);
+  }
+  return -1;
+}
+
+// For copyin() and friends: if va is a not yet mapped page
+// of the current process, fault it in. Returns its physical
+// address, or 0.
+static uint64
+lazyaddr(pagetable_t pagetable, uint64 va, int write)
+{
+  struct proc *p = myproc();
+
+  if(p == 0 || p->pagetable != pagetable || uvmfault(p, va, write) < 0)
+    return 0;
+  return walkaddr(pagetable, va);
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -347,9 +1046,11 @@ uvmclear(pagetable_t pagetable, uint64 va)
   pte_t *pte;
   
   pte = walk(pagetable, va, 0);
-  if(pte == 0)
+  if(pte == 0 || (*pte & PTE_MEGA))
     panic("uvmclear");
+  utlbflush(pagetable);
   *pte &= ~PTE_U;
+  uvmflush(pagetable, va);
 }
 
 // Copy from kernel to user.
@@ -360,16 +1061,27 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
   pte_t *pte;
+  struct proc *p = utlbproc(pagetable);
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
     if(va0 >= MAXVA)
       return -1;
-    pte = walk(pagetable, va0, 0);
-    if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0 ||
-       (*pte & PTE_W) == 0)
-      return -1;
-    pa0 = PTE2PA(*pte);
+    if((pa0 = utlblookup(p, va0, PTE_W)) == 0){
+      pte = walk(pagetable, va0, 0);
+      if((pte == 0 || (*pte & PTE_V) == 0) && lazyaddr(pagetable, va0, 1) != 0)
+        pte = walk(pagetable, va0, 0);
+      if(pte && (*pte & PTE_COW) && uvmcow(pagetable, va0) < 0)
+        return -1;
+      // a shared file page is read-only until its first store.
+      if(pte && (*pte & (PTE_V|PTE_W|PTE_COW)) == PTE_V && lazyaddr(pagetable, va0, 1) != 0)
+        pte = walk(pagetable, va0, 0);
+      if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0 ||
+         (*pte & PTE_W) == 0)
+        return -1;
+      pa0 = ptepa(*pte, va0);
+      utlbfill(p, va0, pa0, PTE_FLAGS(*pte));
+    }
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
@@ -389,12 +1101,16 @@ int
 copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
   uint64 n, va0, pa0;
+  struct proc *p = utlbproc(pagetable);
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
-      return -1;
+    if((pa0 = utlblookup(p, va0, 0)) == 0){
+      pa0 = walkaddr(pagetable, va0);
+      if(pa0 == 0 && (pa0 = lazyaddr(pagetable, va0, 0)) == 0)
+        return -1;
+      utlbfill(p, va0, pa0, PTE_V | PTE_U);
+    }
     n = PGSIZE - (srcva - va0);
     if(n > len)
       n = len;
@@ -414,19 +1130,38 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 int
 copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 {
-  uint64 n, va0, pa0;
+  uint64 n, va0, pa0, w;
   int got_null = 0;
+  struct proc *pr = utlbproc(pagetable);
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
-      return -1;
+    if((pa0 = utlblookup(pr, va0, 0)) == 0){
+      pa0 = walkaddr(pagetable, va0);
+      if(pa0 == 0 && (pa0 = lazyaddr(pagetable, va0, 0)) == 0)
+        return -1;
+      utlbfill(pr, va0, pa0, PTE_V | PTE_U);
+    }
     n = PGSIZE - (srcva - va0);
     if(n > max)
       n = max;
 
     char *p = (char *) (pa0 + (srcva - va0));
+
+    // a word at a time while both sides are aligned and
+    // the word holds no zero byte.
+    if((((uint64)p | (uint64)dst) & 7) == 0){
+      while(n >= 8){
+        w = *(uint64*)p;
+        if((w - 0x0101010101010101UL) & ~w & 0x8080808080808080UL)
+          break;
+        *(uint64*)dst = w;
+        n -= 8;
+        max -= 8;
+        p += 8;
+        dst += 8;
+      }
+    }
     while(n > 0){
       if(*p == '\0'){
         *dst = '\0';
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""Symbolize the output of xv6's prof program.
+
+Feed it a console log containing "prof name pid u|k pc count"
+lines. Kernel pcs are looked up in kernel/kernel.sym, user pcs
+in user/name.sym. Prints folded stacks ("name;function count"),
+the input format of flamegraph.pl, or a flat profile with -f.
+"""
+
+import bisect
+import collections
+import os
+import re
+import sys
+
+LINE = re.compile(r"prof (\S+) (-?\d+) ([uk]) ([0-9a-f]+) (\d+)$")
+
+
+def loadsym(path):
+    syms = []
+    try:
+        with open(path) as f:
+            for line in f:
+                parts = line.split()
+                if len(parts) == 2:
+                    syms.append((int(parts[0], 16), parts[1]))
+    except OSError:
+        pass
+    syms.sort()
+    return [a for a, _ in syms], [n for _, n in syms]
+
+
+def lookup(syms, pc):
+    addrs, names = syms
+    i = bisect.bisect_right(addrs, pc) - 1
+    if i < 0:
+        return "0x%x" % pc
+    return names[i]
+
+
+def main():
+    flat = "-f" in sys.argv[1:]
+    files = [a for a in sys.argv[1:] if a != "-f"]
+    root = os.path.dirname(os.path.abspath(__file__))
+    tables = {"kernel": loadsym(os.path.join(root, "kernel", "kernel.sym"))}
+    counts = collections.Counter()
+
+    for line in (open(files[0]) if files else sys.stdin):
+        m = LINE.search(line.strip())
+        if not m:
+            continue
+        name, _, mode, pc, n = m.groups()
+        if mode == "k":
+            key = "kernel"
+        else:
+            key = name
+            if key not in tables:
+                tables[key] = loadsym(os.path.join(root, "user", "%s.sym" % name))
+        func = lookup(tables[key], int(pc, 16))
+        if mode == "k":
+            func = "[k] " + func
+        counts[(name, func)] += int(n)
+
+    if flat:
+        total = sum(counts.values()) or 1
+        for (name, func), n in counts.most_common():
+            print("%6.2f%% %6d  %-12s %s" % (100.0 * n / total, n, name, func))
+    else:
+        for (name, func), n in sorted(counts.items()):
+            print("%s;%s %d" % (name, func, n))
+
+
+if __name__ == "__main__":
+    main()
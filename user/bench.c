@@ -0,0 +1,293 @@
+// Microbenchmarks for process creation, pipes, memory and
+// the file system. Prints one line per benchmark,
+// "bench name iters ticks", for comparing kernels; a tick
+// is TICKCYCLES timer cycles.
+//
+// usage: bench [-s scale] [name ...]
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define BATCH 8           // children alive at once in "fork"
+#define FBLOCKS 64        // file size for "write" and "read"
+
+char *self = "/bench";
+char *selfargv[] = { "bench", "-x", 0 };
+char buf[1024];
+
+void
+fail(char *what)
+{
+  fprintf(2, "bench: %s failed\n", what);
+  exit(1);
+}
+
+int
+fork1(void)
+{
+  int pid;
+
+  if((pid = fork()) < 0)
+    fail("fork");
+  return pid;
+}
+
+void
+wait1(void)
+{
+  if(wait(0) < 0)
+    fail("wait");
+}
+
+// fork alone: only the fork calls are timed, a batch
+// at a time, and the children are reaped off the clock.
+int
+bfork(int n)
+{
+  int i, j, t, ticks = 0;
+
+  for(i = 0; i < n; i += BATCH){
+    t = uptime();
+    for(j = 0; j < BATCH; j++)
+      if(fork1() == 0)
+        exit(0);
+    ticks += uptime() - t;
+    for(j = 0; j < BATCH; j++)
+      wait1();
+  }
+  return ticks;
+}
+
+int
+bforkwait(int n)
+{
+  int i, t = uptime();
+
+  for(i = 0; i < n; i++){
+    if(fork1() == 0)
+      exit(0);
+    wait1();
+  }
+  return uptime() - t;
+}
+
+int
+bforkexec(int n)
+{
+  int i, t = uptime();
+
+  for(i = 0; i < n; i++){
+    if(fork1() == 0){
+      exec(self, selfargv);
+      fail("exec");
+    }
+    wait1();
+  }
+  return uptime() - t;
+}
+
+int
+bspawn(int n)
+{
+  int i, t = uptime();
+
+  for(i = 0; i < n; i++){
+    if(spawn(self, selfargv, 0, 0, 0) < 0)
+      fail("spawn");
+    wait1();
+  }
+  return uptime() - t;
+}
+
+// reap each child by polling wait_noblock() without sleeping.
+int
+bwaitpoll(int n)
+{
+  int i, pid, t = uptime();
+
+  for(i = 0; i < n; i++){
+    if((pid = fork1()) == 0)
+      exit(0);
+    while(wait_noblock(0) != pid)
+      ;
+  }
+  return uptime() - t;
+}
+
+// one-byte round trips between parent and child.
+int
+bpipe(int n)
+{
+  int p1[2], p2[2], i, t;
+  char c = 0;
+
+  if(pipe(p1) < 0 || pipe(p2) < 0)
+    fail("pipe");
+  if(fork1() == 0){
+    close(p1[1]);
+    close(p2[0]);
+    while(read(p1[0], &c, 1) == 1)
+      write(p2[1], &c, 1);
+    exit(0);
+  }
+  close(p1[0]);
+  close(p2[1]);
+  t = uptime();
+  for(i = 0; i < n; i++){
+    if(write(p1[1], &c, 1) != 1 || read(p2[0], &c, 1) != 1)
+      fail("pipe round trip");
+  }
+  t = uptime() - t;
+  close(p1[1]);
+  close(p2[0]);
+  wait1();
+  return t;
+}
+
+// grow by a page and touch it, then give it all back.
+int
+bsbrk(int n)
+{
+  int i, t = uptime();
+  char *p;
+
+  for(i = 0; i < n; i++){
+    if((p = sbrk(4096)) == (char*)-1)
+      fail("sbrk");
+    *p = 1;
+  }
+  if(sbrk(-n*4096) == (char*)-1)
+    fail("sbrk");
+  return uptime() - t;
+}
+
+int
+bopenclose(int n)
+{
+  int i, fd, t;
+
+  if((fd = open("benchf", O_CREATE|O_RDWR)) < 0)
+    fail("create");
+  close(fd);
+  t = uptime();
+  for(i = 0; i < n; i++){
+    if((fd = open("benchf", O_RDONLY)) < 0)
+      fail("open");
+    close(fd);
+  }
+  t = uptime() - t;
+  unlink("benchf");
+  return t;
+}
+
+int
+bcreate(int n)
+{
+  int i, fd, t = uptime();
+
+  for(i = 0; i < n; i++){
+    if((fd = open("benchf", O_CREATE|O_RDWR)) < 0)
+      fail("create");
+    if(write(fd, buf, 512) != 512)
+      fail("write");
+    close(fd);
+    if(unlink("benchf") < 0)
+      fail("unlink");
+  }
+  return uptime() - t;
+}
+
+// n times, write a FBLOCKS-block file from start to end.
+int
+bwrite(int n)
+{
+  int i, j, fd, t = uptime();
+
+  for(i = 0; i < n; i++){
+    if((fd = open("benchf", O_CREATE|O_WRONLY|O_TRUNC)) < 0)
+      fail("create");
+    for(j = 0; j < FBLOCKS; j++)
+      if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+        fail("write");
+    close(fd);
+  }
+  return uptime() - t;
+}
+
+// read back the file "write" left.
+int
+bread(int n)
+{
+  int i, j, fd, t = uptime();
+
+  for(i = 0; i < n; i++){
+    if((fd = open("benchf", O_RDONLY)) < 0)
+      fail("open");
+    for(j = 0; j < FBLOCKS; j++)
+      if(read(fd, buf, sizeof(buf)) != sizeof(buf))
+        fail("read");
+    close(fd);
+  }
+  return uptime() - t;
+}
+
+struct bench {
+  char *name;
+  int (*f)(int);
+  int n;                  // iterations at scale 1
+} benches[] = {
+  { "fork",      bfork,      256 },
+  { "forkwait",  bforkwait,  256 },
+  { "forkexec",  bforkexec,  128 },
+  { "spawn",     bspawn,     128 },
+  { "waitpoll",  bwaitpoll,  256 },
+  { "pipe",      bpipe,      4096 },
+  { "sbrk",      bsbrk,      1024 },
+  { "openclose", bopenclose, 1024 },
+  { "create",    bcreate,    128 },
+  { "write",     bwrite,     16 },
+  { "read",      bread,      64 },
+};
+
+int
+wanted(char *name, int argc, char **argv)
+{
+  int i;
+
+  if(argc == 0)
+    return 1;
+  for(i = 0; i < argc; i++)
+    if(strcmp(argv[i], name) == 0)
+      return 1;
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int scale = 1, nb = sizeof(benches)/sizeof(benches[0]);
+  struct bench *b;
+
+  if(argc == 2 && strcmp(argv[1], "-x") == 0)
+    exit(0);  // the program "forkexec" and "spawn" run
+  argc--, argv++;
+  if(argc >= 2 && strcmp(argv[0], "-s") == 0){
+    if((scale = atoi(argv[1])) < 1){
+      fprintf(2, "usage: bench [-s scale] [name ...]\n");
+      exit(1);
+    }
+    argc -= 2, argv += 2;
+  }
+
+  for(b = benches; b < &benches[nb]; b++){
+    if(!wanted(b->name, argc, argv))
+      continue;
+    // "read" needs the file "write" makes.
+    if(b->f == bread && !wanted("write", argc, argv))
+      bwrite(1);
+    printf("bench %s %d %d\n", b->name, b->n * scale, b->f(b->n * scale));
+  }
+  unlink("benchf");
+  exit(0);
+}
@@ -2,21 +2,19 @@
 #include "kernel/fcntl.h"
 #include "user/user.h"
 
-char buf[512];
+#define CHUNK (64*1024)  // bytes per sendfile()
 
+// copy fd to the standard output inside the kernel,
+// without a round trip through a user buffer.
 void
 cat(int fd)
 {
   int n;
 
-  while((n = read(fd, buf, sizeof(buf))) > 0) {
-    if (write(1, buf, n) != n) {
-      fprintf(2, "cat: write error\n");
-      exit(1);
-    }
-  }
+  while((n = sendfile(1, fd, CHUNK)) > 0)
+    ;
   if(n < 0){
-    fprintf(2, "cat: read error\n");
+    fprintf(2, "cat: sendfile error\n");
     exit(1);
   }
 }
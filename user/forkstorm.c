@@ -0,0 +1,169 @@
+// Fork-heavy workloads for the load-lab-forkbomb harness.
+// Each prints "storm workload metric value" lines, times in
+// microseconds from nsectime().
+//
+// usage: forkstorm bomb width depth
+//        forkstorm reap n
+//        forkstorm pipe stages n
+
+#include "kernel/types.h"
+#include "kernel/rusage.h"
+#include "user/user.h"
+
+int
+usec(uint64 t0)
+{
+  return (nsectime() - t0) / 1000;
+}
+
+void
+report(char *work, char *metric, int v)
+{
+  printf("storm %s %s %d\n", work, metric, v);
+}
+
+// every process down to depth forks width children, all
+// running at once, then waits for them. a failed fork is
+// counted, not fatal, as the point is to reach the quota.
+// the exit status carries the subtree's fork count.
+int
+bombtree(int width, int depth, int *failed)
+{
+  int i, n = 0, st, f;
+
+  if(depth == 0)
+    return 0;
+  f = 0;
+  for(i = 0; i < width; i++){
+    int pid = fork();
+    if(pid < 0){
+      f++;
+      continue;
+    }
+    if(pid == 0){
+      int sub = 0;
+      n = bombtree(width, depth - 1, &sub);
+      exit(n * 256 + sub);   // fits a small tree
+    }
+    n++;
+  }
+  while(wait(&st) >= 0){
+    n += st / 256;
+    f += st % 256;
+  }
+  *failed += f;
+  return n;
+}
+
+void
+bomb(int width, int depth)
+{
+  uint64 t0 = nsectime();
+  int failed = 0, n, t;
+  struct rusage ru;
+
+  n = bombtree(width, depth, &failed);
+  t = usec(t0);
+  getrusage(RUSAGE_CHILDREN, &ru);
+  report("bomb", "forks", n);
+  report("bomb", "failed", failed);
+  report("bomb", "usec", t);
+  report("bomb", "forks_per_sec", t ? (int)((uint64)n * 1000000 / t) : 0);
+  report("bomb", "csw", (int)(ru.nvcsw + ru.nivcsw));
+}
+
+// how long after a child's last instruction its parent's
+// wait() returns.
+void
+reap(int n)
+{
+  int i, fds[2], lat, max = 0;
+  uint64 sum = 0, t;
+
+  if(pipe(fds) < 0){
+    fprintf(2, "forkstorm: pipe failed\n");
+    exit(1);
+  }
+  for(i = 0; i < n; i++){
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "forkstorm: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      t = nsectime();
+      write(fds[1], &t, sizeof(t));
+      exit(0);
+    }
+    wait(0);
+    if(read(fds[0], &t, sizeof(t)) != sizeof(t)){
+      fprintf(2, "forkstorm: read failed\n");
+      exit(1);
+    }
+    lat = usec(t);
+    sum += lat;
+    if(lat > max)
+      max = lat;
+  }
+  report("reap", "n", n);
+  report("reap", "avg_usec", n ? sum / n : 0);
+  report("reap", "max_usec", max);
+}
+
+// a ring of stages processes passing a token around n times.
+void
+pipering(int stages, int n)
+{
+  int i, p[8][2], tok, t;
+  uint64 t0;
+
+  if(stages < 2 || stages > 8){
+    fprintf(2, "forkstorm: 2 to 8 stages\n");
+    exit(1);
+  }
+  for(i = 0; i < stages; i++)
+    if(pipe(p[i]) < 0){
+      fprintf(2, "forkstorm: pipe failed\n");
+      exit(1);
+    }
+  // stage i reads p[i] and writes p[i+1]; this process is stage 0.
+  for(i = 1; i < stages; i++){
+    if(fork() == 0){
+      // pass the -1 that ends the run on before leaving.
+      while(read(p[i][0], &tok, sizeof(tok)) == sizeof(tok)){
+        write(p[(i+1)%stages][1], &tok, sizeof(tok));
+        if(tok < 0)
+          break;
+      }
+      exit(0);
+    }
+  }
+  t0 = nsectime();
+  for(tok = 0; tok < n; tok++){
+    write(p[1][1], &tok, sizeof(tok));
+    read(p[0][0], &tok, sizeof(tok));
+  }
+  t = usec(t0);
+  tok = -1;
+  write(p[1][1], &tok, sizeof(tok));
+  for(i = 1; i < stages; i++)
+    wait(0);
+  report("pipe", "laps", n);
+  report("pipe", "usec_per_lap", n ? t / n : 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc == 4 && strcmp(argv[1], "bomb") == 0)
+    bomb(atoi(argv[2]), atoi(argv[3]));
+  else if(argc == 3 && strcmp(argv[1], "reap") == 0)
+    reap(atoi(argv[2]));
+  else if(argc == 4 && strcmp(argv[1], "pipe") == 0)
+    pipering(atoi(argv[2]), atoi(argv[3]));
+  else {
+    fprintf(2, "usage: forkstorm bomb width depth | reap n | pipe stages n\n");
+    exit(1);
+  }
+  exit(0);
+}
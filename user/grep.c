@@ -1,36 +1,196 @@
 // Simple grep.  Only supports ^ . * $ operators.
+//
+// The pattern is compiled once into a list of atoms, each a
+// character or '.', possibly starred. Their NFA has one state
+// per atom plus an accepting one; a set of states is a bit mask.
+// A DFA is built from it lazily: each DFA state is one such set,
+// and caches its successor for every byte the first time that
+// byte is seen. Each line is then scanned once, a table lookup
+// per byte. If the pattern starts with a literal string, lines
+// without it are skipped by a Boyer-Moore-Horspool search
+// through the whole buffer before the DFA looks at anything.
 
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
 #include "user/user.h"
 
-char buf[1024];
-int match(char*, char*);
+#define NATOM   63    // atoms in a pattern; one bit each, plus accept
+#define NDSTATE 64    // cached DFA states
+
+char buf[32768];
+
+struct atom {
+  char c;       // 0 for '.'
+  char star;
+};
+
+struct atom atoms[NATOM];
+int natom;
+int bol, eol;              // anchored by ^, by $
+uint64 eps[NATOM+1];       // states reachable from state i on no input
+uint64 again;              // states re-entered at each byte, unless bol
+
+char lit[NATOM];           // the pattern's literal prefix
+int nlit;
+int skip[256];             // Horspool shifts for lit
+
+struct dstate {
+  uint64 set;
+  short next[256];         // -1 if not yet computed
+};
+
+struct dstate ds[NDSTATE];
+int nds;
 
 void
-grep(char *pattern, int fd)
+compile(char *re)
+{
+  int i;
+
+  if(re[0] == '^'){
+    bol = 1;
+    re++;
+  }
+  for(; *re; re++){
+    if(re[0] == '$' && re[1] == '\0'){
+      eol = 1;
+      break;
+    }
+    if(natom == NATOM){
+      fprintf(2, "grep: pattern too long\n");
+      exit(1);
+    }
+    atoms[natom].c = re[0] == '.' ? 0 : re[0];
+    atoms[natom].star = re[1] == '*';
+    if(atoms[natom].star)
+      re++;
+    natom++;
+  }
+
+  eps[natom] = 1ULL << natom;
+  for(i = natom - 1; i >= 0; i--)
+    eps[i] = (1ULL << i) | (atoms[i].star ? eps[i+1] : 0);
+  again = bol ? 0 : eps[0];
+
+  while(nlit < natom && atoms[nlit].c && !atoms[nlit].star){
+    lit[nlit] = atoms[nlit].c;
+    nlit++;
+  }
+  for(i = 0; i < 256; i++)
+    skip[i] = nlit;
+  for(i = 0; i < nlit - 1; i++)
+    skip[lit[i] & 0xff] = nlit - 1 - i;
+}
+
+// The DFA state for set, adding it if it isn't cached.
+// A full cache is thrown away and started over.
+int
+dstate(uint64 set)
+{
+  int i;
+
+  for(i = 0; i < nds; i++)
+    if(ds[i].set == set)
+      return i;
+  if(nds == NDSTATE)
+    nds = 0;
+  ds[nds].set = set;
+  for(i = 0; i < 256; i++)
+    ds[nds].next[i] = -1;
+  return nds++;
+}
+
+// The DFA state after state s reads byte c.
+int
+dnext(int s, int c)
+{
+  uint64 set, nset;
+  int i;
+
+  if(ds[s].next[c] >= 0)
+    return ds[s].next[c];
+  set = ds[s].set;
+  nset = again;
+  for(i = 0; i < natom; i++){
+    if((set & (1ULL << i)) && (atoms[i].c == 0 || atoms[i].c == c))
+      nset |= atoms[i].star ? eps[i] : eps[i+1];
+  }
+  i = dstate(nset);   // may reuse s's slot
+  if(ds[s].set == set)
+    ds[s].next[c] = i;
+  return i;
+}
+
+// Does the line [p, e) match?
+int
+matchline(char *p, char *e)
+{
+  uint64 accept = 1ULL << natom;
+  int s;
+
+  s = dstate(eps[0]);
+  for(; p < e; p++){
+    if(!eol && (ds[s].set & accept))
+      return 1;
+    if(ds[s].set == 0)
+      return 0;
+    s = dnext(s, *p & 0xff);
+  }
+  return (ds[s].set & accept) != 0;
+}
+
+// First occurrence of lit in [p, e), or 0.
+char*
+findlit(char *p, char *e)
+{
+  int last = nlit - 1;
+
+  while(e - p >= nlit){
+    if(p[last] == lit[last] && memcmp(p, lit, last) == 0)
+      return p;
+    p += skip[p[last] & 0xff];
+  }
+  return 0;
+}
+
+void
+grep(int fd)
 {
   int n, m;
-  char *p, *q;
+  char *p, *q, *e, *end;
 
   m = 0;
-  while((n = read(fd, buf+m, sizeof(buf)-m-1)) > 0){
+  while((n = read(fd, buf+m, sizeof(buf)-m)) > 0){
     m += n;
-    buf[m] = '\0';
+    e = buf + m;
+    for(end = e; end > buf && end[-1] != '\n'; end--)
+      ;
+    if(end == buf && m == sizeof(buf)){
+      // a line longer than buf; take what we have.
+      if(matchline(buf, e))
+        write(1, buf, m);
+      m = 0;
+      continue;
+    }
+    // [buf, end) holds whole lines.
     p = buf;
-    while((q = strchr(p, '\n')) != 0){
-      *q = 0;
-      if(match(pattern, p)){
-        *q = '\n';
-        write(1, p, q+1 - p);
+    while(p < end){
+      if(nlit > 0 && !bol){
+        // only a line holding lit can match.
+        if((q = findlit(p, end)) == 0)
+          break;
+        while(q > p && q[-1] != '\n')
+          q--;
+        p = q;
       }
+      q = memchr(p, '\n', end - p);
+      if(matchline(p, q))
+        write(1, p, q+1 - p);
       p = q+1;
     }
-    if(m > 0){
-      m -= p - buf;
-      memmove(buf, p, m);
-    }
+    m = e - end;
+    memmove(buf, end, m);
   }
 }
 
@@ -38,16 +198,15 @@ int
 main(int argc, char *argv[])
 {
   int fd, i;
-  char *pattern;
 
   if(argc <= 1){
     fprintf(2, "usage: grep pattern [file ...]\n");
     exit(1);
   }
-  pattern = argv[1];
+  compile(argv[1]);
 
   if(argc <= 2){
-    grep(pattern, 0);
+    grep(0);
     exit(0);
   }
 
@@ -56,52 +215,8 @@ main(int argc, char *argv[])
       printf("grep: cannot open %s\n", argv[i]);
       exit(1);
     }
-    grep(pattern, fd);
+    grep(fd);
     close(fd);
   }
   exit(0);
 }
-
-// Regexp matcher from Kernighan & Pike,
-// The Practice of Programming, Chapter 9, or
-// https://www.cs.princeton.edu/courses/archive/spr09/cos333/beautiful.html
-
-int matchhere(char*, char*);
-int matchstar(int, char*, char*);
-
-int
-match(char *re, char *text)
-{
-  if(re[0] == '^')
-    return matchhere(re+1, text);
-  do{  // must look at empty string
-    if(matchhere(re, text))
-      return 1;
-  }while(*text++ != '\0');
-  return 0;
-}
-
-// matchhere: search for re at beginning of text
-int matchhere(char *re, char *text)
-{
-  if(re[0] == '\0')
-    return 1;
-  if(re[1] == '*')
-    return matchstar(re[0], re+2, text);
-  if(re[0] == '$' && re[1] == '\0')
-    return *text == '\0';
-  if(*text!='\0' && (re[0]=='.' || re[0]==*text))
-    return matchhere(re+1, text+1);
-  return 0;
-}
-
-// matchstar: search for c*re at beginning of text
-int matchstar(int c, char *re, char *text)
-{
-  do{  // a * matches zero or more instances
-    if(matchhere(re, text))
-      return 1;
-  }while(*text!='\0' && (*text++==c || c=='.'));
-  return 0;
-}
-
@@ -0,0 +1,62 @@
+// Print the most contended kernel locks, or with a lock
+// name as argument, that lock's hold-time histogram.
+// Needs a kernel built with LOCKSTAT=1.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+#define NTOP 10
+
+struct lockstat st[NLOCKCLASS];
+
+int
+main(int argc, char *argv[])
+{
+  struct lockstat t;
+  int n, i, j;
+
+  if((n = lockstat(st, NLOCKCLASS)) < 0){
+    fprintf(2, "lockstat: kernel built without LOCKSTAT\n");
+    exit(1);
+  }
+  if(n > NLOCKCLASS)
+    n = NLOCKCLASS;
+
+  if(argc > 1){
+    for(i = 0; i < n; i++){
+      if(strcmp(st[i].name, argv[1]) != 0)
+        continue;
+      printf("%s: hold ticks\tcount\n", st[i].name);
+      for(j = 0; j < NLOCKHIST; j++){
+        if(st[i].hold[j] == 0)
+          continue;
+        printf("  < %d\t\t%ld\n", 1 << j, st[i].hold[j]);
+      }
+      exit(0);
+    }
+    fprintf(2, "lockstat: no lock %s\n", argv[1]);
+    exit(1);
+  }
+
+  // most contended first.
+  for(i = 0; i < n; i++){
+    for(j = i + 1; j < n; j++){
+      if(st[j].ncontended > st[i].ncontended){
+        t = st[i];
+        st[i] = st[j];
+        st[j] = t;
+      }
+    }
+  }
+  printf("name\t\tacquire\tcontend\tspins\tavghold\tmaxhold\n");
+  for(i = 0; i < n && i < NTOP; i++){
+    printf("%s\t%s%ld\t%ld\t%ld\t%ld\t%ld\n", st[i].name,
+           strlen(st[i].name) < 8 ? "\t" : "",
+           st[i].nacquire, st[i].ncontended, st[i].nspin,
+           st[i].nacquire ? st[i].holdtotal / st[i].nacquire : 0,
+           st[i].holdmax);
+  }
+  exit(0);
+}
@@ -0,0 +1,33 @@
+// Print physical memory allocator statistics.
+
+#include "kernel/types.h"
+#include "kernel/memstat.h"
+#include "user/user.h"
+
+int
+main(void)
+{
+  struct memstat st;
+  uint64 free = 0, big = 0;
+  int largest = -1;
+
+  if(memstat(&st) < 0){
+    fprintf(2, "memstat: memstat failed\n");
+    exit(1);
+  }
+  printf("order\tfree\talloc\tfail\n");
+  for(int i = 0; i < NORDER; i++){
+    printf("%d\t%ld\t%ld\t%ld\n", i, st.nfree[i], st.nalloc[i], st.nfail[i]);
+    free += st.nfree[i] << i;
+    if(st.nfree[i] > 0){
+      largest = i;
+      if(i == NORDER - 1)
+        big += st.nfree[i] << i;
+    }
+  }
+  printf("free pages %ld, cached %ld, in megapage blocks %ld%%\n",
+         free + st.ncached, st.ncached, free ? big * 100 / free : 0);
+  printf("largest free order %d, split %ld merged %ld\n",
+         largest, st.nsplit, st.nmerge);
+  exit(0);
+}
@@ -1,19 +1,125 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/uio.h"
 #include "user/user.h"
 
 #include <stdarg.h>
 
 static char digits[] = "0123456789ABCDEF";
 
+// Output of one vprintf() call, gathered as iovecs for a
+// single writev(): runs of the format string and %s strings
+// are pointed at where they are, and converted numbers go
+// into scratch.
+struct out {
+  int fd;
+  int niov;
+  struct iovec iov[IOV_MAX];
+  int nscratch;
+  char scratch[128];
+};
+
+// Standard output is line buffered: it is written when a
+// newline arrives, when the buffer fills, before anything
+// goes to standard error, and when fflush(), exit(), exec()
+// or fork() is called.
+static struct {
+  char buf[512];
+  int n;
+} stdout;
+
 static void
-putc(int fd, char c)
+flushstdout(void)
+{
+  if(stdout.n > 0)
+    write(1, stdout.buf, stdout.n);
+  stdout.n = 0;
+}
+
+void
+fflush(int fd)
 {
-  write(fd, &c, 1);
+  if(fd == 1)
+    flushstdout();
+}
+
+// append iov[0..n-1] to the stdout buffer.
+static void
+bufferv(struct iovec *iov, int n)
+{
+  int nl = 0;
+
+  stdioflush = flushstdout;
+  for(int i = 0; i < n; i++){
+    char *s = iov[i].iov_base;
+    int len = iov[i].iov_len;
+    if(stdout.n + len > sizeof(stdout.buf)){
+      flushstdout();
+      if(len > sizeof(stdout.buf)){
+        write(1, s, len);
+        continue;
+      }
+    }
+    for(int j = 0; j < len; j++){
+      stdout.buf[stdout.n++] = s[j];
+      if(s[j] == '\n')
+        nl = 1;
+    }
+  }
+  if(nl)
+    flushstdout();
+}
+
+static void
+flush(struct out *o)
+{
+  if(o->niov > 0){
+    if(o->fd == 1){
+      bufferv(o->iov, o->niov);
+    } else {
+      if(o->fd == 2)
+        flushstdout();
+      writev(o->fd, o->iov, o->niov);
+    }
+  }
+  o->niov = 0;
+  o->nscratch = 0;
 }
 
+// add the n bytes at s, growing the last iovec if they
+// follow straight on from it.
 static void
-printint(int fd, int xx, int base, int sgn)
+putn(struct out *o, const char *s, int n)
+{
+  struct iovec *v;
+
+  if(n == 0)
+    return;
+  if(o->niov > 0){
+    v = &o->iov[o->niov - 1];
+    if((char*)v->iov_base + v->iov_len == s){
+      v->iov_len += n;
+      return;
+    }
+  }
+  if(o->niov == IOV_MAX)
+    flush(o);
+  o->iov[o->niov].iov_base = (void*)s;
+  o->iov[o->niov].iov_len = n;
+  o->niov++;
+}
+
+static void
+putc(struct out *o, char c)
+{
+  if(o->nscratch == sizeof(o->scratch) || o->niov == IOV_MAX)
+    flush(o);
+  o->scratch[o->nscratch] = c;
+  putn(o, &o->scratch[o->nscratch++], 1);
+}
+
+static void
+printint(struct out *o, int xx, int base, int sgn)
 {
   char buf[16];
   int i, neg;
@@ -35,25 +141,30 @@ printint(int fd, int xx, int base, int sgn)
     buf[i++] = '-';
 
   while(--i >= 0)
-    putc(fd, buf[i]);
+    putc(o, buf[i]);
 }
 
 static void
-printptr(int fd, uint64 x) {
+printptr(struct out *o, uint64 x) {
   int i;
-  putc(fd, '0');
-  putc(fd, 'x');
+  putc(o, '0');
+  putc(o, 'x');
   for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4)
-    putc(fd, digits[x >> (sizeof(uint64) * 8 - 4)]);
+    putc(o, digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
 // Print to the given fd. Only understands %d, %x, %p, %s.
 void
 vprintf(int fd, const char *fmt, va_list ap)
 {
+  struct out o;
   char *s;
   int c0, c1, c2, i, state;
 
+  o.fd = fd;
+  o.niov = 0;
+  o.nscratch = 0;
+
   state = 0;
   for(i = 0; fmt[i]; i++){
     c0 = fmt[i] & 0xff;
@@ -61,49 +172,48 @@ vprintf(int fd, const char *fmt, va_list ap)
       if(c0 == '%'){
         state = '%';
       } else {
-        putc(fd, c0);
+        putn(&o, &fmt[i], 1);
       }
     } else if(state == '%'){
       c1 = c2 = 0;
       if(c0) c1 = fmt[i+1] & 0xff;
       if(c1) c2 = fmt[i+2] & 0xff;
       if(c0 == 'd'){
-        printint(fd, va_arg(ap, int), 10, 1);
+        printint(&o, va_arg(ap, int), 10, 1);
       } else if(c0 == 'l' && c1 == 'd'){
-        printint(fd, va_arg(ap, uint64), 10, 1);
+        printint(&o, va_arg(ap, uint64), 10, 1);
         i += 1;
       } else if(c0 == 'l' && c1 == 'l' && c2 == 'd'){
-        printint(fd, va_arg(ap, uint64), 10, 1);
+        printint(&o, va_arg(ap, uint64), 10, 1);
         i += 2;
       } else if(c0 == 'u'){
-        printint(fd, va_arg(ap, int), 10, 0);
+        printint(&o, va_arg(ap, int), 10, 0);
       } else if(c0 == 'l' && c1 == 'u'){
-        printint(fd, va_arg(ap, uint64), 10, 0);
+        printint(&o, va_arg(ap, uint64), 10, 0);
         i += 1;
       } else if(c0 == 'l' && c1 == 'l' && c2 == 'u'){
-        printint(fd, va_arg(ap, uint64), 10, 0);
+        printint(&o, va_arg(ap, uint64), 10, 0);
         i += 2;
       } else if(c0 == 'x'){
-        printint(fd, va_arg(ap, int), 16, 0);
+        printint(&o, va_arg(ap, int), 16, 0);
       } else if(c0 == 'l' && c1 == 'x'){
-        printint(fd, va_arg(ap, uint64), 16, 0);
+        printint(&o, va_arg(ap, uint64), 16, 0);
         i += 1;
       } else if(c0 == 'l' && c1 == 'l' && c2 == 'x'){
-        printint(fd, va_arg(ap, uint64), 16, 0);
+        printint(&o, va_arg(ap, uint64), 16, 0);
         i += 2;
       } else if(c0 == 'p'){
-        printptr(fd, va_arg(ap, uint64));
+        printptr(&o, va_arg(ap, uint64));
       } else if(c0 == 's'){
         if((s = va_arg(ap, char*)) == 0)
           s = "(null)";
-        for(; *s; s++)
-          putc(fd, *s);
+        putn(&o, s, strlen(s));
       } else if(c0 == '%'){
-        putc(fd, '%');
+        putc(&o, '%');
       } else {
         // Unknown % sequence.  Print it to draw attention.
-        putc(fd, '%');
-        putc(fd, c0);
+        putc(&o, '%');
+        putc(&o, c0);
       }
 
 #if 0
@@ -136,6 +246,7 @@ vprintf(int fd, const char *fmt, va_list ap)
       state = 0;
     }
   }
+  flush(&o);
 }
 
 void
@@ -0,0 +1,88 @@
+// Run a command under the sampling profiler and print one
+// line per distinct sample, "prof name pid u|k pc count", for
+// profsym.py to symbolize on the host.
+
+#include "kernel/types.h"
+#include "kernel/prof.h"
+#include "user/user.h"
+
+#define NBUF 64
+#define NHIST 1024
+
+struct hist {
+  struct profsample s;
+  int n;
+} hist[NHIST];
+int nhist, nlost;
+
+struct profsample buf[NBUF];
+
+void
+add(struct profsample *s)
+{
+  int i;
+
+  for(i = 0; i < nhist; i++){
+    struct profsample *h = &hist[i].s;
+    if(h->pc == s->pc && h->pid == s->pid && h->user == s->user){
+      hist[i].n++;
+      return;
+    }
+  }
+  if(nhist == NHIST){
+    nlost++;
+    return;
+  }
+  hist[nhist].s = *s;
+  hist[nhist].n = 1;
+  nhist++;
+}
+
+void
+drain(void)
+{
+  int n;
+
+  while((n = profread(buf, NBUF)) > 0)
+    for(int i = 0; i < n; i++)
+      add(&buf[i]);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid, xstatus;
+
+  if(argc < 2){
+    fprintf(2, "usage: prof command [args...]\n");
+    exit(1);
+  }
+  drain();  // leftovers of an earlier run
+  nhist = 0;
+  profile(1);
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "prof: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    fprintf(2, "prof: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  while(wait_noblock(&xstatus) != pid){
+    sleep(1);
+    drain();
+  }
+  profile(0);
+  drain();
+
+  for(int i = 0; i < nhist; i++){
+    struct profsample *s = &hist[i].s;
+    printf("prof %s %d %c %lx %d\n", s->name, s->pid,
+           s->user ? 'u' : 'k', s->pc, hist[i].n);
+  }
+  if(nlost)
+    printf("prof: %d samples not tallied\n", nlost);
+  exit(0);
+}
@@ -0,0 +1,25 @@
+// Print per-CPU run queue statistics.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/schedstat.h"
+#include "user/user.h"
+
+int
+main(void)
+{
+  struct schedstat st[NCPU];
+  int n;
+
+  if((n = sched_stat(st, NCPU)) < 0){
+    fprintf(2, "schedstat: sched_stat failed\n");
+    exit(1);
+  }
+  for(int i = 0; i < n && i < NCPU; i++){
+    if(st[i].nrun == 0 && st[i].runnable == 0)
+      continue;
+    printf("cpu%d: runnable %d ran %ld stolen %ld\n",
+           i, st[i].runnable, st[i].nrun, st[i].nsteal);
+  }
+  exit(0);
+}
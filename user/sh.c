@@ -4,6 +4,9 @@
 #include "user/user.h"
 #include "kernel/fcntl.h"
 #include "kernel/param.h"
+#include "kernel/rusage.h"
+#include "kernel/spawn.h"
+#include "kernel/poll.h"
 
 // Parsed command representation
 #define EXEC  1
@@ -13,6 +16,7 @@
 #define BACK  5
 
 #define MAXARGS 10
+#define SHPRIO (4*DEFPRIO)  // the shell's own scheduling priority
 
 int shellpid;
 static inline int is_shell(void){ return getpid() == shellpid; }
@@ -56,59 +60,175 @@ struct backcmd {
 };
 
 int fork1(void);  // Fork but panics on failure.
+int spawn1(char*, char**, int);
 void panic(char*);
 struct cmd *parsecmd(char*);
 int getcmd(char *buf, int nbuf, int fd);
 
 
-int bg_jobs[NPROC];
+// Background jobs: a hash from leader pid to job, so that
+// reaping a child costs a lookup rather than a scan, and a
+// list in start order for the jobs builtin.
+#define NJOBHASH 64
+#define JOBCMD   32
 
-void add_job(int pid) {
-    for (int i = 0; i < NPROC; i++) {
-        if (bg_jobs[i] == 0) {
-            bg_jobs[i] = pid;
-            return;
-        }
+enum jobstate { JOB_FREE, JOB_RUNNING };
+
+struct job {
+    int pid;                  // the job's leader
+    int id;                   // job number, shown as %id
+    enum jobstate state;
+    int start;                // uptime() when it started
+    char cmd[JOBCMD];         // the command line, maybe cut short
+    struct job *hnext;        // hash chain
+    struct job *prev, *next;  // start order
+};
+
+struct job jobtab[NPROC];
+struct job *jobhash[NJOBHASH];
+struct job *jobfree;
+struct job joblist;           // head of the start-order list
+int njobs;
+int nextjobid = 1;
+char curline[100];            // the line being run, for add_job()
+
+void init_jobs(void) {
+    jobfree = 0;
+    for (int i = NPROC - 1; i >= 0; i--) {
+        jobtab[i].state = JOB_FREE;
+        jobtab[i].hnext = jobfree;
+        jobfree = &jobtab[i];
     }
+    joblist.prev = joblist.next = &joblist;
 }
 
+// The hash chain link that points at pid's job, or at
+// the null at the end of the chain if pid isn't a job.
+struct job **job_slot(int pid) {
+    struct job **jp = &jobhash[(uint)pid % NJOBHASH];
 
-void remove_job(int pid) {
-    for (int i = 0; i < NPROC; i++) {
-        if (bg_jobs[i] == pid) {
-            bg_jobs[i] = 0;
-            return;
-        }
-    }
+    while (*jp && (*jp)->pid != pid)
+        jp = &(*jp)->hnext;
+    return jp;
 }
 
+void add_job(int pid) {
+    struct job *j = jobfree;
+    struct job **jp;
+    int n;
 
-int is_bg_job(int pid) {
-    for (int i = 0; i < NPROC; i++) {
-        if (bg_jobs[i] == pid) {
-            return 1;
-        }
+    if (j == 0) {
+        fprintf(2, "sh: too many jobs, not tracking %d\n", pid);
+        return;
     }
-    return 0;
+    jobfree = j->hnext;
+    if (njobs++ == 0)
+        nextjobid = 1;
+    j->pid = pid;
+    j->id = nextjobid++;
+    j->state = JOB_RUNNING;
+    j->start = uptime();
+    n = strlen(curline);
+    if (n > JOBCMD - 1)
+        n = JOBCMD - 1;
+    memmove(j->cmd, curline, n);
+    j->cmd[n] = 0;
+    jp = job_slot(pid);
+    j->hnext = 0;
+    *jp = j;
+    j->prev = joblist.prev;
+    j->next = &joblist;
+    joblist.prev->next = j;
+    joblist.prev = j;
+}
+
+// Forget pid's job; returns 0 if it wasn't one.
+int remove_job(int pid) {
+    struct job **jp = job_slot(pid);
+    struct job *j = *jp;
+
+    if (j == 0)
+        return 0;
+    *jp = j->hnext;
+    j->prev->next = j->next;
+    j->next->prev = j->prev;
+    j->state = JOB_FREE;
+    j->hnext = jobfree;
+    jobfree = j;
+    njobs--;
+    return 1;
+}
+
+void print_rusage(struct rusage *ru) {
+    printf("\tuser %ld sys %ld csw %ld/%ld faults %ld blocks %ld\n",
+           ru->utime, ru->stime, ru->nvcsw, ru->nivcsw,
+           ru->nfault, ru->ninblock);
 }
 
-void print_jobs() {
-    for (int i = 0; i < NPROC; i++) {
-        if (bg_jobs[i] != 0) {
-            printf("%d\n", bg_jobs[i]);
+// jobs -l also shows each job's number, command line and
+// ticks since it started, the live processes in its session
+// and in the whole system, and what its leader has used so far.
+void print_jobs(int verbose) {
+    struct rusage ru;
+    struct job *j;
+    int now = uptime();
+
+    for (j = joblist.next; j != &joblist; j = j->next) {
+        if (verbose) {
+            printf("%d\t%%%d %s\tup %d\tprocs %d", j->pid, j->id, j->cmd,
+                   now - j->start, nprocs(j->pid));
+            if (getrusage(j->pid, &ru) == 0)
+                print_rusage(&ru);
+            else
+                printf("\n");
+        } else {
+            printf("%d\n", j->pid);
         }
     }
+    if (verbose)
+        printf("total procs %d/%d\n", nprocs(0), setmaxproc(0));
 }
 
 
-void reap_zombies() {
-    int status;
-    int pid;
-    while ((pid = wait_noblock(&status)) > 0) {
-        if (is_bg_job(pid)) {
-            remove_job(pid);
-            printf("[bg %d] exited with status %d\n", pid, status);
+int chld = -1;  // child-event descriptor, for reap_zombies()
+
+// Returns the number of exits it reported.
+int reap_zombies() {
+    int reaped[2*NPROC];  // (pid, status) pairs
+    int n, nreported = 0;
+    do {
+        if ((n = read(chld, reaped, sizeof(reaped))) < 0)
+            n = 0;
+        n /= 2*sizeof(int);
+        for (int i = 0; i < n; i++) {
+            int pid = reaped[2*i], status = reaped[2*i+1];
+            if (remove_job(pid)) {
+                printf("[bg %d] exited with status %d\n", pid, status);
+                nreported++;
+            }
         }
+    } while (n == NPROC);
+    return nreported;
+}
+
+// Block until input arrives, reporting background jobs
+// that exit meanwhile and prompting again after them.
+void wait_input(void) {
+    struct pollfd pf[2];
+
+    pf[0].fd = 0;
+    pf[0].events = POLLIN;
+    pf[1].fd = chld;
+    pf[1].events = POLLIN;
+    for (;;) {
+        if (poll(pf, 2, -1) < 0)
+            return;
+        if (pf[1].revents & POLLHUP)
+            pf[1].fd = -1;  // no children left to wait for
+        if ((pf[1].revents & POLLIN) && reap_zombies() > 0)
+            fprintf(2, "$ ");
+        if (pf[0].revents)
+            return;
     }
 }
 
@@ -119,16 +239,38 @@ void wait_for_foreground(int foreground_pid) {
     while ((reaped_pid = wait(&status)) > 0) {
         if (reaped_pid == foreground_pid) {
             break;
-        } else if (is_bg_job(reaped_pid)) {
-         
-            remove_job(reaped_pid);
+        } else if (remove_job(reaped_pid)) {
             printf("[bg %d] exited with status %d\n", reaped_pid, status);
-         
         }
     }
 }
 
 
+// The wait builtin: wait for every background job, showing
+// what each used, itself and its reaped descendants.
+void wait_for_jobs(void) {
+    struct rusage before, after, ru;
+    int status;
+    int pid;
+
+    getrusage(RUSAGE_CHILDREN, &before);
+    while ((pid = wait(&status)) > 0) {
+        getrusage(RUSAGE_CHILDREN, &after);
+        if (remove_job(pid)) {
+            printf("[bg %d] exited with status %d\n", pid, status);
+            ru.utime = after.utime - before.utime;
+            ru.stime = after.stime - before.stime;
+            ru.nvcsw = after.nvcsw - before.nvcsw;
+            ru.nivcsw = after.nivcsw - before.nivcsw;
+            ru.nfault = after.nfault - before.nfault;
+            ru.ninblock = after.ninblock - before.ninblock;
+            print_rusage(&ru);
+        }
+        before = after;
+    }
+}
+
+
 void set_background_flag(struct cmd *cmd) {
     if (cmd == 0) return;
 
@@ -162,6 +304,7 @@ runcmd(struct cmd *cmd)
   struct pipecmd *pcmd;
   struct redircmd *rcmd;
   int pid, pid_left, pid_right;
+  int lead;
 
   if(cmd == 0)
     return; 
@@ -183,12 +326,26 @@ runcmd(struct cmd *cmd)
     }
 
     if(strcmp(ecmd->argv[0], "jobs") == 0){
-      print_jobs();
+      print_jobs(ecmd->argv[1] != 0 && strcmp(ecmd->argv[1], "-l") == 0);
       return; 
     }
 
-    pid = fork1();
-    if(pid == 0) { 
+    if(strcmp(ecmd->argv[0], "wait") == 0 && is_shell()){
+      wait_for_jobs();
+      return;
+    }
+
+    lead = ecmd->back && is_shell();
+    // start the program without copying the shell first;
+    // if it can't be loaded, fork so that the child reports
+    // the failure as it always has.
+    pid = spawn1(ecmd->argv[0], ecmd->argv, lead ? SPAWN_SETSID : 0);
+    if(pid < 0 && (pid = fork1()) == 0) { 
+      // a background job gets its own session, so it
+      // can't use up the shell's process quota, and its
+      // own process group, so kill -pid ends all of it.
+      if(lead)
+        setsid();
       exec(ecmd->argv[0], ecmd->argv);
       fprintf(2, "exec %s failed\n", ecmd->argv[0]);
       exit(0);
@@ -196,6 +353,7 @@ runcmd(struct cmd *cmd)
 
     if (is_shell()) {
       if (ecmd->back) {
+        setpgid(pid, 0);  // in case we kill it before it runs
         add_job(pid);
         printf("[%d]\n", pid);
       } else {
@@ -229,8 +387,15 @@ runcmd(struct cmd *cmd)
     if(pipe(p) < 0)
       panic("pipe");
     
+    int is_background = 0;
+    if (pcmd->left->type == EXEC)
+      is_background = ((struct execcmd*)pcmd->left)->back;
+
+    lead = is_background && is_shell();
     pid_left = fork1();
     if(pid_left == 0){ 
+      if (lead)
+        setsid();
       close(1);
       dup(p[1]);
       close(p[0]);
@@ -239,8 +404,12 @@ runcmd(struct cmd *cmd)
       exit(0);
     }
 
+    if (lead)
+      setpgid(pid_left, 0);
     pid_right = fork1();
     if(pid_right == 0){ 
+      if (lead)
+        setpgid(0, pid_left);
       close(0);
       dup(p[0]);
       close(p[0]);
@@ -248,14 +417,12 @@ runcmd(struct cmd *cmd)
       runcmd(pcmd->right);
       exit(0);
     }
-    
+    if (lead)
+      setpgid(pid_right, pid_left);  // in case we kill it before it runs
+
     close(p[0]);
     close(p[1]);
 
-    int is_background = 0;
-    if (pcmd->left->type == EXEC)
-      is_background = ((struct execcmd*)pcmd->left)->back;
-
     if (is_shell()) {
       if (is_background) {
         add_job(pid_left);         
@@ -286,11 +453,14 @@ int
 main(int argc, char *argv[])
 {
   static char buf[100];
+  char *p;
   int fd;
   shellpid = getpid();
 
-  for(int i = 0; i < NPROC; i++)
-    bg_jobs[i] = 0;
+  // stay responsive while jobs spin on the CPU.
+  setpriority(0, SHPRIO);
+
+  init_jobs();
 
   if(argc > 1){
     if((fd = open(argv[1], O_RDONLY)) < 0){
@@ -299,13 +469,13 @@ main(int argc, char *argv[])
     }
   } else {
     fd = 0;
+    // exited children, without a trap per wait_noblock().
+    chld = chldfd(CHLD_NONBLOCK);
   }
 
   while(1){
-    if(fd == 0) {
-        sleep(1);
+    if(fd == 0)
         reap_zombies();
-    }
 
     if(getcmd(buf, sizeof(buf), fd) < 0){
       break; // EOF
@@ -316,6 +486,10 @@ main(int argc, char *argv[])
     }
 
     if(buf[0] == '\n' || buf[0] == 0)continue;
+
+    strcpy(curline, buf);
+    if((p = strchr(curline, '\n')) != 0)
+      *p = 0;
   
     runcmd(parsecmd(buf));
     
@@ -335,6 +509,21 @@ fork1(void)
   return pid;
 }
 
+// Spawn, panicking like fork1() if no process can be made.
+// Returns -1 if the program can't be loaded.
+int
+spawn1(char *path, char **argv, int flags)
+{
+  int pid;
+
+  pid = spawn(path, argv, 0, 0, flags);
+  if(pid == -1)
+    panic("fork");
+  if(pid < 0)
+    return -1;
+  return pid;
+}
+
 void
 panic(char *s)
 {
@@ -649,6 +838,8 @@ getcmd(char *buf, int nbuf, int fd)
   if(fd == 0) {
     // Interactive mode
     fprintf(2, "$ ");
+    if(chld >= 0)
+      wait_input();
   }
  
   memset(buf, 0, nbuf);
@@ -0,0 +1,75 @@
+// Run a command with kernel event tracing on, and stream the
+// events as they arrive, one line per event:
+// "trace time cpu pid event a b", with time in timer cycles.
+// Each CPU's events come out in order; sort on time to merge
+// the CPUs.
+
+#include "kernel/types.h"
+#include "kernel/trace.h"
+#include "user/user.h"
+
+#define NBUF 64
+
+char *names[] = {
+[TR_SYSENTER]  "sysenter",
+[TR_SYSEXIT]   "sysexit",
+[TR_SWTCH]     "swtch",
+[TR_SLEEP]     "sleep",
+[TR_WAKEUP]    "wakeup",
+[TR_DISKSUB]   "disksub",
+[TR_DISKDONE]  "diskdone",
+[TR_COMMIT]    "commit",
+[TR_LOST]      "lost",
+};
+
+struct traceevent buf[NBUF];
+
+void
+drain(int show)
+{
+  int n;
+
+  while((n = traceread(buf, NBUF)) > 0){
+    for(int i = 0; show && i < n; i++){
+      struct traceevent *e = &buf[i];
+      printf("trace %ld %d %d %s %lx %lx\n", e->time, e->cpu, e->pid,
+             names[e->type], e->a, e->b);
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mask = TRACEALL;
+  int pid, xstatus;
+
+  if(argc > 2 && strcmp(argv[1], "-m") == 0){
+    mask = atoi(argv[2]);
+    argv += 2;
+    argc -= 2;
+  }
+  if(argc < 2){
+    fprintf(2, "usage: trace [-m mask] command [args...]\n");
+    exit(1);
+  }
+  drain(0);  // leftovers of an earlier run
+  trace(mask);
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "trace: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    fprintf(2, "trace: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  while(wait_noblock(&xstatus) != pid){
+    sleep(1);
+    drain(1);
+  }
+  trace(0);
+  drain(1);
+  exit(0);
+}
@@ -1,6 +1,9 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
+#include "kernel/vdso.h"
 #include "user/user.h"
 
 //
@@ -14,6 +17,45 @@ start()
   exit(0);
 }
 
+// set by printf.c once stdout holds buffered output, so
+// that it gets written before the process exits, execs,
+// or forks a child that would write it a second time.
+void (*stdioflush)(void);
+
+int
+fork(void)
+{
+  if(stdioflush)
+    stdioflush();
+  return _fork();
+}
+
+int
+exit(int status)
+{
+  if(stdioflush)
+    stdioflush();
+  _exit(status);
+}
+
+int
+exec(const char *path, char **argv)
+{
+  if(stdioflush)
+    stdioflush();
+  return _exec(path, argv);
+}
+
+// the child can't inherit buffered output, but should
+// not get to write before what the parent printed first.
+int
+spawn(const char *path, char **argv, struct spawnact *acts, int nact, int flags)
+{
+  if(stdioflush)
+    stdioflush();
+  return _spawn(path, argv, acts, nact, flags);
+}
+
 char*
 strcpy(char *s, const char *t)
 {
@@ -63,6 +105,17 @@ strchr(const char *s, char c)
   return 0;
 }
 
+void*
+memchr(const void *s, int c, uint n)
+{
+  const char *p = s;
+
+  for(; n > 0; n--, p++)
+    if(*p == (char)c)
+      return (void*)p;
+  return 0;
+}
+
 char*
 gets(char *buf, int max)
 {
@@ -145,3 +198,22 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// the time register, in VDSO->freq cycles per second.
+uint64
+rdtime(void)
+{
+  uint64 x;
+  asm volatile("rdtime %0" : "=r" (x));
+  return x;
+}
+
+// nanoseconds since boot, without a system call.
+uint64
+nsectime(void)
+{
+  struct vdso *v = (struct vdso*)VDSO;
+  uint64 t = rdtime() - v->boottime;
+
+  return t / v->freq * 1000000000 + t % v->freq * 1000000000 / v->freq;
+}
@@ -3,8 +3,14 @@
 #include "user/user.h"
 #include "kernel/param.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Small requests, up to MAXSMALL bytes, are rounded up to one of
+// NCLASS power-of-two sizes and served from a free list per size,
+// refilled a chunk at a time, so malloc() and free() are a few
+// instructions with no list walk. Freed small blocks stay on their
+// size's list. Larger requests use the first-fit allocator by
+// Kernighan and Ritchie, The C programming Language, 2nd ed.
+// Section 8.7, which also supplies the chunks and gets its memory
+// from sbrk() at least 64KB at a time.
 
 typedef long Align;
 
@@ -18,15 +24,22 @@ union header {
 
 typedef union header Header;
 
+#define NCLASS   8                    // 16, 32, ..., 2048 bytes
+#define MAXSMALL (16 << (NCLASS-1))
+#define CHUNK    4096                 // bytes carved per refill
+
+// a block of size class c, with its header, is (1<<c)+1 units;
+// its header's size says which class it is.
+static Header *bins[NCLASS];
+
 static Header base;
 static Header *freep;
 
-void
-free(void *ap)
+static void
+lfree(Header *bp)
 {
-  Header *bp, *p;
+  Header *p;
 
-  bp = (Header*)ap - 1;
   for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
     if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
       break;
@@ -56,12 +69,12 @@ morecore(uint nu)
     return 0;
   hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  lfree(hp);
   return freep;
 }
 
-void*
-malloc(uint nbytes)
+static void*
+lmalloc(uint nbytes)
 {
   Header *p, *prevp;
   uint nunits;
@@ -88,3 +101,59 @@ malloc(uint nbytes)
         return 0;
   }
 }
+
+// carve a chunk from the large allocator into blocks of class c.
+static int
+refill(int c)
+{
+  uint units = (1 << c) + 1;
+  uint n = CHUNK / (units * sizeof(Header));
+  Header *p;
+
+  if(n < 8)
+    n = 8;
+  if((p = lmalloc(n * units * sizeof(Header))) == 0)
+    return -1;
+  for(; n > 0; n--, p += units){
+    p->s.size = units;
+    p->s.ptr = bins[c];
+    bins[c] = p;
+  }
+  return 0;
+}
+
+void
+free(void *ap)
+{
+  Header *bp;
+  int c;
+
+  if(ap == 0)
+    return;
+  bp = (Header*)ap - 1;
+  if(bp->s.size <= MAXSMALL/sizeof(Header) + 1){
+    for(c = 0; (1 << c) + 1 < bp->s.size; c++)
+      ;
+    bp->s.ptr = bins[c];
+    bins[c] = bp;
+    return;
+  }
+  lfree(bp);
+}
+
+void*
+malloc(uint nbytes)
+{
+  Header *p;
+  int c;
+
+  if(nbytes > MAXSMALL)
+    return lmalloc(nbytes);
+  for(c = 0; (16 << c) < nbytes; c++)
+    ;
+  if(bins[c] == 0 && refill(c) < 0)
+    return 0;
+  p = bins[c];
+  bins[c] = p->s.ptr;
+  return (void*)(p + 1);
+}
@@ -1,15 +1,25 @@
 struct stat;
+struct schedstat;
+struct memstat;
+struct lockstat;
+struct profsample;
+struct rusage;
+struct traceevent;
+struct uring;
+struct iovec;
+struct spawnact;
+struct pollfd;
 
 // system calls
-int fork(void);
-int exit(int) __attribute__((noreturn));
+int _fork(void);
+int _exit(int) __attribute__((noreturn));
 int wait(int*);
 int pipe(int*);
 int write(int, const void*, int);
 int read(int, void*, int);
 int close(int);
 int kill(int);
-int exec(const char*, char**);
+int _exec(const char*, char**);
 int open(const char*, int);
 int mknod(const char*, short, short);
 int unlink(const char*);
@@ -23,21 +33,54 @@ char* sbrk(int);
 int sleep(int);
 int uptime(void);
 int wait_noblock(int *status);
+int sched_stat(struct schedstat*, int);
+int wait_batch(int *pairs, int n);
+int setsid(void);
+int nprocs(int sid);
+int setpriority(int pid, int prio);
+int setmaxproc(int n);
+int setpgid(int pid, int pgid);
+int killpg(int pgid);
+int memstat(struct memstat*);
+int lockstat(struct lockstat*, int);
+int profile(int on);
+int profread(struct profsample*, int);
+int getrusage(int who, struct rusage*);
+int trace(int mask);
+int traceread(struct traceevent*, int);
+int uring_enter(struct uring*);
+int readv(int fd, const struct iovec*, int);
+int writev(int fd, const struct iovec*, int);
+int _spawn(const char*, char**, struct spawnact*, int, int);
+int chldfd(int flags);
+int poll(struct pollfd*, int, int);
+void* mmap(void*, uint64, int, int, int, uint64);
+int munmap(void*, uint64);
+int sendfile(int, int, int);
 
 // ulib.c
+extern void (*stdioflush)(void);
+int fork(void);
+int exit(int) __attribute__((noreturn));
+int exec(const char*, char**);
+int spawn(const char*, char**, struct spawnact*, int, int);
 int stat(const char*, struct stat*);
 char* strcpy(char*, const char*);
 void *memmove(void*, const void*, int);
 char* strchr(const char*, char c);
+void* memchr(const void*, int, uint);
 int strcmp(const char*, const char*);
 void fprintf(int, const char*, ...) __attribute__ ((format (printf, 2, 3)));
 void printf(const char*, ...) __attribute__ ((format (printf, 1, 2)));
+void fflush(int);
 char* gets(char*, int max);
 uint strlen(const char*);
 void* memset(void*, int, uint);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+uint64 rdtime(void);
+uint64 nsectime(void);
 
 // umalloc.c
 void* malloc(uint);
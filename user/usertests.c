@@ -7,6 +7,13 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/rusage.h"
+#include "kernel/uring.h"
+#include "kernel/uio.h"
+#include "kernel/memstat.h"
+#include "kernel/spawn.h"
+#include "kernel/poll.h"
+#include "kernel/mman.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -2586,6 +2593,965 @@ badarg(char *s)
   exit(0);
 }
 
+// fork a process whose memory is more than half of physical
+// memory, which only copy-on-write fork can share. then check
+// that a store by the child stays private to the child.
+void
+cowfork(char *s)
+{
+  enum { SZ = 80*1024*1024 };
+  char *a, *p;
+  int pid, ppid, xstatus;
+
+  ppid = getpid();
+  a = sbrk(SZ);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(p = a; p < a + SZ; p += 4096)
+    *(int*)p = ppid;
+
+  for(int i = 0; i < 3; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      for(p = a; p < a + SZ; p += 64*4096){
+        if(*(int*)p != ppid){
+          printf("%s: child read wrong value\n", s);
+          exit(1);
+        }
+        *(int*)p = getpid();
+      }
+      exit(0);
+    }
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(1);
+  }
+
+  for(p = a; p < a + SZ; p += 4096){
+    if(*(int*)p != ppid){
+      printf("%s: parent memory changed by child\n", s);
+      exit(1);
+    }
+  }
+  sbrk(-SZ);
+}
+
+// wait_batch() should reap every exited child, with the
+// right status, in one call.
+void
+waitbatch(char *s)
+{
+  enum { N = 5 };
+  int pids[N], reaped[2*N], n, got = 0;
+
+  for(int i = 0; i < N; i++){
+    pids[i] = fork();
+    if(pids[i] < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pids[i] == 0)
+      exit(i);
+  }
+
+  for(int tries = 0; got < N && tries < 100; tries++){
+    sleep(1);
+    n = wait_batch(reaped + 2*got, N - got);
+    if(n < 0){
+      printf("%s: wait_batch failed\n", s);
+      exit(1);
+    }
+    got += n;
+  }
+  if(got != N){
+    printf("%s: reaped %d of %d children\n", s, got, N);
+    exit(1);
+  }
+  for(int i = 0; i < N; i++){
+    int j;
+    for(j = 0; j < N && pids[j] != reaped[2*i]; j++)
+      ;
+    if(j == N || reaped[2*i+1] != j){
+      printf("%s: bad pid %d or status %d\n", s, reaped[2*i], reaped[2*i+1]);
+      exit(1);
+    }
+  }
+  if(wait_batch(reaped, N) != 0 || wait(0) != -1){
+    printf("%s: extra children\n", s);
+    exit(1);
+  }
+}
+
+// sbrk more than physical memory, which only works if the heap
+// is allocated on first touch, including touches by system calls.
+void
+lazysbrk(char *s)
+{
+  enum { BIG = 1024*1024*1024 };
+  char *a, *p;
+  int fds[2];
+  char buf[8];
+
+  a = sbrk(BIG);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(p = a; p < a + BIG; p += BIG/16)
+    *p = 'x';
+  for(p = a; p < a + BIG; p += BIG/16){
+    if(*p != 'x' || *(p+4096) != 0){
+      printf("%s: bad lazy page contents\n", s);
+      exit(1);
+    }
+  }
+
+  // a read() into, and a write() from, untouched pages.
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  p = a + BIG - 8192;
+  if(write(fds[1], "lazy", 4) != 4 || read(fds[0], p, 4) != 4 ||
+     write(fds[1], p + 4096, 4) != 4 || read(fds[0], buf, 4) != 4){
+    printf("%s: system call on lazy page failed\n", s);
+    exit(1);
+  }
+  if(memcmp(p, "lazy", 4) != 0 || buf[0] != 0){
+    printf("%s: system call saw wrong data\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  sbrk(-BIG);
+}
+
+// setpriority() accepts 1..MAXPRIO for existing processes only.
+void
+setprio(char *s)
+{
+  int pid, xst;
+
+  if(setpriority(0, 0) != -1 || setpriority(0, MAXPRIO+1) != -1){
+    printf("%s: setpriority accepted a bad priority\n", s);
+    exit(1);
+  }
+  if(setpriority(0, MAXPRIO) != 0 || setpriority(getpid(), DEFPRIO) != 0){
+    printf("%s: setpriority failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(0);
+  wait(&xst);
+  if(setpriority(pid, DEFPRIO) != -1){
+    printf("%s: setpriority of a reaped process succeeded\n", s);
+    exit(1);
+  }
+  // kernel threads have negative pids, and are off limits.
+  if(setpriority(-1, DEFPRIO) != -1 || kill(-1) != -1){
+    printf("%s: reached a kernel thread\n", s);
+    exit(1);
+  }
+}
+
+// fork() fails once setmaxproc()'s limit is reached.
+void
+maxproc(char *s)
+{
+  int old, pid, xst;
+
+  if(setmaxproc(NPROCMAX+1) != -1){
+    printf("%s: setmaxproc accepted too large a limit\n", s);
+    exit(1);
+  }
+  old = setmaxproc(nprocs(0));
+  pid = fork();
+  if(pid == 0)
+    exit(0);
+  setmaxproc(old);
+  if(pid > 0){
+    wait(&xst);
+    printf("%s: fork beyond the limit succeeded\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed after restoring the limit\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(0);
+  wait(&xst);
+}
+
+// a process can't escape its session's quota by calling
+// setsid() after each fork(): the new sessions nest in it.
+void
+setsidquota(char *s)
+{
+  int fds[2], pid, n, xst;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    setsid();
+    close(fds[1]);
+    for(n = 0; n < NPROCSESS + 8; n++){
+      if((pid = fork()) < 0)
+        break;
+      if(pid == 0){
+        setsid();
+        read(fds[0], &xst, 1);  // until the parent closes fds[1]
+        exit(0);
+      }
+    }
+    exit(n < NPROCSESS ? 0 : 1);
+  }
+  close(fds[0]);
+  wait(&xst);
+  close(fds[1]);
+  if(xst != 0){
+    printf("%s: setsid() escaped the session quota\n", s);
+    exit(1);
+  }
+}
+
+// killpg() kills a whole process group in one call.
+void
+killpgtest(char *s)
+{
+  int fds[2], pid, n, xst;
+  char c;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    setpgid(0, 0);
+    for(int i = 0; i < 5; i++){
+      if(fork() == 0){
+        for(;;)
+          sleep(1000);
+      }
+    }
+    write(fds[1], "x", 1);
+    for(;;)
+      sleep(1000);
+  }
+  close(fds[1]);
+  if(read(fds[0], &c, 1) != 1){
+    printf("%s: child didn't get going\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  if((n = killpg(pid)) != 6){
+    printf("%s: killpg killed %d, expected 6\n", s, n);
+    exit(1);
+  }
+  wait(&xst);
+  if(xst != -1){
+    printf("%s: group leader exited with %d\n", s, xst);
+    exit(1);
+  }
+  if(killpg(pid) != -1){
+    printf("%s: killpg found live members afterwards\n", s);
+    exit(1);
+  }
+}
+
+// a heap big enough for megapages survives shrinking to
+// the middle of one, and fork(), and regrowing it doesn't
+// allocate a megapage for the stretch that is split.
+void
+megaheap(char *s)
+{
+  char *start, *p, *end;
+  int pid, xst;
+  uint64 n = 6*1024*1024;
+  struct memstat before, after;
+
+  start = sbrk(n);
+  if(start == (char*)-1){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(p = start; p < start + n; p += 4096)
+    *p = (uint64)p >> 12;
+  if(sbrk(-(n/2 + 4096)) == (char*)-1){
+    printf("%s: sbrk shrink failed\n", s);
+    exit(1);
+  }
+  end = start + n/2 - 4096;
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  for(p = start; p < end; p += 4096){
+    if(*p != (char)((uint64)p >> 12)){
+      printf("%s: read wrong data\n", s);
+      exit(1);
+    }
+    *p = 0;
+  }
+  if(pid == 0)
+    exit(0);
+  wait(&xst);
+  if(xst != 0)
+    exit(1);
+
+  // regrowing the rest of the stretch the shrink split
+  // faults in ordinary pages, without a megapage.
+  if((uint64)end % MEGAPGSIZE == 0){
+    sbrk(-4096);
+    end -= 4096;
+  }
+  n = MEGAPGSIZE - (uint64)end % MEGAPGSIZE;
+  if(memstat(&before) < 0 || sbrk(n) == (char*)-1){
+    printf("%s: memstat or sbrk failed\n", s);
+    exit(1);
+  }
+  for(p = end; p < end + n; p += 4096)
+    *p = 1;
+  if(memstat(&after) < 0 ||
+     after.nalloc[MEGAORDER] != before.nalloc[MEGAORDER]){
+    printf("%s: fault in a split stretch allocated a megapage\n", s);
+    exit(1);
+  }
+  sbrk(start - sbrk(0));
+}
+
+// a reaped child's CPU time and preemptions show up in
+// the parent's RUSAGE_CHILDREN totals.
+void
+rusage(char *s)
+{
+  struct rusage before, after;
+  int pid, xst, t0;
+
+  if(getrusage(RUSAGE_SELF, &before) < 0 ||
+     getrusage(RUSAGE_CHILDREN, &before) < 0){
+    printf("%s: getrusage failed\n", s);
+    exit(1);
+  }
+  if(getrusage(999999, &after) != -1){
+    printf("%s: getrusage found a bogus pid\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    t0 = uptime();
+    while(uptime() < t0 + 3)
+      ;
+    exit(0);
+  }
+  wait(&xst);
+  getrusage(RUSAGE_CHILDREN, &after);
+  if(after.utime + after.stime < before.utime + before.stime + 1){
+    printf("%s: child's ticks not counted\n", s);
+    exit(1);
+  }
+  if(after.nivcsw <= before.nivcsw){
+    printf("%s: child's preemptions not counted\n", s);
+    exit(1);
+  }
+}
+
+// uring_enter() runs a batch in order and posts each
+// result with its submission's data.
+void
+uringbatch(char *s)
+{
+  static struct uring r;
+  static int ops[] = { URING_WRITE, URING_READ, URING_NOP, 99, URING_READ };
+  static int want[] = { 5, 5, 0, -1, -1 };
+  int nops = sizeof(ops)/sizeof(ops[0]);
+  char out[8];
+  int fds[2];
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < nops; i++){
+    struct uring_sqe *e = &r.sq[r.sqtail++ % NSQE];
+    e->op = ops[i];
+    e->fd = i == 0 ? fds[1] : i == 4 ? NOFILE : fds[0];
+    e->addr = (uint64)(i == 0 ? "hello" : out);
+    e->n = 5;
+    e->data = 100 + i;
+  }
+  if(uring_enter(&r) != nops || r.sqhead != r.sqtail){
+    printf("%s: uring_enter didn't run the batch\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < nops; i++){
+    struct uring_cqe *c = &r.cq[r.cqhead++ % NCQE];
+    if(c->data != 100 + i || c->res != want[i]){
+      printf("%s: op %d: data %d res %d\n", s, i, (int)c->data, c->res);
+      exit(1);
+    }
+  }
+  if(memcmp(out, "hello", 5) != 0){
+    printf("%s: read wrong data\n", s);
+    exit(1);
+  }
+  r.sqtail = r.sqhead + NSQE + 1;
+  if(uring_enter(&r) != -1){
+    printf("%s: uring_enter took an overfull ring\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// writev() gathers buffers into a file in order, and
+// readv() scatters the file back across other boundaries.
+void
+vectorio(char *s)
+{
+  char a[3], b[5];
+  struct iovec out[3] = {
+    { "ab", 2 }, { "", 0 }, { "cdefgh", 6 },
+  };
+  struct iovec in[2] = {
+    { a, sizeof(a) }, { b, sizeof(b) },
+  };
+  int fd;
+
+  unlink("vectorio");
+  if((fd = open("vectorio", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  if(writev(fd, out, 3) != 8){
+    printf("%s: writev failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("vectorio", O_RDONLY);
+  if(readv(fd, in, 2) != 8 || memcmp(a, "abc", 3) != 0 ||
+     memcmp(b, "defgh", 5) != 0){
+    printf("%s: readv read the wrong data\n", s);
+    exit(1);
+  }
+  if(readv(fd, in, 2) != 0){
+    printf("%s: readv read past the end\n", s);
+    exit(1);
+  }
+  if(readv(fd, in, IOV_MAX + 1) != -1){
+    printf("%s: readv took too many buffers\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("vectorio");
+}
+
+// buffered stdout isn't written twice by a fork()ed child,
+// and exit() writes a partial line.
+void
+stdiobuf(char *s)
+{
+  char buf[16];
+  int fds[2], pid, xst, n, tot;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    close(1);
+    dup(fds[1]);
+    close(fds[1]);
+    printf("a");
+    if(fork() == 0)
+      exit(0);
+    wait(0);
+    printf("b\nc");
+    exit(0);
+  }
+  close(fds[1]);
+  tot = 0;
+  while(tot < sizeof(buf) && (n = read(fds[0], buf + tot, sizeof(buf) - tot)) > 0)
+    tot += n;
+  close(fds[0]);
+  wait(&xst);
+  if(tot != 4 || memcmp(buf, "ab\nc", 4) != 0){
+    printf("%s: child wrote %d bytes\n", s, tot);
+    exit(1);
+  }
+}
+
+uint64
+freepages(void)
+{
+  struct memstat st;
+  uint64 n;
+
+  if(memstat(&st) < 0)
+    return 0;
+  n = st.ncached;
+  for(int i = 0; i < NORDER; i++)
+    n += st.nfree[i] << i;
+  return n;
+}
+
+// an exited child's memory is free before it is reaped.
+void
+zombiemem(char *s)
+{
+  uint64 before;
+  char *p, *a;
+  int pid, xst;
+
+  before = freepages();
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if((a = sbrk(1024*4096)) == (char*)-1)
+      exit(1);
+    for(p = a; p < a + 1024*4096; p += 4096)
+      *p = 1;
+    exit(0);
+  }
+  sleep(10);
+  if(freepages() + 256 < before){
+    printf("%s: zombie still holds %d pages\n", s, (int)(before - freepages()));
+    exit(1);
+  }
+  wait(&xst);
+  if(xst != 0){
+    printf("%s: child failed\n", s);
+    exit(1);
+  }
+}
+
+// spawn() runs a program with file actions applied, and
+// uses up no pid when the program can't be loaded.
+void
+spawntest(char *s)
+{
+  int fds[2], pid, pid1, xst, n;
+  char buf[16];
+  char *argv[] = { "echo", "spawned", 0 };
+  struct spawnact acts[2];
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  acts[0].op = SPAWN_DUP;
+  acts[0].fd = fds[1];
+  acts[0].newfd = 1;
+  acts[1].op = SPAWN_CLOSE;
+  acts[1].fd = fds[0];
+  pid = spawn("echo", argv, acts, 2, 0);
+  if(pid < 0){
+    printf("%s: spawn failed\n", s);
+    exit(1);
+  }
+  close(fds[1]);
+  n = read(fds[0], buf, sizeof(buf));
+  close(fds[0]);
+  if(n != 8 || memcmp(buf, "spawned\n", 8) != 0){
+    printf("%s: wrong output from spawned echo\n", s);
+    exit(1);
+  }
+  if(wait(&xst) != pid || xst != 0){
+    printf("%s: wait failed\n", s);
+    exit(1);
+  }
+
+  if(spawn("nosuchprogram", argv, 0, 0, 0) != -2){
+    printf("%s: spawn of a missing program didn't fail\n", s);
+    exit(1);
+  }
+  pid1 = fork();
+  if(pid1 == 0)
+    exit(0);
+  wait(0);
+  if(pid1 != pid + 1){
+    printf("%s: failed spawn used up a pid\n", s);
+    exit(1);
+  }
+}
+
+// the clock read through the VDSO page moves forward at the
+// rate of uptime(), and user code can't write the page.
+void
+clocktest(char *s)
+{
+  uint64 t0, t1;
+  int u0, pid, xst;
+
+  t0 = nsectime();
+  u0 = uptime();
+  sleep(5);
+  t1 = nsectime();
+  if(t1 <= t0){
+    printf("%s: clock went backwards\n", s);
+    exit(1);
+  }
+  // 100ms ticks, allowing for the sleep's rounding.
+  if((t1 - t0) / 100000000 + 1 < uptime() - u0){
+    printf("%s: clock slower than uptime\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    *(uint64*)VDSO = 0;
+    exit(0);
+  }
+  wait(&xst);
+  if(xst != -1){
+    printf("%s: wrote the VDSO page\n", s);
+    exit(1);
+  }
+}
+
+// a child-event descriptor reaps exited children, blocking
+// or not, and isn't inherited.
+void
+chldfdtest(char *s)
+{
+  int fd, nfd, pid, xst, ev[2];
+
+  if((fd = chldfd(0)) < 0 || (nfd = chldfd(CHLD_NONBLOCK)) < 0){
+    printf("%s: chldfd failed\n", s);
+    exit(1);
+  }
+  if(read(fd, ev, sizeof(ev)) != 0){
+    printf("%s: read with no children didn't return 0\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(read(fd, ev, sizeof(ev)) >= 0)
+      exit(1);
+    sleep(5);
+    exit(7);
+  }
+  if(read(nfd, ev, sizeof(ev)) != 0){
+    printf("%s: non-blocking read waited\n", s);
+    exit(1);
+  }
+  if(read(fd, ev, sizeof(ev)) != sizeof(ev) || ev[0] != pid || ev[1] != 7){
+    printf("%s: wrong child event\n", s);
+    exit(1);
+  }
+  if(wait(&xst) != -1){
+    printf("%s: child reaped twice\n", s);
+    exit(1);
+  }
+  close(fd);
+  close(nfd);
+}
+
+// poll() times out on an empty pipe, then wakes when a child
+// writes to it, and when the child exits.
+void
+polltest(char *s)
+{
+  int fds[2], cfd, pid;
+  struct pollfd pf[3];
+  char c;
+
+  if(pipe(fds) < 0 || (cfd = chldfd(CHLD_NONBLOCK)) < 0){
+    printf("%s: pipe or chldfd failed\n", s);
+    exit(1);
+  }
+  pf[0].fd = fds[0];
+  pf[0].events = POLLIN;
+  pf[1].fd = cfd;
+  pf[1].events = POLLIN;
+  pf[2].fd = 99;
+  pf[2].events = POLLIN;
+  if(poll(pf, 2, 2) != 0 || pf[0].revents != 0){
+    printf("%s: poll on an empty pipe didn't time out\n", s);
+    exit(1);
+  }
+  if(poll(pf, 3, 0) != 2 || pf[1].revents != POLLHUP || pf[2].revents != POLLNVAL){
+    printf("%s: wrong revents for chldfd or a closed fd\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    sleep(3);
+    write(fds[1], "x", 1);
+    exit(0);
+  }
+  if(poll(pf, 1, -1) != 1 || pf[0].revents != POLLIN || read(fds[0], &c, 1) != 1){
+    printf("%s: poll didn't see the pipe write\n", s);
+    exit(1);
+  }
+  pf[0].events = 0;
+  if(poll(pf, 2, -1) < 1 || pf[1].revents != POLLIN){
+    printf("%s: poll didn't see the child exit\n", s);
+    exit(1);
+  }
+  wait(0);
+  close(fds[0]);
+  close(fds[1]);
+  close(cfd);
+}
+
+// anonymous mappings are zeroed and shared ones survive fork();
+// shared file mappings see each other's stores and write()s,
+// stores reach the file on munmap(), and an unmapped page faults.
+void
+mmaptest(char *s)
+{
+  char *a, *b, buf[8];
+  int fd, pid, xst;
+
+  a = mmap(0, 2*4096, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  b = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  if(a == MAP_FAILED || b == MAP_FAILED || a[4096] != 0 || b[0] != 0){
+    printf("%s: anonymous mmap failed\n", s);
+    exit(1);
+  }
+  a[0] = 'p';
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    a[0] = 'c';
+    b[0] = 'c';
+    exit(0);
+  }
+  wait(0);
+  if(a[0] != 'p' || b[0] != 'c'){
+    printf("%s: private or shared mapping wrong after fork\n", s);
+    exit(1);
+  }
+
+  fd = open("mmapf", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, "abcdefgh", 8) != 8){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  a = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(a == MAP_FAILED || a[1] != 'b' || a[8] != 0){
+    printf("%s: file mmap failed\n", s);
+    exit(1);
+  }
+  a[1] = 'B';
+  b = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(b == MAP_FAILED || b[1] != 'B' || write(fd, "ij", 2) != 2 ||
+     a[8] != 'i' || b[9] != 'j'){
+    printf("%s: shared file mappings out of step\n", s);
+    exit(1);
+  }
+  if(munmap(b, 4096) < 0 || munmap(a, 4096) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("mmapf", O_RDONLY);
+  if(read(fd, buf, 8) != 8 || buf[1] != 'B' ||
+     read(fd, buf, 2) != 2 || buf[0] != 'i'){
+    printf("%s: store didn't reach the file\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("mmapf");
+
+  pid = fork();
+  if(pid == 0){
+    a[0] = 1;  // unmapped
+    exit(0);
+  }
+  wait(&xst);
+  if(xst != -1){
+    printf("%s: unmapped page didn't fault\n", s);
+    exit(1);
+  }
+}
+
+// read() from a pipe into a file mapping that hasn't been
+// touched yet faults the page in before taking the pipe's lock.
+void
+mmappipe(char *s)
+{
+  char *a;
+  int fd, fds[2];
+
+  fd = open("mmapp", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, "abcdefgh", 8) != 8){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  a = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(a == MAP_FAILED || pipe(fds) < 0){
+    printf("%s: mmap or pipe failed\n", s);
+    exit(1);
+  }
+  if(write(fds[1], "xy", 2) != 2 || read(fds[0], a + 2, 2) != 2 ||
+     a[1] != 'b' || a[2] != 'x' || a[4] != 'e'){
+    printf("%s: read into shared mapping failed\n", s);
+    exit(1);
+  }
+  munmap(a, 4096);
+
+  a = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(a == MAP_FAILED){
+    printf("%s: private mmap failed\n", s);
+    exit(1);
+  }
+  if(write(fds[1], "z", 1) != 1 || read(fds[0], a, 1) != 1 ||
+     a[0] != 'z' || a[2] != 'x'){
+    printf("%s: read into private mapping failed\n", s);
+    exit(1);
+  }
+  munmap(a, 4096);
+  close(fds[0]);
+  close(fds[1]);
+  close(fd);
+  unlink("mmapp");
+}
+
+// write() from a file mapping that hasn't been touched yet,
+// into the mapped file itself and, in two processes at once,
+// into each other's mapped file.
+void
+mmapwrite(char *s)
+{
+  char *a, buf[8];
+  int fa, fb, i, pid;
+
+  fa = open("mmapwa", O_CREATE|O_RDWR);
+  fb = open("mmapwb", O_CREATE|O_RDWR);
+  if(fa < 0 || fb < 0 || write(fa, "aaaaaaaa", 8) != 8 ||
+     write(fb, "bbbbbbbb", 8) != 8){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  a = mmap(0, 4096, PROT_READ, MAP_SHARED, fa, 0);
+  if(a == MAP_FAILED || write(fa, a, 8) != 8){
+    printf("%s: write from own mapping failed\n", s);
+    exit(1);
+  }
+  munmap(a, 4096);
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 20; i++){
+    a = mmap(0, 4096, PROT_READ, MAP_SHARED, pid == 0 ? fb : fa, 0);
+    if(a == MAP_FAILED || write(pid == 0 ? fa : fb, a, 8) != 8){
+      printf("%s: cross write failed\n", s);
+      exit(1);
+    }
+    munmap(a, 4096);
+  }
+  if(pid == 0)
+    exit(0);
+  wait(0);
+  close(fa);
+  close(fb);
+  fa = open("mmapwa", O_RDONLY);
+  if(read(fa, buf, 8) != 8 || (buf[0] != 'a' && buf[0] != 'b')){
+    printf("%s: file contents wrong\n", s);
+    exit(1);
+  }
+  close(fa);
+  unlink("mmapwa");
+  unlink("mmapwb");
+}
+
+// sendfile() copies a file into a pipe, and stops at its end.
+void
+sendfiletest(char *s)
+{
+  int fd, fds[2], i, n;
+  char buf[600];
+
+  fd = open("sendf", O_CREATE|O_RDWR);
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = i;
+  if(fd < 0 || write(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("sendf", O_RDONLY);
+  if(fd < 0 || pipe(fds) < 0){
+    printf("%s: open or pipe failed\n", s);
+    exit(1);
+  }
+  if((n = sendfile(fds[1], fd, 4096)) != sizeof(buf) || sendfile(fds[1], fd, 4096) != 0){
+    printf("%s: sendfile returned %d\n", s, n);
+    exit(1);
+  }
+  memset(buf, 0, sizeof(buf));
+  if(read(fds[0], buf, sizeof(buf)) != sizeof(buf) || buf[1] != 1 || buf[599] != (char)599){
+    printf("%s: wrong data in the pipe\n", s);
+    exit(1);
+  }
+  if(sendfile(fd, fds[0], 1) != -1){
+    printf("%s: sendfile to a read-only file worked\n", s);
+    exit(1);
+  }
+  close(fd);
+  close(fds[0]);
+  close(fds[1]);
+  unlink("sendf");
+}
+
 struct test {
   void (*f)(char *);
   char *s;
@@ -2650,6 +3616,27 @@ struct test {
   {sbrklast, "sbrklast"},
   {sbrk8000, "sbrk8000"},
   {badarg, "badarg" },
+  {cowfork, "cowfork"},
+  {waitbatch, "waitbatch"},
+  {lazysbrk, "lazysbrk"},
+  {setprio, "setprio"},
+  {maxproc, "maxproc"},
+  {setsidquota, "setsidquota"},
+  {killpgtest, "killpg"},
+  {megaheap, "megaheap"},
+  {rusage, "rusage"},
+  {uringbatch, "uringbatch"},
+  {vectorio, "vectorio"},
+  {stdiobuf, "stdiobuf"},
+  {zombiemem, "zombiemem"},
+  {spawntest, "spawn"},
+  {clocktest, "clock"},
+  {chldfdtest, "chldfd"},
+  {polltest, "poll"},
+  {mmaptest, "mmap"},
+  {mmappipe, "mmappipe"},
+  {mmapwrite, "mmapwrite"},
+  {sendfiletest, "sendfile"},
 
   { 0, 0},
 };
@@ -6,24 +6,27 @@ print "# generated by usys.pl - do not edit\n";
 
 print "#include \"kernel/syscall.h\"\n";
 
+# entry("_fork", "fork") names the stub for SYS_fork _fork,
+# leaving fork() to a wrapper in ulib.c.
 sub entry {
     my $name = shift;
+    my $sys = shift || $name;
     print ".global $name\n";
     print "${name}:\n";
-    print " li a7, SYS_${name}\n";
+    print " li a7, SYS_${sys}\n";
     print " ecall\n";
     print " ret\n";
 }
 	
-entry("fork");
-entry("exit");
+entry("_fork", "fork");
+entry("_exit", "exit");
 entry("wait");
 entry("pipe");
 entry("read");
 entry("write");
 entry("close");
 entry("kill");
-entry("exec");
+entry("_exec", "exec");
 entry("open");
 entry("mknod");
 entry("unlink");
@@ -37,3 +40,27 @@ entry("sbrk");
 entry("sleep");
 entry("uptime");
 entry("wait_noblock");
+entry("sched_stat");
+entry("wait_batch");
+entry("setsid");
+entry("nprocs");
+entry("setpriority");
+entry("setmaxproc");
+entry("setpgid");
+entry("killpg");
+entry("memstat");
+entry("lockstat");
+entry("profile");
+entry("profread");
+entry("getrusage");
+entry("trace");
+entry("traceread");
+entry("uring_enter");
+entry("readv");
+entry("writev");
+entry("_spawn", "spawn");
+entry("chldfd");
+entry("poll");
+entry("mmap");
+entry("munmap");
+entry("sendfile");